@@ -0,0 +1,90 @@
+"""
+Delta encoding of checkpoint solutions.
+
+A densely checkpointed run of a quasi-steady problem writes a sequence of
+solutions which differ only slightly from one another. In incremental
+checkpoint mode, the driver writes a full solution (a keyframe) every K
+checkpoints, and in between stores only the difference to the most recent
+keyframe, as a `DeltaSolution`.
+
+The difference is the bitwise XOR of the float64 bit patterns, which is
+exact, so a restored solution is bitwise identical to the one that was
+saved. Where a value has changed little, the sign, exponent, and leading
+mantissa bits cancel. The XOR is split into byte planes (all the most
+significant bytes first, and so on), so those runs of zero bytes are
+contiguous, and the result is compressed with zlib.
+
+Each delta refers to a keyframe rather than to the previous checkpoint, so
+restoring any checkpoint reads at most two files. It also records a CRC-32
+of the keyframe solution, so that a keyframe file which was overwritten
+since (for example by a restart from an earlier checkpoint) is detected
+rather than decoded against.
+"""
+
+import zlib
+from typing import NamedTuple
+
+
+class DeltaSolution(NamedTuple):
+    """
+    A solution array stored as a compressed difference to a keyframe.
+    """
+
+    keyframe: str
+    """ File name of the keyframe checkpoint, in the same directory """
+
+    shape: tuple
+    """ The shape of the solution array """
+
+    data: bytes
+    """ The compressed, byte-plane ordered XOR with the keyframe solution """
+
+    keyframe_checksum: int = None
+    """ CRC-32 of the keyframe solution the delta was encoded against """
+
+    @staticmethod
+    def checksum(solution):
+        """
+        Return the CRC-32 of the bytes of a float64 solution array.
+        """
+        import numpy as np
+
+        return zlib.crc32(np.ascontiguousarray(solution, dtype=np.float64).data)
+
+    @classmethod
+    def encode(cls, solution, keyframe_solution, keyframe, level=1):
+        """
+        Return the delta of a solution to a keyframe solution, which must
+        have the same shape.
+        """
+        import numpy as np
+
+        a = np.ascontiguousarray(solution, dtype=np.float64).view(np.uint64)
+        b = np.ascontiguousarray(keyframe_solution, dtype=np.float64).view(np.uint64)
+        planes = (a ^ b).view(np.uint8).reshape(-1, 8)[:, ::-1].T
+        data = zlib.compress(np.ascontiguousarray(planes).tobytes(), level)
+        checksum = cls.checksum(keyframe_solution)
+        return cls(keyframe, tuple(solution.shape), data, checksum)
+
+    def matches(self, keyframe_solution):
+        """
+        Return whether the given solution is the one the delta was encoded
+        against. Deltas written before the checksum was recorded match any
+        keyframe of the right shape.
+        """
+        if tuple(keyframe_solution.shape) != self.shape:
+            return False
+        if self.keyframe_checksum is None:
+            return True
+        return self.checksum(keyframe_solution) == self.keyframe_checksum
+
+    def decode(self, keyframe_solution):
+        """
+        Return the solution, given the keyframe solution.
+        """
+        import numpy as np
+
+        planes = np.frombuffer(zlib.decompress(self.data), dtype=np.uint8)
+        xor = np.ascontiguousarray(planes.reshape(8, -1).T[:, ::-1])
+        b = np.ascontiguousarray(keyframe_solution, dtype=np.float64).view(np.uint64)
+        return (xor.view(np.uint64).reshape(self.shape) ^ b).view(np.float64)
@@ -16,6 +16,7 @@ from sailfish.solvers import (
 
 logger = getLogger(__name__)
 user_build_config = dict()
+keyframe_cache = dict()
 
 
 class ConfigurationError(Exception):
@@ -60,6 +61,46 @@ def first_not_none(*args):
             return arg
 
 
+def parse_resolution_schedule(spec):
+    """
+    Return a list of (resolution, until) pairs from a string of the form
+    `N1:T1,N2:T2,...,N`.
+
+    The run uses resolution N1 until the user time T1, then N2 until T2, and
+    so on, and the final resolution N until the end of the run. Each
+    resolution must be a power-of-two multiple of the one before it.
+    """
+    schedule = list()
+
+    try:
+        *stages, final = spec.split(",")
+        for stage in stages:
+            resolution, until = stage.split(":")
+            schedule.append((int(resolution), float(until)))
+        schedule.append((int(final), float("inf")))
+    except ValueError:
+        raise ConfigurationError(f"bad resolution schedule {spec}, expect N1:T1,...,N")
+
+    for (n0, t0), (n1, t1) in zip(schedule[:-1], schedule[1:]):
+        factor = n1 // n0
+        if n1 % n0 or factor < 2 or factor & (factor - 1) or t1 <= t0:
+            raise ConfigurationError(
+                f"bad resolution schedule {spec}, resolutions must increase by "
+                "powers of two, at increasing times"
+            )
+
+    return schedule
+
+
+def scheduled_resolution(schedule, user_time):
+    """
+    Return the resolution given by a schedule at a user time.
+    """
+    for resolution, until in schedule:
+        if user_time < until:
+            return resolution
+
+
 def update_dict_where_none(new_dict, old_dict, frozen=[]):
     """
     Like `dict.update`, except `key=value` pairs in `old_dict` are only used
@@ -155,12 +196,20 @@ def write_checkpoint(number, outdir, state):
         pathlib.Path(outdir).mkdir(parents=True, exist_ok=True)
         filename = os.path.join(outdir, filename)
 
+    solution = state.solver.mapped_solution(pathlib.Path(filename).stem)
+    mapped = solution is not None
+
+    if not mapped:
+        solution = checkpoint_solution(
+            number, outdir, state.solver.solution, state.driver.checkpoint_keyframe
+        )
+
     state_checkpoint_dict = dict(
         iteration=state.iteration,
         time=state.solver.time,
         timestep_dt=state.timestep_dt,
         cfl_number=state.cfl_number,
-        solution=state.solver.solution,
+        solution=solution,
         primitive=state.solver.primitive,
         timeseries=state.timeseries,
         solver=state.setup.solver,
@@ -177,17 +226,237 @@ def write_checkpoint(number, outdir, state):
         logger.info(f"write checkpoint {chkpt.name}")
         pickle.dump(state_checkpoint_dict, chkpt)
 
+    # A pyramid is a copy of the solution, so it is not written when the
+    # checkpoint refers to file-backed state rather than copying it.
+    if not state.driver.no_pyramids and not mapped:
+        write_pyramid(filename, state)
+
+
+def checkpoint_solution(number, outdir, solution, keyframe_interval):
+    """
+    Return the solution to store in a checkpoint, which is either the
+    solution array itself, or in incremental checkpoint mode, its difference
+    to the most recent keyframe.
+
+    Every checkpoint whose number is a multiple of the keyframe interval is a
+    keyframe. The latest keyframe is kept in memory; after a restart it is
+    read from the output directory. If it cannot be read, the full solution
+    is written.
+    """
+    import numpy as np
+    from sailfish.delta import DeltaSolution
+
+    if not keyframe_interval or type(number) is not int:
+        return solution
+
+    keyframe = f"chkpt.{number - number % keyframe_interval:04d}.pk"
+    path = os.path.join(outdir or "", keyframe)
+
+    if number % keyframe_interval == 0:
+        keyframe_cache.clear()
+        keyframe_cache[path] = solution
+        return solution
+
+    if path not in keyframe_cache:
+        try:
+            keyframe_solution = load_checkpoint(path)["solution"]
+        except ConfigurationError:
+            keyframe_solution = None
+
+        if type(keyframe_solution) is not np.ndarray:
+            logger.warning(f"keyframe {path} is not available, write full checkpoint")
+            return solution
+
+        keyframe_cache.clear()
+        keyframe_cache[path] = keyframe_solution
+
+    if keyframe_cache[path].shape != solution.shape:
+        return solution
+
+    return DeltaSolution.encode(solution, keyframe_cache[path], keyframe)
+
+
+def pyramid_filename(chkpt_filename):
+    return chkpt_filename.replace(".pk", ".pyramid.npz")
+
+
+def write_pyramid(chkpt_filename, state):
+    """
+    Write the solution restricted to successively coarser meshes, next to a
+    checkpoint file.
+
+    The levels are written uncompressed to an npz archive, under the keys
+    `level1`, `level2`, etc., where level n has 2^n times fewer zones on a
+    side than the checkpoint. Nothing is written if the solver does not
+    provide a pyramid.
+    """
+    import numpy as np
+
+    if not hasattr(state.solver, "pyramid"):
+        return
+
+    levels = state.solver.pyramid()
+
+    if not levels:
+        return
+
+    mesh = state.mesh
+    np.savez(
+        pyramid_filename(chkpt_filename),
+        time=state.solver.time,
+        solver=state.setup.solver,
+        extent=(mesh.x0, mesh.x1, mesh.y0, mesh.y1),
+        shape=mesh.shape,
+        **{f"level{n + 1}": level for n, level in enumerate(levels)},
+    )
+
+
+def load_pyramid_level(chkpt_filename, pixels):
+    """
+    Return the coarsest level of a checkpoint's pyramid with at least the
+    given number of zones on each side, and the mesh extent.
+
+    Only the selected level is read from the file. The result is a tuple
+    `(primitive, extent, time)`, or None if there is no pyramid file or no
+    level coarser than the checkpoint is large enough.
+    """
+    import numpy as np
+
+    try:
+        archive = np.load(pyramid_filename(chkpt_filename))
+    except FileNotFoundError:
+        return None
+
+    with archive:
+        levels = sorted(
+            (int(k[5:]) for k in archive.files if k.startswith("level")),
+            reverse=True,
+        )
+        extent = tuple(archive["extent"])
+        time = float(archive["time"])
+        shape = archive["shape"]
+
+        for n in levels:
+            if min(shape) >> n >= pixels:
+                return archive[f"level{n}"], extent, time
+
+    return None
+
+
+def write_image(number, outdir, state, pipeline=None):
+    """
+    Render fields of the solution to PNG files, one per field.
+
+    The fields, downsampling factor, and colormap are given by the driver
+    arguments `image_fields`, `image_downsample`, and `image_colormap`. See
+    :py:mod:`sailfish.render` for the format of the fields string. The
+    fields are downsampled by the solver right away, and if a side effect
+    pipeline is given, they are colorized and written on its worker thread.
+    """
+    from sailfish.render import parse_image_fields
+
+    driver = state.driver
+
+    for field in parse_image_fields(driver.image_fields):
+        data = state.solver.downsampled_field(
+            field.name, driver.image_downsample, field.log_scale
+        )
+
+        if data is None:
+            logger.info("image event skipped: solver does not render images")
+            return
+
+        filename = f"image.{field.label}.{number:04d}.png"
+
+        if outdir is not None:
+            pathlib.Path(outdir).mkdir(parents=True, exist_ok=True)
+            filename = os.path.join(outdir, filename)
+
+        if pipeline is not None:
+            pipeline.submit(encode_image, filename, data, field, driver.image_colormap)
+        else:
+            encode_image(filename, data, field, driver.image_colormap)
+
+
+def encode_image(filename, data, field, colormap):
+    """
+    Colorize a downsampled field and write it to a PNG file.
+    """
+    from time import perf_counter
+    from sailfish.render import colorize, write_png
+
+    start = perf_counter()
+    rgb = colorize(data, field.vmin, field.vmax, colormap)
+    write_png(filename, rgb)
+    elapsed = perf_counter() - start
+    logger.info(f"write image {filename} in {elapsed * 1e3:.1f}ms")
+
+
+def write_averages(number, outdir, state):
+    """
+    Write the solver's time-averaged fields to a file, as a pickle.
+
+    The running sums are reset by the solver, so each file contains the
+    averages over the time since the previous one was written.
+    """
+    averages = state.solver.field_averages()
+
+    if averages is None:
+        logger.info("averages event skipped: no fields or no elapsed time")
+        return
+
+    filename = f"averages.{number:04d}.pk"
+
+    if outdir is not None:
+        pathlib.Path(outdir).mkdir(parents=True, exist_ok=True)
+        filename = os.path.join(outdir, filename)
+
+    averages_dict = dict(
+        **averages,
+        iteration=state.iteration,
+        mesh=state.mesh,
+        model_parameters=state.setup.model_parameter_dict(),
+        setup_name=state.setup.dash_case_class_name(),
+    )
+
+    with open(filename, "wb") as outf:
+        logger.info(f"write averages {outf.name}")
+        pickle.dump(averages_dict, outf)
+
 
 def load_checkpoint(chkpt_file):
     """
     Load the simulation state from a pickle file.
+
+    If the solution was stored as a difference to a keyframe, the keyframe is
+    loaded from the same directory and the solution is restored. An error is
+    raised if the keyframe file no longer holds the solution the difference
+    was taken against.
     """
+    from sailfish.delta import DeltaSolution
+
     try:
         with open(chkpt_file, "rb") as file:
-            return pickle.load(file)
+            chkpt = pickle.load(file)
     except FileNotFoundError:
         raise ConfigurationError(f"could not open checkpoint file {chkpt_file}")
 
+    delta = chkpt.get("solution")
+
+    if type(delta) is DeltaSolution:
+        keyframe_file = os.path.join(os.path.dirname(chkpt_file), delta.keyframe)
+        keyframe = load_checkpoint(keyframe_file)
+
+        if not delta.matches(keyframe["solution"]):
+            raise ConfigurationError(
+                f"keyframe {keyframe_file} of checkpoint {chkpt_file} has been "
+                "overwritten since the checkpoint was written"
+            )
+
+        chkpt["solution"] = delta.decode(keyframe["solution"])
+
+    return chkpt
+
 
 def newest_chkpt_in_directory(directory_name):
     import re
@@ -225,6 +494,65 @@ def append_timeseries(state):
         )
 
 
+def append_probes(outdir, state):
+    """
+    Append the solver's buffered probe samples to the file `probes.dat`.
+
+    The file is raw float64 data, with one row per sample: the simulation
+    time, followed by the primitive variables at each probe. It is only ever
+    appended to, so after a restart it contains the samples between the
+    checkpoint and the end of the interrupted run twice; `load_probes` drops
+    the earlier copy. The probe descriptions are written to `probes.pk` when
+    the data file is created.
+    """
+    samples = state.solver.probe_samples()
+
+    if samples is None:
+        return
+
+    filename = "probes.dat"
+
+    if outdir is not None:
+        pathlib.Path(outdir).mkdir(parents=True, exist_ok=True)
+        filename = os.path.join(outdir, filename)
+
+    if not os.path.exists(filename):
+        with open(filename.replace(".dat", ".pk"), "wb") as outf:
+            pickle.dump(
+                dict(
+                    probes=[p._asdict() for p in state.solver.physics["probes"]],
+                    probe_cadence=state.solver.physics["probe_cadence"],
+                    row_length=samples.shape[1],
+                    model_parameters=state.setup.model_parameter_dict(),
+                    setup_name=state.setup.dash_case_class_name(),
+                ),
+                outf,
+            )
+
+    with open(filename, "ab") as outf:
+        outf.write(samples.astype("float64").tobytes())
+
+
+def load_probes(directory="."):
+    """
+    Load the probe descriptions and samples written by `append_probes`.
+
+    The samples are returned as a 2d array whose first column is the time.
+    Samples superseded by a restart from an earlier checkpoint are removed.
+    """
+    import numpy as np
+
+    with open(os.path.join(directory, "probes.pk"), "rb") as inf:
+        meta = pickle.load(inf)
+
+    data = np.fromfile(os.path.join(directory, "probes.dat"), dtype="float64")
+    data = data.reshape(-1, meta["row_length"])
+    time = data[:, 0]
+    keep = time < np.minimum.accumulate(np.append(time[1:], np.inf)[::-1])[::-1]
+
+    return meta, data[keep]
+
+
 class DriverArgs(NamedTuple):
     """
     Contains data used by the driver.
@@ -242,7 +570,15 @@ class DriverArgs(NamedTuple):
     num_patches: int = None
     events: Dict[str, Recurrence] = dict()
     new_timestep_cadence: int = None
+    adaptive_timestep: bool = None
     verbose_output: str = ""
+    image_fields: str = "log_sigma"
+    image_downsample: int = 1
+    image_colormap: str = "magma"
+    live_view: str = None
+    checkpoint_keyframe: int = None
+    no_pyramids: bool = None
+    resolution_schedule: str = None
 
     def from_namespace(args):
         """
@@ -310,6 +646,7 @@ def simulate(driver):
     from sailfish import __version__ as version
     from sailfish.kernel.system import configure_build, log_system_info, measure_time
     from sailfish.event import Recurrence
+    from sailfish.timestep import TimestepCadence, drift_tolerance
     from sailfish import solvers
 
     main_logger = getLogger("main_logger")
@@ -325,6 +662,17 @@ def simulate(driver):
         setup = SetupBase.find_setup_class(driver.setup_name)(
             **driver.model_parameters or dict()
         )
+        if driver.resolution_schedule is not None:
+            if driver.resolution is not None:
+                raise ConfigurationError(
+                    "resolution and resolution schedule cannot both be given"
+                )
+            schedule = parse_resolution_schedule(driver.resolution_schedule)
+            user_time = setup.start_time / setup.reference_time_scale
+            driver = driver._replace(
+                resolution=scheduled_resolution(schedule, user_time)
+            )
+
         driver = driver._replace(
             resolution=driver.resolution or setup.default_resolution,
         )
@@ -425,8 +773,17 @@ def simulate(driver):
     mesh = setup.mesh(driver.resolution)
     end_time = first_not_none(driver.end_time, setup.default_end_time, float("inf"))
     reference_time = setup.reference_time_scale
-    new_timestep_cadence = driver.new_timestep_cadence or 1
-    dt = None
+    adaptive_timestep = driver.adaptive_timestep or False
+
+    if adaptive_timestep:
+        new_timestep_cadence = driver.new_timestep_cadence or 100
+    else:
+        new_timestep_cadence = driver.new_timestep_cadence or 1
+
+    if driver.resolution_schedule is not None:
+        schedule = parse_resolution_schedule(driver.resolution_schedule)
+    else:
+        schedule = None
 
     if "physics" in driver.verbose_output:
         logger.info(f"physics struct (setup -> solver) {setup.physics}")
@@ -457,6 +814,15 @@ def simulate(driver):
         )
 
     cfl_number = driver.cfl_number or solver.recommended_cfl
+    drift = drift_tolerance(cfl_number, solver.maximum_cfl)
+
+    if (
+        schedule is not None
+        and type(solver).prolonged_solution is SolverBase.prolonged_solution
+    ):
+        raise ConfigurationError(
+            f"solver {setup.solver} does not support a resolution schedule"
+        )
 
     for name, event in driver.events.items():
         logger.info(f"recurrence for {name} event is {event}")
@@ -464,9 +830,26 @@ def simulate(driver):
     logger.info(f"run until t={end_time}")
     logger.info(f"CFL number is {cfl_number}")
     logger.info(f"simulation time / user time is {reference_time:0.4f}")
-    logger.info(f"recompute dt every {new_timestep_cadence} iterations")
+
+    if adaptive_timestep:
+        logger.info(
+            f"recompute dt adaptively, at most every {new_timestep_cadence} "
+            f"iterations, allowing {drift:.3f} wavespeed drift"
+        )
+    else:
+        logger.info(f"recompute dt every {new_timestep_cadence} iterations")
+
     setup.print_model_parameters(newlines=True, logger=main_logger)
 
+    if driver.live_view is not None:
+        from sailfish.live import LiveViewPublisher
+
+        live_view = LiveViewPublisher(
+            driver.live_view, driver.image_fields, driver.image_downsample
+        )
+    else:
+        live_view = None
+
     def grab_state():
         """
         Collect items from the driver and solver state, as well as run
@@ -484,6 +867,14 @@ def simulate(driver):
             timestep_dt=dt,
         )
 
+    """
+    The adaptive timestep cadence is reset when any event fires, and at the
+    start of the run. Since checkpoints are written from events, a restarted
+    run recomputes dt on the same iterations as a continuous one.
+    """
+    cadence = TimestepCadence()
+    num_dt_recomputes = 0
+
     while True:
         siml_time = solver.time
         user_time = siml_time / reference_time
@@ -499,16 +890,56 @@ def simulate(driver):
             state = event_states[name]
             if event_states[name].is_due(user_time, event):
                 event_states[name] = state.next(user_time, event)
+                cadence = TimestepCadence()
                 yield name, state.number, grab_state()
 
         if end_time is not None and user_time >= end_time:
             break
 
+        if schedule is not None:
+            resolution = scheduled_resolution(schedule, user_time)
+
+            if resolution > driver.resolution:
+                """
+                Continue the run on a finer mesh. The solution is prolonged
+                conservatively, and a new solver is created. Quantities
+                accumulated by the old solver since the last reduction
+                (e.g. time-averaged fields) are discarded.
+                """
+                factor = resolution // driver.resolution
+                solution = solver.prolonged_solution(factor)
+                driver = driver._replace(resolution=resolution)
+                mesh = setup.mesh(resolution)
+                solver = make_solver(
+                    setup.solver,
+                    setup.physics,
+                    driver.solver_options,
+                    setup=setup,
+                    mesh=mesh,
+                    time=siml_time,
+                    solution=solution,
+                    num_patches=driver.num_patches or 1,
+                    mode=mode,
+                )
+                dt = None
+                cadence = TimestepCadence()
+                main_logger.info(f"[{iteration:04d}] t={user_time:0.3f} refine {mesh}")
+
         with measure_time(mode) as fold_time:
             for _ in range(fold):
-                if dt is None or (iteration % new_timestep_cadence == 0):
+                if adaptive_timestep:
+                    if dt is None or cadence.is_due(iteration):
+                        dx = mesh.min_spacing(siml_time)
+                        a = solver.maximum_wavespeed()
+                        dt = dx / a * cfl_number
+                        cadence = cadence.next(
+                            iteration, a, drift, new_timestep_cadence
+                        )
+                        num_dt_recomputes += 1
+                elif dt is None or (iteration % new_timestep_cadence == 0):
                     dx = mesh.min_spacing(siml_time)
                     dt = dx / solver.maximum_wavespeed() * cfl_number
+                    num_dt_recomputes += 1
                 solver.advance(dt)
                 iteration += 1
 
@@ -517,6 +948,30 @@ def simulate(driver):
             f"[{iteration:04d}] t={user_time:0.3f} dt={dt:.3e} Mzps={Mzps:.3f}"
         )
 
+        floors = solver.floor_counts()
+
+        if floors and any(floors.values()):
+            per_step = " ".join(f"{k}={v / fold:.1f}" for k, v in floors.items())
+            main_logger.info(f"[{iteration:04d}] floors per step: {per_step}")
+
+        if live_view is not None:
+            telemetry = dict(
+                iteration=iteration,
+                time=solver.time / reference_time,
+                dt=dt,
+                Mzps=Mzps,
+                floors={k: v / fold for k, v in (floors or dict()).items()},
+            )
+            metadata = dict(setup_name=setup.dash_case_class_name(), mesh=str(mesh))
+            live_view.publish(solver, telemetry, metadata)
+
+        if solver.num_probe_samples:
+            yield "probes", None, grab_state()
+
+    if live_view is not None:
+        live_view.close()
+
+    logger.info(f"recomputed dt {num_dt_recomputes} times")
     yield "end", None, grab_state()
 
 
@@ -541,7 +996,9 @@ def run(setup_name, quiet=True, **kwargs):
 
     load_user_config()
 
-    return next(simulate(driver))[2]
+    for name, number, state in simulate(driver):
+        if name == "end":
+            return state
 
 
 def init_logging():
@@ -624,11 +1081,25 @@ def load_user_config():
 def main():
     """
     General-purpose command line interface.
+
+    The command `sailfish sweep ...` is handed off to :py:func:`sailfish.sweep.main`,
+    and `sailfish live ...` to :py:func:`sailfish.live.main`.
     """
     import argparse
+    import sys
     import sailfish
     import sailfish.setups
 
+    if sys.argv[1:2] == ["sweep"]:
+        from sailfish.sweep import main as sweep_main
+
+        return sweep_main(sys.argv[2:])
+
+    if sys.argv[1:2] == ["live"]:
+        from sailfish.live import main as live_main
+
+        return live_main(sys.argv[2:])
+
     class MakeDict(argparse.Action):
         def __call__(self, parser, namespace, values, option_string=None):
             setattr(namespace, self.dest, dict(values))
@@ -667,6 +1138,11 @@ def main():
         type=int,
         help="grid resolution",
     )
+    parser.add_argument(
+        "--resolution-schedule",
+        metavar="S",
+        help="run at increasing resolutions, N1:T1,N2:T2,...,N means N1 until time T1, etc.",
+    )
     parser.add_argument(
         "--patches",
         metavar="N",
@@ -692,7 +1168,14 @@ def main():
         "--new-timestep-cadence",
         metavar="C",
         type=int,
-        help="iterations between recomputing the timestep dt",
+        help="iterations between recomputing the timestep dt (the maximum "
+        "interval if --adaptive-timestep is given)",
+    )
+    parser.add_argument(
+        "--adaptive-timestep",
+        action="store_true",
+        default=None,
+        help="recompute dt when the wavespeed is predicted to drift too far",
     )
     parser.add_argument(
         "--events",
@@ -722,6 +1205,18 @@ def main():
         dest="events",
         help="checkpoint recurrence [<delta>|<log:mul>]",
     )
+    parser.add_argument(
+        "--checkpoint-keyframe",
+        metavar="K",
+        type=int,
+        help="write a full checkpoint every K, and only differences in between",
+    )
+    parser.add_argument(
+        "--no-pyramids",
+        action="store_true",
+        default=None,
+        help="do not write a restriction pyramid next to each checkpoint",
+    )
     parser.add_argument(
         "--timeseries",
         "-t",
@@ -731,6 +1226,50 @@ def main():
         dest="events",
         help="timeseries recurrence [<delta>|<log:mul>]",
     )
+    parser.add_argument(
+        "--averages",
+        metavar="A",
+        type=Recurrence.from_str,
+        action=add_dict_entry("averages"),
+        dest="events",
+        help="recurrence of time-averaged field outputs [<delta>|<log:mul>]",
+    )
+    parser.add_argument(
+        "--image",
+        metavar="I",
+        type=Recurrence.from_str,
+        action=add_dict_entry("image"),
+        dest="events",
+        help="recurrence of rendered PNG images [<delta>|<log:mul>]",
+    )
+    parser.add_argument(
+        "--image-fields",
+        metavar="F",
+        type=str,
+        default="log_sigma",
+        help="fields to render, e.g. log_sigma:-4:1,speed [[log_]name[:vmin:vmax],...]",
+    )
+    parser.add_argument(
+        "--image-downsample",
+        metavar="K",
+        type=int,
+        default=1,
+        help="render images averaged over blocks of K x K zones",
+    )
+    parser.add_argument(
+        "--image-colormap",
+        metavar="C",
+        type=str,
+        default="magma",
+        choices=["magma", "viridis", "gray"],
+        help="colormap for rendered images",
+    )
+    parser.add_argument(
+        "--live-view",
+        metavar="NAME",
+        type=str,
+        help="publish the image fields after each fold to shared memory segment NAME",
+    )
     parser.add_argument(
         "--model",
         nargs="*",
@@ -772,6 +1311,13 @@ def main():
         type=str,
         help="path to a module defining a get_event_handlers function",
     )
+    parser.add_argument(
+        "--async-events",
+        metavar="D",
+        type=int,
+        help="run event handlers and image encoding on a worker thread, "
+        "with at most D events pending",
+    )
     parser.add_argument(
         "--verbose-output",
         metavar="P",
@@ -838,18 +1384,58 @@ def main():
             else:
                 events_dict = dict()
 
-            for name, number, state in simulate(driver):
-                if name == "timeseries":
-                    append_timeseries(state)
-                elif name == "checkpoint":
-                    write_checkpoint(number, outdir, state)
-                elif name == "end":
-                    if args.final_chkpt:
-                        write_checkpoint("final", outdir, state)
-                elif name in events_dict:
-                    events_dict[name](number, outdir, state, logger)
-                else:
-                    logger.warning(f"unrecognized event {name}")
+            if args.async_events is not None:
+                from sailfish.pipeline import SideEffectPipeline, snapshot
+
+                if args.async_events < 1:
+                    raise ConfigurationError("--async-events must be at least 1")
+
+                pipeline = SideEffectPipeline(args.async_events)
+            else:
+                pipeline = None
+
+            """
+            Side effects which need the live solver are performed here. With
+            --async-events, user event handlers are given a snapshot of the
+            state, and they and the image encoding run on a worker thread.
+            Pending side effects are completed before each checkpoint is
+            written, so a checkpoint never runs ahead of them.
+            """
+            try:
+                for name, number, state in simulate(driver):
+                    if name == "timeseries":
+                        append_timeseries(state)
+                    elif name == "checkpoint":
+                        if pipeline is not None:
+                            pipeline.drain()
+                        write_checkpoint(number, outdir, state)
+                    elif name == "averages":
+                        write_averages(number, outdir, state)
+                    elif name == "image":
+                        write_image(number, outdir, state, pipeline)
+                    elif name == "probes":
+                        append_probes(outdir, state)
+                    elif name == "end":
+                        if pipeline is not None:
+                            pipeline.drain()
+                        if args.final_chkpt:
+                            write_checkpoint("final", outdir, state)
+                    elif name in events_dict:
+                        if pipeline is not None:
+                            pipeline.submit(
+                                events_dict[name],
+                                number,
+                                outdir,
+                                snapshot(state),
+                                logger,
+                            )
+                        else:
+                            events_dict[name](number, outdir, state, logger)
+                    else:
+                        logger.warning(f"unrecognized event {name}")
+            finally:
+                if pipeline is not None:
+                    pipeline.close()
 
     except ConfigurationError as e:
         print(f"bad configuration: {e}")
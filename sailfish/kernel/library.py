@@ -4,8 +4,13 @@ Defines a `Library` utility class to encapulsate CPU/GPU compiled kernels.
 CPU modules are built with the cffi module. Build products including the .so
 file itself are placed in this module's __pycache__ directory, and stored for
 reuse based on the SHA value of the source code and #define macros. GPU
-modules are JIT-compiled with cupy. No caching is presently done for the GPU
-modules.
+modules are JIT-compiled with cupy. No on-disk caching is presently done for
+the GPU modules.
+
+Loaded modules are also kept in memory for the lifetime of the process, so
+that constructing a `Library` again with the same code, mode, and build
+configuration (for example when a process runs many jobs of a parameter
+sweep) reuses the warm module rather than re-parsing and re-loading it.
 """
 
 from platform import system
@@ -22,6 +27,8 @@ logger = getLogger(__name__)
 THREAD_BLOCK_SIZE_1D = (64,)
 THREAD_BLOCK_SIZE_2D = (8, 8)
 THREAD_BLOCK_SIZE_3D = (4, 4, 4)
+MAX_VALIDATION_CACHE_SIZE = 4096
+loaded_modules = dict()
 
 KERNEL_LIB_HEADER = r"""
 #define EXEC_CPU 0
@@ -38,6 +45,16 @@ KERNEL_LIB_HEADER = r"""
 #define PUBLIC extern "C" __global__
 #endif
 
+// In the cpu and omp modes, FOR_EACH_3D visits the (i, j) plane in square
+// tiles of TILE_SIZE_3D columns, each swept along k (the contiguous axis), so
+// that a stencil reaching two zones along i and j touches a working set that
+// fits in cache. Tiles are distributed over threads in omp mode, so a given
+// (i, j) column is always visited by one thread. The tile size may be
+// overridden with a define macro.
+#ifndef TILE_SIZE_3D
+#define TILE_SIZE_3D 8
+#endif
+
 #if (EXEC_MODE == EXEC_CPU)
 #define FOR_EACH_1D(NI) \
 for (int i = 0; i < NI; ++i) \
@@ -47,8 +64,10 @@ for (int i = 0; i < NI; ++i) \
 for (int j = 0; j < NJ; ++j) \
 
 #define FOR_EACH_3D(NI, NJ, NK) \
-for (int i = 0; i < NI; ++i) \
-for (int j = 0; j < NJ; ++j) \
+for (int _ti = 0; _ti < NI; _ti += TILE_SIZE_3D) \
+for (int _tj = 0; _tj < NJ; _tj += TILE_SIZE_3D) \
+for (int i = _ti; i < NI && i < _ti + TILE_SIZE_3D; ++i) \
+for (int j = _tj; j < NJ && j < _tj + TILE_SIZE_3D; ++j) \
 for (int k = 0; k < NK; ++k) \
 
 #elif (EXEC_MODE == EXEC_OMP)
@@ -62,9 +81,11 @@ for (int i = 0; i < NI; ++i) \
 for (int j = 0; j < NJ; ++j) \
 
 #define FOR_EACH_3D(NI, NJ, NK) \
-_Pragma("omp parallel for") \
-for (int i = 0; i < NI; ++i) \
-for (int j = 0; j < NJ; ++j) \
+_Pragma("omp parallel for collapse(2)") \
+for (int _ti = 0; _ti < NI; _ti += TILE_SIZE_3D) \
+for (int _tj = 0; _tj < NJ; _tj += TILE_SIZE_3D) \
+for (int i = _ti; i < NI && i < _ti + TILE_SIZE_3D; ++i) \
+for (int j = _tj; j < NJ && j < _tj + TILE_SIZE_3D; ++j) \
 for (int k = 0; k < NK; ++k) \
 
 #elif (EXEC_MODE == EXEC_GPU)
@@ -110,8 +131,7 @@ class KernelInvocation:
         args = list(self.shape) + list(args)
 
         if lib.debug:
-            validate_types(args, tuple(spec), name, lib.xp)
-            validate_constraints(args, tuple(spec), name)
+            lib.validate(self.kernel.symbol, args)
 
         if lib.cpu_mode:
             kernel(*to_ctypes(args, spec))
@@ -171,13 +191,24 @@ class Library:
 
         with measure_time(mode) as prep_time:
             self.debug = debug
+            self.validated = dict()
             self.cpu_mode = mode != "gpu"
-            self.api = parse_api(code)
+            key = (code, mode, name, str(define_macros), str(build_config))
 
-            if self.cpu_mode:
-                self.load_cpu_module(code, name, mode=mode, define_macros=define_macros)
+            if key in loaded_modules:
+                self.api, self.module, self.xp = loaded_modules[key]
+                logger.info(f"reuse loaded library for {name}")
             else:
-                self.load_gpu_module(code, define_macros)
+                self.api = parse_api(code, define_macros)
+
+                if self.cpu_mode:
+                    self.load_cpu_module(
+                        code, name, mode=mode, define_macros=define_macros
+                    )
+                else:
+                    self.load_gpu_module(code, define_macros)
+
+                loaded_modules[key] = self.api, self.module, self.xp
 
             logger.info(f"module preparation took {prep_time():0.3}s")
 
@@ -245,6 +276,31 @@ class Library:
         self.module = module
         self.xp = cupy
 
+    def validate(self, symbol, args):
+        """
+        Check kernel arguments against the symbol's signature and constraints.
+
+        Validation results are cached, keyed on the argument types, the array
+        shapes, dtypes, strides, and data pointers, and the values of any
+        scalar arguments referenced by a constraint. Once a kernel has been
+        launched with a given set of buffers, subsequent launches on the same
+        buffers cost only the construction of the key.
+        """
+        try:
+            key = validation_key(args, symbol, self.cpu_mode)
+            if key in self.validated:
+                return
+        except (TypeError, AttributeError):
+            key = None
+
+        validate_types(args, tuple(symbol.args), symbol.name, self.xp)
+        validate_constraints(args, symbol)
+
+        if key is not None:
+            if len(self.validated) >= MAX_VALIDATION_CACHE_SIZE:
+                self.validated.clear()
+            self.validated[key] = True
+
     def __getattr__(self, symbol):
         return Kernel(self, self.api[symbol])
 
@@ -300,16 +356,37 @@ def validate_types(args, spec, symbol, xp):
                 raise layout_error(symbol, n)
 
 
-def validate_constraints(args, spec, symbol):
+def validation_key(args, symbol, cpu_mode):
+    """
+    Return a hashable key which determines the outcome of argument validation.
+    """
+    key = [symbol.name, len(args)]
+
+    for arg, (typename, name, _) in zip(args, symbol.args):
+        if typename == "double*" and hasattr(arg, "shape"):
+            if cpu_mode:
+                ptr = arg.__array_interface__["data"][0]
+            else:
+                ptr = arg.data.ptr
+            key.append((type(arg), arg.shape, arg.dtype, arg.strides, ptr))
+        elif name in symbol.watched:
+            key.append((type(arg), arg))
+        else:
+            key.append(type(arg))
+
+    return tuple(key)
+
+
+def validate_constraints(args, symbol):
     """
     Validate kernel argument constraints for a symbol.
 
-    Constraints are optionally defined in C code and extracted in the
-    `parse_api` module.
+    Constraints are optionally defined in C code, extracted in the
+    `parse_api` module, and compiled there to Python callables.
     """
-    scope = dict(zip([a[1] for a in spec], args))
-    for arg, (_, name, constraint) in zip(args, spec):
-        if constraint:
-            c = constraint.replace("$", name)
-            if not eval(c, None, scope):
-                raise ValueError(f"argument constraint for {symbol} not satisfied: {c}")
+    for constraint in symbol.constraints:
+        if not constraint.test(*args):
+            raise ValueError(
+                f"argument constraint for {symbol.name} not satisfied: "
+                f"{constraint.expression}"
+            )
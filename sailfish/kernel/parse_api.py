@@ -2,7 +2,7 @@
 Analyzes C code intended for JIT-compilation to a kernel library.
 """
 
-from typing import NamedTuple, List
+from typing import NamedTuple, List, Callable, FrozenSet
 
 
 class Argument(NamedTuple):
@@ -11,9 +11,25 @@ class Argument(NamedTuple):
     constraint: str
 
 
+class Constraint(NamedTuple):
+    """
+    An argument constraint, compiled to a Python callable.
+
+    The `test` function takes the kernel arguments positionally and returns
+    whether the constraint is satisfied. The `expression` is the constraint
+    source with the `$` placeholder substituted, for use in error messages.
+    """
+
+    expression: str
+    test: Callable
+    names: FrozenSet[str]
+
+
 class Symbol(NamedTuple):
     name: str
     args: List[Argument]
+    constraints: List[Constraint] = []
+    watched: FrozenSet[str] = frozenset()
 
     @property
     def rank(self):
@@ -55,7 +71,39 @@ def scan(lines):
                 yield "end_symbol", None
 
 
-def parse_api(code):
+def compile_constraints(args, define_macros=dict()):
+    """
+    Compile the argument constraints of a kernel into Python callables.
+
+    Each constraint is evaluated in a scope containing the kernel arguments
+    by name, and any macros defined on the compiler command line (so that,
+    for example, an array shape can depend on a compile-time guard zone
+    count). Rather than re-parsing the constraint string on every kernel
+    invocation, a lambda taking all of the kernel arguments is built once
+    here. This function returns the list of compiled constraints, and the
+    set of non-array argument names referenced by any of them; the values
+    of those arguments influence the outcome of validation, whereas for
+    array arguments only the type, shape, and layout do.
+    """
+    names = [arg.name for arg in args]
+    constraints = []
+    watched = set()
+
+    for arg in args:
+        if arg.constraint:
+            expression = arg.constraint.replace("$", arg.name).strip()
+            code = compile(expression, f"<constraint on {arg.name}>", "eval")
+            test = eval(
+                f"lambda {', '.join(names)}: {expression}\n", dict(define_macros)
+            )
+            refs = frozenset(code.co_names).intersection(names)
+            constraints.append(Constraint(expression, test, refs))
+            watched.update(n for n in refs if args[names.index(n)].dtype != "double*")
+
+    return constraints, frozenset(watched)
+
+
+def parse_api(code, define_macros=dict()):
     """
     Parse a C-like source file to extract a public API.
 
@@ -64,7 +112,10 @@ def parse_api(code):
     names of the public functions (or kernels) in the code, and the values are
     lists of the (positional) arguments describing the function signature. Each
     function argument is a tuple of the data type, the argument name, and an
-    optional constraint which could be validated at runtime.
+    optional constraint which could be validated at runtime. Constraints are
+    compiled to Python callables here, so that validating them at kernel
+    invocation time does not involve any string processing. The
+    `define_macros` are visible to the constraint expressions.
     """
     api = dict()
     for event, value in scan(code.splitlines()):
@@ -74,7 +125,10 @@ def parse_api(code):
         elif event == "argument":
             args.append(Argument(*value))
         elif event == "end_symbol":
-            api[name] = Symbol(name=name, args=args)
+            constraints, watched = compile_constraints(args, define_macros)
+            api[name] = Symbol(
+                name=name, args=args, constraints=constraints, watched=watched
+            )
 
     for symbol in api.values():
         if not 1 <= symbol.rank <= 3:
@@ -84,6 +138,61 @@ def parse_api(code):
     return api
 
 
+class Parameter(NamedTuple):
+    dtype: str
+    name: str
+
+
+class PrivateFunction(NamedTuple):
+    """
+    The signature of a PRIVATE function. Parameter types are "int",
+    "double", "double*", or "struct Name*"; const qualifiers are dropped.
+    """
+
+    name: str
+    return_type: str
+    params: List[Parameter]
+
+
+def parse_private(code, name):
+    """
+    Find the PRIVATE function with the given name in C-like source code, and
+    return its signature as a `PrivateFunction`.
+
+    If the function is defined more than once (for example in alternative
+    preprocessor branches), the first definition is used.
+    """
+    import re
+
+    code = re.sub(r"//[^\n]*", "", code)
+    function = re.compile(
+        r"PRIVATE\s+(?P<rtype>\w+)\s+" + name + r"\s*\((?P<params>[^)]*)\)"
+    )
+    param = re.compile(r"(?P<dtype>struct\s+\w+|\w+)\s*(?P<ptr>\*?)\s*(?P<name>\w+)")
+    match = function.search(code)
+
+    if match is None:
+        raise ValueError(f"no PRIVATE function named {name}")
+
+    params = list()
+
+    for item in match.group("params").split(","):
+        item = item.replace("const ", "").strip()
+
+        if not item or item == "void":
+            continue
+
+        m = param.fullmatch(item)
+
+        if m is None:
+            raise ValueError(f"unsupported parameter '{item}' to {name}")
+
+        dtype = " ".join(m.group("dtype").split()) + m.group("ptr")
+        params.append(Parameter(dtype, m.group("name")))
+
+    return PrivateFunction(name, match.group("rtype"), params)
+
+
 def main():
     import argparse, pprint
 
@@ -5,6 +5,7 @@ Functions for querying compute capabilities and configuring JIT builds.
 import contextlib
 import logging
 import multiprocessing
+import os
 import platform
 import time
 
@@ -145,6 +146,19 @@ def num_devices(mode):
         return getDeviceCount()
 
 
+def num_threads(mode):
+    """
+    Return the number of host threads that kernels run on in a given mode.
+
+    In omp mode this is the value of the `OMP_NUM_THREADS` environment
+    variable if it is set, and the number of cores otherwise.
+    """
+    if mode == "omp":
+        return int(os.environ.get("OMP_NUM_THREADS", multiprocessing.cpu_count()))
+    else:
+        return 1
+
+
 def log_system_info(mode):
     """
     Log relevant details of the system's compute capabilities.
@@ -0,0 +1,379 @@
+"""
+Publish a live view of a running simulation to POSIX shared memory.
+
+When the driver is given a live view name (`--live-view NAME`), it publishes
+after each fold a downsampled copy of the image fields (`--image-fields`
+and `--image-downsample`, see :py:mod:`sailfish.render`), together with the
+latest telemetry, into the shared memory segment `/dev/shm/NAME`. Another
+process on the same machine can attach to the segment and inspect the run,
+with
+
+    sailfish live NAME [--plot]
+
+The segment starts with a fixed header, followed by a block of JSON
+metadata, and then two buffers. Each buffer holds the telemetry as
+null-padded JSON, followed by the fields as a float64 array of shape
+(num_fields, ni, nj). The publisher writes to the back buffer and then makes
+it the front buffer. The sequence counter in the header is incremented at
+the start and at the end of each publish, so it is odd while a publish is
+in progress. A reader records the sequence number, copies the front buffer,
+and reads the sequence number again; the copy is consistent if the number
+advanced by at most one. The publisher never waits for readers.
+
+The header also holds the state of the segment. If the shape of the fields
+changes (when a resolution schedule refines the mesh), the publisher marks
+the segment as superseded, removes it, and creates a new one with the same
+name; a reader which sees the mark attaches to the new segment. When the run
+ends, the segment is marked as closed before it is removed.
+"""
+
+import json, struct
+from logging import getLogger
+from multiprocessing import shared_memory
+
+logger = getLogger(__name__)
+
+MAGIC = b"SAILLIVE"
+VERSION = 2
+HEADER = struct.Struct("<8sIIQQQQ")
+METADATA_SIZE = 4096
+TELEMETRY_SIZE = 4096
+STATE_OFFSET = 24
+SEQUENCE_OFFSET = 32
+FRONT_OFFSET = 40
+STATE_LIVE = 0
+STATE_SUPERSEDED = 1
+STATE_CLOSED = 2
+
+
+class LiveViewClosed(Exception):
+    """
+    Raised by a reader when the run publishing the live view has ended.
+    """
+
+
+def attach(name):
+    """
+    Attach to an existing shared memory segment, without registering it to
+    be removed when this process exits.
+    """
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)
+    except TypeError:
+        from multiprocessing import resource_tracker
+
+        shm = shared_memory.SharedMemory(name=name)
+        resource_tracker.unregister(shm._name, "shared_memory")
+        return shm
+
+
+def pack_json(obj, size):
+    data = json.dumps(obj).encode()
+
+    if len(data) > size:
+        raise ValueError(f"live view JSON block exceeds {size} bytes")
+
+    return data + bytes(size - len(data))
+
+
+def unpack_json(data):
+    return json.loads(bytes(data).rstrip(b"\0").decode())
+
+
+class LiveViewPublisher:
+    """
+    Writes downsampled fields and telemetry to a shared memory segment.
+
+    The segment is created on the first call to `publish`, when the shape of
+    the fields is known, replaced if that shape changes, and removed by
+    `close`. A stale segment with the same name, left by a run that did not
+    exit cleanly, is replaced.
+    """
+
+    def __init__(self, name, fields, downsample=1):
+        from sailfish.render import parse_image_fields
+
+        self.name = name
+        self.fields = parse_image_fields(fields)
+        self.downsample = downsample
+        self.shm = None
+        self.sequence = 0
+        self.front = 0
+
+    def create(self, shape, metadata):
+        num_fields = len(self.fields)
+        buffer_size = TELEMETRY_SIZE + 8 * num_fields * shape[0] * shape[1]
+        size = HEADER.size + METADATA_SIZE + 2 * buffer_size
+
+        try:
+            stale = attach(self.name)
+            stale.close()
+            stale.unlink()
+            logger.warning(f"replaced stale live view segment {self.name}")
+        except FileNotFoundError:
+            pass
+
+        self.shm = shared_memory.SharedMemory(name=self.name, create=True, size=size)
+        self.buffer_size = buffer_size
+        self.shape = shape
+        self.sequence = 0
+        self.front = 0
+
+        metadata = dict(
+            metadata,
+            fields=[f.label for f in self.fields],
+            shape=list(shape),
+            downsample=self.downsample,
+        )
+        header = HEADER.pack(MAGIC, VERSION, num_fields, buffer_size, STATE_LIVE, 0, 0)
+        self.shm.buf[: HEADER.size] = header
+        self.shm.buf[HEADER.size : HEADER.size + METADATA_SIZE] = pack_json(
+            metadata, METADATA_SIZE
+        )
+        logger.info(f"publish live view to shared memory segment {self.name}")
+
+    def publish(self, solver, telemetry, metadata=dict()):
+        """
+        Write the fields and telemetry to the back buffer, and then swap it
+        to the front.
+        """
+        import numpy as np
+
+        images = [
+            solver.downsampled_field(f.name, self.downsample, f.log_scale)
+            for f in self.fields
+        ]
+
+        if images[0] is None:
+            return
+
+        if self.shm is not None and images[0].shape != self.shape:
+            self.remove(STATE_SUPERSEDED)
+
+        if self.shm is None:
+            self.create(images[0].shape, metadata)
+
+        back = 1 - self.front
+        start = HEADER.size + METADATA_SIZE + back * self.buffer_size
+        fields_view = np.ndarray(
+            (len(images),) + self.shape,
+            dtype=np.float64,
+            buffer=self.shm.buf,
+            offset=start + TELEMETRY_SIZE,
+        )
+        self.set_sequence(self.sequence + 1)
+        self.shm.buf[start : start + TELEMETRY_SIZE] = pack_json(
+            telemetry, TELEMETRY_SIZE
+        )
+        fields_view[...] = images
+        self.front = back
+        struct.pack_into("<Q", self.shm.buf, FRONT_OFFSET, back)
+        self.set_sequence(self.sequence + 1)
+        del fields_view
+
+    def set_sequence(self, sequence):
+        self.sequence = sequence
+        struct.pack_into("<Q", self.shm.buf, SEQUENCE_OFFSET, sequence)
+
+    def remove(self, state):
+        """
+        Mark the shared memory segment with the given state, so that readers
+        attached to it can tell, and remove it.
+        """
+        struct.pack_into("<Q", self.shm.buf, STATE_OFFSET, state)
+        self.shm.close()
+        self.shm.unlink()
+        self.shm = None
+
+    def close(self):
+        """
+        Remove the shared memory segment.
+        """
+        if self.shm is not None:
+            self.remove(STATE_CLOSED)
+
+
+class LiveViewReader:
+    """
+    Reads the fields and telemetry published by a running simulation.
+    """
+
+    def __init__(self, name):
+        self.name = name
+        self.generation = 0
+        self.shm = None
+        self.attach()
+
+    def attach(self):
+        shm = attach(self.name)
+        magic, version, num_fields, buffer_size, *_ = HEADER.unpack_from(shm.buf)
+
+        if magic != MAGIC or version != VERSION:
+            shm.close()
+            raise ValueError(f"{self.name} is not a sailfish live view segment")
+
+        if self.shm is not None:
+            self.shm.close()
+            self.generation += 1
+
+        self.shm = shm
+        self.buffer_size = buffer_size
+        self.metadata = unpack_json(
+            self.shm.buf[HEADER.size : HEADER.size + METADATA_SIZE]
+        )
+
+    @property
+    def sequence(self):
+        return struct.unpack_from("<Q", self.shm.buf, SEQUENCE_OFFSET)[0]
+
+    @property
+    def state(self):
+        return struct.unpack_from("<Q", self.shm.buf, STATE_OFFSET)[0]
+
+    def read(self, attempts=100):
+        """
+        Return a consistent copy of the front buffer, as a tuple of the
+        telemetry dictionary and a dictionary of field arrays, or None if
+        nothing has been published yet. If the segment was superseded, the
+        reader attaches to the new one, whose fields may have another shape
+        (the `generation` is then incremented). Raises `LiveViewClosed` if
+        the run has ended.
+        """
+        import numpy as np
+
+        if self.state == STATE_CLOSED:
+            raise LiveViewClosed(f"live view {self.name} is closed")
+
+        if self.state == STATE_SUPERSEDED:
+            try:
+                self.attach()
+            except FileNotFoundError:
+                # The new segment is not created yet.
+                return None
+
+            return self.read(attempts)
+
+        fields = self.metadata["fields"]
+        shape = (len(fields),) + tuple(self.metadata["shape"])
+
+        for _ in range(attempts):
+            s1 = self.sequence
+
+            if s1 == 0:
+                return None
+
+            front = struct.unpack_from("<Q", self.shm.buf, FRONT_OFFSET)[0]
+            start = HEADER.size + METADATA_SIZE + front * self.buffer_size
+            telemetry = bytes(self.shm.buf[start : start + TELEMETRY_SIZE])
+            data = np.ndarray(
+                shape,
+                dtype=np.float64,
+                buffer=self.shm.buf,
+                offset=start + TELEMETRY_SIZE,
+            ).copy()
+
+            if self.sequence - s1 <= 1:
+                return unpack_json(telemetry), dict(zip(fields, data))
+
+        raise RuntimeError("live view is being updated too quickly to read")
+
+    def close(self):
+        self.shm.close()
+
+
+def main(argv=None):
+    """
+    Command line interface, invoked as `sailfish live`.
+    """
+    import argparse, time
+
+    parser = argparse.ArgumentParser(
+        prog="sailfish live",
+        description="inspect the live view of a running simulation",
+    )
+    parser.add_argument("name", help="name of the live view segment")
+    parser.add_argument(
+        "--plot",
+        action="store_true",
+        help="plot the fields with matplotlib, rather than print a summary",
+    )
+    parser.add_argument(
+        "--interval",
+        metavar="S",
+        type=float,
+        default=1.0,
+        help="seconds between updates",
+    )
+    parser.add_argument(
+        "--once",
+        action="store_true",
+        help="read the live view once and exit",
+    )
+    args = parser.parse_args(argv)
+
+    try:
+        reader = LiveViewReader(args.name)
+    except FileNotFoundError:
+        print(f"no live view named {args.name}")
+        return
+
+    if args.plot:
+        import matplotlib.pyplot as plt
+
+        fields = reader.metadata["fields"]
+        fig, axes = plt.subplots(1, len(fields), squeeze=False)
+        artists = [None] * len(fields)
+
+    last = None
+
+    generation = reader.generation
+
+    try:
+        while True:
+            try:
+                result = reader.read()
+            except LiveViewClosed:
+                print("the run has ended")
+                break
+
+            if result is not None and result[0] != last:
+                telemetry, data = result
+                last = telemetry
+                print(" ".join(f"{k}={v}" for k, v in telemetry.items()))
+
+                if reader.generation != generation:
+                    generation = reader.generation
+                    print(f"fields now have shape {reader.metadata['shape']}")
+
+                    if args.plot:
+                        fig.clf()
+                        axes = fig.subplots(1, len(fields), squeeze=False)
+                        artists = [None] * len(fields)
+
+                if args.plot:
+                    for n, (name, f) in enumerate(data.items()):
+                        if artists[n] is None:
+                            artists[n] = axes[0, n].imshow(f.T, origin="lower")
+                            axes[0, n].set_title(name)
+                            fig.colorbar(artists[n], ax=axes[0, n])
+                        artists[n].set_data(f.T)
+                        artists[n].autoscale()
+                    fig.suptitle(f"t={telemetry['time']:.3f}")
+                    plt.pause(0.01)
+                else:
+                    for name, f in data.items():
+                        print(f"    {name}: min={f.min():.4e} max={f.max():.4e}")
+
+            if args.once:
+                break
+
+            if args.plot:
+                plt.pause(args.interval)
+            else:
+                time.sleep(args.interval)
+
+    except KeyboardInterrupt:
+        print("")
+
+    finally:
+        reader.close()
@@ -0,0 +1,160 @@
+"""
+File-backed memory for solver state arrays.
+
+A solver patch whose state is allocated with `MappedArray` keeps it in a
+shared memory mapping of a hidden file in a given directory (typically on
+fast local storage). Writing a checkpoint then requires no copy of the
+solution: the mapping is flushed, and the file is renamed. The array is
+then switched to a private, copy-on-write mapping of the same file, so that
+later writes by the solver do not modify the checkpoint. A solver should not
+write to the interior of a saved array, but replace it with a fresh one (see
+`replace_if_saved`).
+
+On restart, a saved file is mapped straight back into memory with a private
+mapping, so the pages are read from disk as they are first accessed.
+
+Hidden files which were not saved are removed when their array is garbage
+collected, but are left behind if the process is killed.
+"""
+
+import mmap
+import os
+from typing import NamedTuple
+
+
+class MappedArray:
+    """
+    A float64 array in a file-backed memory mapping.
+    """
+
+    count = 0
+
+    def __init__(self, shape, fd, filename, saved):
+        self.shape = tuple(shape)
+        self.fd = fd
+        self.filename = filename
+        self.saved = saved
+        self.map(private=saved)
+
+    @classmethod
+    def create(cls, directory, shape):
+        """
+        Create a zero-initialized array backed by a hidden file in the given
+        directory. The file is removed when the array is garbage collected,
+        unless it has been saved.
+        """
+        cls.count += 1
+        filename = os.path.join(directory, f".state.{os.getpid()}.{cls.count}.f64")
+        fd = os.open(filename, os.O_CREAT | os.O_TRUNC | os.O_RDWR, 0o644)
+        os.ftruncate(fd, 8 * prod(shape))
+        return cls(shape, fd, filename, saved=False)
+
+    @classmethod
+    def open(cls, filename, shape):
+        """
+        Map a saved file to an array. Writes to the array are not reflected
+        in the file.
+        """
+        fd = os.open(filename, os.O_RDONLY)
+
+        if os.fstat(fd).st_size != 8 * prod(shape):
+            os.close(fd)
+            raise ValueError(f"{filename} does not hold an array of shape {shape}")
+
+        return cls(shape, fd, filename, saved=True)
+
+    def map(self, private):
+        import numpy as np
+
+        access = mmap.ACCESS_COPY if private else mmap.ACCESS_WRITE
+        self.buffer = mmap.mmap(self.fd, 8 * prod(self.shape), access=access)
+        self.array = np.ndarray(self.shape, dtype=np.float64, buffer=self.buffer)
+
+    def save(self, filename):
+        """
+        Rename the file backing this array, and switch the array to a private
+        mapping. An existing file with that name is replaced. If the array
+        was already saved, a hard link to its file is created instead.
+        """
+        if self.saved:
+            if os.path.exists(filename):
+                if os.path.samefile(filename, self.filename):
+                    return
+                os.unlink(filename)
+            os.link(self.filename, filename)
+        else:
+            self.buffer.flush()
+            os.replace(self.filename, filename)
+            self.filename = filename
+            self.saved = True
+            self.map(private=True)
+
+    def __del__(self):
+        if hasattr(self, "fd"):
+            os.close(self.fd)
+
+            if not self.saved:
+                os.unlink(self.filename)
+
+
+def prod(shape):
+    n = 1
+    for s in shape:
+        n *= s
+    return n
+
+
+def replace_if_saved(mapped, directory):
+    """
+    Return the given array if it has not been saved, or a new array of the
+    same shape otherwise. This is used to pick the output buffer of a solver
+    update.
+    """
+    if mapped.saved:
+        return MappedArray.create(directory, mapped.shape)
+    else:
+        return mapped
+
+
+class MappedSolution(NamedTuple):
+    """
+    A reference to a solution saved from file-backed solver patches. This is
+    stored in place of the solution array in a checkpoint.
+
+    Each file holds a patch primitive array, including guard zones, for the
+    given range of rows of the mesh. Indexing or converting the reference to
+    an array loads the whole solution, without guard zones, so that tools
+    reading checkpoints work unmodified.
+    """
+
+    filenames: list
+    index_ranges: list
+    shapes: list
+    num_guard: int
+
+    def load(self):
+        import numpy as np
+
+        ng = self.num_guard
+        patches = list()
+
+        for filename, shape in zip(self.filenames, self.shapes):
+            data = np.fromfile(filename, dtype=np.float64).reshape(shape)
+            patches.append(data[ng:-ng, ng:-ng])
+
+        return np.concatenate(patches, axis=0)
+
+    def open_patch(self, n):
+        return MappedArray.open(self.filenames[n], self.shapes[n])
+
+    @property
+    def shape(self):
+        ni = self.index_ranges[-1][1] - self.index_ranges[0][0]
+        _, nj, nq = self.shapes[0]
+        return (ni, nj - 2 * self.num_guard, nq)
+
+    def __array__(self, dtype=None):
+        return self.load() if dtype is None else self.load().astype(dtype)
+
+    def __getitem__(self, index):
+        return self.load()[index]
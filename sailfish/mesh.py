@@ -259,3 +259,86 @@ class PlanarCartesian2DMesh(NamedTuple):
         ni = di[1] - di[0]
         nj = dj[1] - dj[0]
         return PlanarCartesian2DMesh(x0, y0, x1, y1, ni, nj)
+
+
+class PlanarCartesian3DMesh(NamedTuple):
+    """
+    A 3D mesh with rectangular binning.
+
+    The zones are cubes when the mesh is constructed with `centered_slab`,
+    which is the usual choice for vertically resolved disks: the domain is
+    square in the x-y plane, and thinner along the z-axis.
+    """
+
+    x0: float = 0.0
+    y0: float = 0.0
+    z0: float = 0.0
+    x1: float = 1.0
+    y1: float = 1.0
+    z1: float = 1.0
+    ni: int = 100
+    nj: int = 100
+    nk: int = 100
+
+    def __str__(self):
+        return f"<planar cartesian 3d: ({self.x0} -> {self.x1}) x ({self.y0} -> {self.y1}) x ({self.z0} -> {self.z1}), shape {self.shape}>"
+
+    @classmethod
+    def centered_slab(cls, domain_radius, domain_height, resolution):
+        """
+        Return a mesh centered on the origin, with a square cross-section of
+        half-width `domain_radius` and `resolution` zones on a side. The
+        number of zones along the z-axis is chosen to make cubic zones with a
+        half-height as close as possible to `domain_height`.
+        """
+        dx = 2.0 * domain_radius / resolution
+        nk = max(1, round(2.0 * domain_height / dx))
+        return PlanarCartesian3DMesh(
+            -domain_radius,
+            -domain_radius,
+            -0.5 * nk * dx,
+            +domain_radius,
+            +domain_radius,
+            +0.5 * nk * dx,
+            resolution,
+            resolution,
+            nk,
+        )
+
+    @property
+    def dx(self):
+        return (self.x1 - self.x0) / self.ni
+
+    @property
+    def dy(self):
+        return (self.y1 - self.y0) / self.nj
+
+    @property
+    def dz(self):
+        return (self.z1 - self.z0) / self.nk
+
+    @property
+    def shape(self):
+        return self.ni, self.nj, self.nk
+
+    def min_spacing(self, time=None):
+        return min(self.dx, self.dy, self.dz)
+
+    @property
+    def num_total_zones(self):
+        return self.ni * self.nj * self.nk
+
+    def cell_coordinates(self, i, j, k):
+        x = self.x0 + (i + 0.5) * self.dx
+        y = self.y0 + (j + 0.5) * self.dy
+        z = self.z0 + (k + 0.5) * self.dz
+        return x, y, z
+
+    def vertex_coordinates(self, i, j, k):
+        """
+        Return the position of the lower-left-back corner of zone (i, j, k).
+        """
+        x = self.x0 + i * self.dx
+        y = self.y0 + j * self.dy
+        z = self.z0 + k * self.dz
+        return x, y, z
@@ -23,7 +23,7 @@ class ViscosityModel(Enum):
 
 class Diagnostic(NamedTuple):
     quantity: str
-    """ time, mdot, ldot, mass_moment, eccentricity_vector """
+    """ time, mdot, ldot, mass_moment, eccentricity_vector, radial_profiles, plugin """
 
     gravity: bool = False
     """ Whether to include the gravity term (if applicable) """
@@ -37,6 +37,155 @@ class Diagnostic(NamedTuple):
     radial_cut: tuple = None
     """ None is ok, or a radial annulus to include e.g. (1.0, 2.0) """
 
+    num_bins: int = 32
+    """ The number of annuli for radial_profiles, spanning the radial cut """
+
+    num_modes: int = 4
+    """ The highest azimuthal Fourier mode m for radial_profiles """
+
+    plugin: str = None
+    """ The name of a :obj:`Plugin` whose fields are summed, for quantity plugin """
+
+
+class Probe(NamedTuple):
+    """
+    A point where the primitive variables are sampled at high cadence
+
+    A probe is either at a fixed position, or attached to one of the point
+    masses. The position of an attached probe is an offset from the point
+    mass, which is either fixed in orientation, or co-rotating with the point
+    mass, i.e. rotated by the point mass's azimuthal angle about the origin.
+    """
+
+    x: float = 0.0
+    """ The x-position, or the x-offset from the point mass if attached """
+
+    y: float = 0.0
+    """ The y-position, or the y-offset from the point mass if attached """
+
+    which_mass: int = None
+    """ None for a fixed probe, or 1 or 2 to attach it to a point mass """
+
+    corotating: bool = False
+    """ Whether the offset of an attached probe co-rotates with the mass """
+
+    def position(self, point_masses):
+        """
+        Return the probe position, given the current pair of point masses.
+        """
+        from math import atan2, cos, sin
+
+        if self.which_mass is None:
+            return self.x, self.y
+
+        m = point_masses[self.which_mass - 1]
+
+        if self.corotating:
+            phi = atan2(m.position_y, m.position_x)
+            dx = self.x * cos(phi) - self.y * sin(phi)
+            dy = self.x * sin(phi) + self.y * cos(phi)
+        else:
+            dx, dy = self.x, self.y
+
+        return m.position_x + dx, m.position_y + dy
+
+
+PLUGIN_KERNEL_TEMPLATE = r"""
+PUBLIC void plugin_{name}(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double *primitive, // :: $.shape[:2] == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD)
+    double *field) // :: $.shape == (ni, nj, {num_fields})
+{{
+    struct PointMass m1 = {{x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1}};
+    struct PointMass m2 = {{x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2}};
+    struct PointMassList mass_list = {{{{m1, m2}}}};
+
+    int ng = NUM_GUARD;
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+
+    FOR_EACH_2D(ni, nj)
+    {{
+        struct PluginZone zone = {{
+            patch_xl + (i + 0.5) * dx,
+            patch_yl + (j + 0.5) * dy,
+            dx,
+            dy,
+            &primitive[(i + ng) * si + (j + ng) * sj],
+            si,
+            sj,
+        }};
+        {name}(&zone, &mass_list, &field[(i * nj + j) * {num_fields}]);
+    }}
+}}
+"""
+
+
+class Plugin(NamedTuple):
+    """
+    A user-defined C function, evaluated on each zone by the solver kernels
+
+    The code must define a function with the plugin's name and the signature
+
+    .. code-block:: c
+
+        PRIVATE void name(struct PluginZone *zone, struct PointMassList *mass_list, double *out)
+
+    which writes one value for each of the plugin's fields to `out`. The
+    zone gives the cell-center coordinates, the zone spacing, and a pointer
+    to the zone's primitive variables; the primitives of the neighboring
+    zones are at offsets of +/- `zone->si` (along x) and +/- `zone->sj`
+    (along y), up to two zones away. The function is compiled together with
+    the solver's C code, so it may call the solver's private functions.
+    Plugins are supported by the cbdiso_2d and cbdgam_2d solvers.
+    """
+
+    name: str
+    """ The name of the C function, which must be a valid identifier """
+
+    code: str
+    """ C source code defining the function """
+
+    fields: tuple = ("value",)
+    """ Names of the values written by the function for each zone """
+
+    def kernel_code(self):
+        """
+        Return the source code of a public kernel that applies the plugin
+        function to each zone of a patch.
+        """
+        if not self.name.isidentifier():
+            raise ValueError(f"plugin name {self.name} is not a valid identifier")
+
+        return PLUGIN_KERNEL_TEMPLATE.format(
+            name=self.name, num_fields=len(self.fields)
+        )
+
 
 class PointMass(NamedTuple):
     r"""
@@ -132,7 +281,16 @@ class Physics(NamedTuple):
 
     4. Thermal cooling
 
-       Todo.
+       In gamma-law mode, the gas loses specific internal energy at a rate
+       proportional to the fourth power of the internal energy over the
+       square of the surface density, with the :obj:`cooling_coefficient`
+       as the constant of proportionality. In each zone, this rate is
+       integrated exactly over the time step, at fixed surface density. The
+       cbdgam_2d solver applies it within each Runge-Kutta stage by default.
+       With the solver option `cooling_method=split`, it is instead applied
+       in two half-steps before and after the hydrodynamics update, which
+       remains accurate when the cooling time is much shorter than the time
+       step.
 
     5. An outer buffer zone
 
@@ -148,6 +306,19 @@ class Physics(NamedTuple):
        between the domain radius (the half-width of a square domain), extending
        inwards by an amount specified by the :obj:`buffer_onset_width`
        parameter.
+
+    6. Probes
+
+       A list of :obj:`Probe` points, at fixed positions or attached to a
+       point mass, where the primitive variables are interpolated every
+       :obj:`probe_cadence` iterations. The samples are buffered by the
+       solver and appended by the driver to a file.
+
+    7. Plugins
+
+       A list of user-defined :obj:`Plugin` functions, compiled into the
+       solver kernels. A diagnostic with quantity plugin sums a plugin's
+       fields over the domain.
     """
 
     eos_type: EquationOfState = EquationOfState.GLOBALLY_ISOTHERMAL
@@ -192,6 +363,15 @@ class Physics(NamedTuple):
     diagnostics: List[Diagnostic] = []
     """ Physics diagnostics to be returned when reductions are computed """
 
+    probes: List[Probe] = []
+    """ Points where the primitive variables are sampled at high cadence """
+
+    probe_cadence: int = 1
+    """ Number of iterations between probe samples """
+
+    plugins: List[Plugin] = []
+    """ User-defined C functions, which may be named by diagnostics """
+
     @property
     def num_particles(self):
         if self.point_mass_function is None:
@@ -199,6 +379,13 @@ class Physics(NamedTuple):
         else:
             return len(self.point_mass_function(0.0))
 
+    def probe_positions(self, time):
+        """
+        Return a list of the probe (x, y) positions at the given time.
+        """
+        masses = self.point_masses(time)
+        return [probe.position(masses) for probe in self.probes]
+
     def point_masses(self, time):
         """
         Generate two point masses from the simulation time and supplied
@@ -0,0 +1,113 @@
+"""
+Runs the side effects of driver events on a worker thread.
+
+Side effects which need the live solver (reductions, checkpoints, draining
+the probe and averaging buffers) are performed by the driver between
+iterations. Side effects which only read the solution, such as user event
+handlers and image encoding, can instead be handed to a `SideEffectPipeline`
+along with a snapshot of the state, and the run continues while they
+execute. The solver kernels release the GIL, so the worker thread overlaps
+with the time stepping.
+"""
+
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
+from copy import deepcopy
+from logging import getLogger
+from time import perf_counter
+
+logger = getLogger(__name__)
+
+
+class SolverSnapshot:
+    """
+    A read-only copy of the solver state, taken between iterations.
+
+    It has the `time`, `solution`, `primitive`, `options`, and `physics`
+    attributes of the solver it was taken from. Solver methods which launch
+    kernels are not available. Most solvers return new host arrays from
+    `solution` and `primitive`, which are kept as they are; the arrays are
+    only copied if the solver returns live state.
+    """
+
+    def __init__(self, solver):
+        self.time = solver.time
+
+        if getattr(solver, "returns_live_state", False):
+            self.solution = deepcopy(solver.solution)
+            self.primitive = deepcopy(solver.primitive)
+        else:
+            self.solution = solver.solution
+            self.primitive = solver.primitive
+
+        self.options = solver.options
+        self.physics = solver.physics
+
+
+def snapshot(state):
+    """
+    Return a copy of a driver state which is not modified as the run goes on.
+    """
+    return state._replace(
+        solver=SolverSnapshot(state.solver),
+        timeseries=list(state.timeseries),
+        event_states=dict(state.event_states),
+    )
+
+
+class SideEffectPipeline:
+    """
+    Runs functions in the order they were submitted, on a worker thread.
+
+    At most `max_pending` functions are queued or running; submitting
+    another one first waits for the oldest to finish, so the run is slowed
+    down rather than accumulating snapshots if the side effects fall behind.
+    An exception raised by a function is re-raised on the driver thread, by
+    the next call to `submit` or `drain`.
+    """
+
+    def __init__(self, max_pending=4):
+        if max_pending < 1:
+            raise ValueError("max_pending must be at least 1")
+
+        self.max_pending = max_pending
+        self.pending = deque()
+        self.stall_time = 0.0
+        self.executor = ThreadPoolExecutor(
+            max_workers=1, thread_name_prefix="side-effects"
+        )
+
+    def submit(self, fn, *args):
+        while self.pending and self.pending[0].done():
+            self.pending.popleft().result()
+
+        if len(self.pending) >= self.max_pending:
+            start = perf_counter()
+            self.pending.popleft().result()
+            self.stall_time += perf_counter() - start
+
+        self.pending.append(self.executor.submit(fn, *args))
+
+    def drain(self):
+        """
+        Wait for all of the submitted functions to finish.
+        """
+        start = perf_counter()
+
+        while self.pending:
+            self.pending.popleft().result()
+
+        self.stall_time += perf_counter() - start
+
+    def close(self):
+        try:
+            self.drain()
+        finally:
+            self.executor.shutdown()
+            logger.info(f"waited {self.stall_time:.2f}s for asynchronous events")
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
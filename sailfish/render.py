@@ -0,0 +1,155 @@
+"""
+In-situ rendering of solution fields to PNG images.
+
+The solvers downsample a field from their patch arrays (see the
+`downsampled_field` method of the circumbinary disk solvers), and the
+functions here apply a scaling and a colormap, and encode the result as a
+PNG file. Only numpy and the standard library are used, so that a frame can
+be written in a few milliseconds during a run.
+
+Fields to render are given as a comma-separated list of entries of the form
+`[log_]name[:vmin:vmax]`, for example `log_sigma:-4:1,speed`. The `log_`
+prefix selects a base-10 logarithmic scaling. If the range is omitted, each
+frame is scaled to the range of its own data.
+"""
+
+import struct, zlib
+from typing import NamedTuple
+
+# Colormap control points at equal intervals in [0, 1], interpolated to a
+# 256-entry lookup table.
+COLORMAPS = dict(
+    viridis=[
+        (0.267004, 0.004874, 0.329415),
+        (0.282623, 0.140926, 0.457517),
+        (0.253935, 0.265254, 0.529983),
+        (0.206756, 0.371758, 0.553117),
+        (0.163625, 0.471133, 0.558148),
+        (0.127568, 0.566949, 0.550556),
+        (0.134692, 0.658636, 0.517649),
+        (0.266941, 0.748751, 0.440573),
+        (0.477504, 0.821444, 0.318195),
+        (0.741388, 0.873449, 0.149561),
+        (0.993248, 0.906157, 0.143936),
+    ],
+    magma=[
+        (0.001462, 0.000466, 0.013866),
+        (0.078815, 0.054184, 0.211667),
+        (0.232077, 0.059889, 0.437695),
+        (0.390384, 0.100379, 0.501864),
+        (0.550287, 0.161158, 0.505719),
+        (0.716387, 0.214982, 0.475290),
+        (0.868793, 0.287728, 0.409303),
+        (0.967671, 0.439703, 0.359810),
+        (0.994738, 0.624350, 0.427397),
+        (0.995680, 0.812706, 0.572645),
+        (0.987053, 0.991438, 0.749504),
+    ],
+    gray=[
+        (0.0, 0.0, 0.0),
+        (1.0, 1.0, 1.0),
+    ],
+)
+
+
+class ImageField(NamedTuple):
+    """
+    A field to render, and how to scale it
+    """
+
+    name: str
+    """ The field name, as in the solver's `IMAGE_FIELDS` """
+
+    log_scale: bool = False
+    """ Whether to render the base-10 logarithm of the field """
+
+    vmin: float = None
+    """ The value mapped to the bottom of the colormap, or None for auto """
+
+    vmax: float = None
+    """ The value mapped to the top of the colormap, or None for auto """
+
+    @property
+    def label(self):
+        return f"log_{self.name}" if self.log_scale else self.name
+
+
+def parse_image_fields(spec):
+    """
+    Parse a comma-separated string of image field entries into a list of
+    `ImageField` instances.
+    """
+    fields = list()
+
+    for entry in spec.split(","):
+        name, *limits = entry.strip().split(":")
+        log_scale = name.startswith("log_")
+
+        if log_scale:
+            name = name[4:]
+        if len(limits) not in (0, 2):
+            raise ValueError(f"image field {entry} must be name or name:vmin:vmax")
+
+        fields.append(ImageField(name, log_scale, *map(float, limits)))
+
+    return fields
+
+
+def colormap_table(name):
+    """
+    Return a (256, 3) array of 8-bit colors for the named colormap.
+    """
+    import numpy as np
+
+    try:
+        points = np.array(COLORMAPS[name])
+    except KeyError:
+        raise ValueError(f"unknown colormap {name}, options are {list(COLORMAPS)}")
+
+    x = np.linspace(0.0, 1.0, 256)
+    xp = np.linspace(0.0, 1.0, len(points))
+    rgb = [np.interp(x, xp, points[:, c]) for c in range(3)]
+    return (np.stack(rgb, axis=1) * 255.0 + 0.5).astype(np.uint8)
+
+
+def colorize(data, vmin=None, vmax=None, cmap="magma"):
+    """
+    Map a 2d array of values indexed by (x, y) to an RGB image, with rows
+    ordered from the top (largest y) to the bottom, as stored in a PNG.
+
+    Values outside [vmin, vmax] are clipped, and non-finite values are given
+    the bottom color. Missing limits are taken from the finite data.
+    """
+    import numpy as np
+
+    finite = np.isfinite(data)
+
+    if vmin is None:
+        vmin = data[finite].min() if finite.any() else 0.0
+    if vmax is None:
+        vmax = data[finite].max() if finite.any() else 1.0
+
+    scaled = (data - vmin) / ((vmax - vmin) or 1.0)
+    index = (np.clip(np.where(finite, scaled, 0.0), 0.0, 1.0) * 255.0).astype(int)
+    return colormap_table(cmap)[index.T[::-1]]
+
+
+def write_png(filename, rgb, level=6):
+    """
+    Write an (rows, columns, 3) array of 8-bit colors to a PNG file.
+    """
+    import numpy as np
+
+    rows, cols, _ = rgb.shape
+    raw = np.zeros((rows, 1 + 3 * cols), dtype=np.uint8)
+    raw[:, 1:] = rgb.reshape(rows, 3 * cols)
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack(">I", len(data)) + body + struct.pack(">I", zlib.crc32(body))
+
+    with open(filename, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", cols, rows, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(raw.tobytes(), level)))
+        f.write(chunk(b"IEND", b""))
@@ -4,3 +4,4 @@ from .envelope_shock import *
 from .exploding_star import *
 from .circumbinary_disk import *
 from .binary_bondi import *
+from .vertical_disk import *
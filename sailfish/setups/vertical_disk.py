@@ -0,0 +1,166 @@
+"""
+3D disk setups for binary problems.
+"""
+
+from math import sqrt, exp, pi
+from sailfish.mesh import PlanarCartesian3DMesh
+from sailfish.physics.circumbinary import EquationOfState, PointMass, SinkModel
+from sailfish.physics.kepler import OrbitalElements
+from sailfish.setup_base import SetupBase, SetupError, param
+
+__all__ = ["VerticalCircumbinaryDisk"]
+
+
+class VerticalCircumbinaryDisk(SetupBase):
+    r"""
+    A vertically resolved, locally isothermal circumbinary disk.
+
+    This is the science setup for the cbdiso_3d solver. The binary orbits in
+    the z = 0 plane. The sound speed is set from the mid-plane gravitational
+    potential, so it is uniform on vertical columns, and the disk has scale
+    height :math:`H \approx r / \mathcal{M}` where :math:`\mathcal{M}` is the
+    orbital Mach number. The initial density is uniform in the mid-plane, and
+    in vertical hydrostatic equilibrium in the binary potential:
+
+    .. math::
+        \rho = \rho_0 \exp \left[ \frac{\phi(r, 0) - \phi(r, z)}{c_s^2} \right]
+
+    with a floor at a small fraction of :math:`\rho_0`. The gas is on
+    Keplerian orbits with a softened radial coordinate.
+
+    The computational domain is square in the x-y plane, and extends to
+    roughly `domain_height` above and below the mid-plane (the zones are
+    cubes). The resolution is the number of zones across the x-y plane. The
+    default height is several scale heights at the corners of the default
+    domain, where H is largest, so the disk atmosphere above and below is
+    near the density floor at the z boundaries; those let gas out but not in.
+    """
+
+    domain_radius = param(4.0, "half side length of the domain in the x-y plane")
+    domain_height = param(2.0, "half height of the domain along the z-axis")
+    mach_number = param(10.0, "orbital Mach number", mutable=True)
+    eccentricity = param(0.0, "orbital eccentricity of the binary", mutable=True)
+    mass_ratio = param(1.0, "component mass ratio m2 / m1 <= 1", mutable=True)
+    sink_rate = param(10.0, "component sink rate", mutable=True)
+    sink_radius = param(0.05, "component sink radius", mutable=True)
+    softening_length = param(0.05, "gravitational softening length", mutable=True)
+    sink_model = param(
+        "torque_free", "sink [acceleration_free|force_free|torque_free]", mutable=True
+    )
+    initial_density = param(1.0, "initial mid-plane density")
+    density_floor = param(1e-6, "initial density floor, relative to the mid-plane")
+    which_diagnostics = param("none", "diagnostics set to get from solver [none|mdots]")
+
+    def validate(self):
+        if self.which_diagnostics not in ["none", "mdots"]:
+            raise SetupError(
+                f"which_diagnostics must be none or mdots, got {self.which_diagnostics}"
+            )
+
+    def potential(self, t, x, y, z):
+        """
+        Return the softened gravitational potential of the binary.
+        """
+        phi = 0.0
+
+        for m in self.point_masses(t):
+            dx = x - m.position_x
+            dy = y - m.position_y
+            phi -= m.mass / sqrt(dx * dx + dy * dy + z * z + m.softening_length**2)
+
+        return phi
+
+    def primitive(self, t, coords, primitive):
+        GM = 1.0
+        x, y, z = coords
+        r = sqrt(x * x + y * y)
+        r_softened = sqrt(x * x + y * y + self.softening_length**2)
+        phi_hat_x = -y / max(r, 1e-12)
+        phi_hat_y = +x / max(r, 1e-12)
+        phi0 = self.potential(t, x, y, 0.0)
+        cs2 = -phi0 / self.mach_number**2
+        stratification = exp((phi0 - self.potential(t, x, y, z)) / cs2)
+
+        primitive[0] = self.initial_density * max(stratification, self.density_floor)
+        primitive[1] = sqrt(GM / r_softened) * phi_hat_x
+        primitive[2] = sqrt(GM / r_softened) * phi_hat_y
+        primitive[3] = 0.0
+
+    def mesh(self, resolution):
+        return PlanarCartesian3DMesh.centered_slab(
+            self.domain_radius, self.domain_height, resolution
+        )
+
+    @property
+    def default_resolution(self):
+        return 128
+
+    @property
+    def physics(self):
+        return dict(
+            eos_type=EquationOfState.LOCALLY_ISOTHERMAL,
+            mach_number=self.mach_number,
+            point_mass_function=self.point_masses,
+            buffer_is_enabled=False,
+            diagnostics=self.diagnostics,
+        )
+
+    @property
+    def diagnostics(self):
+        if self.which_diagnostics != "none":
+            return [
+                dict(quantity="time"),
+                dict(quantity="mass"),
+                dict(quantity="mdot", which_mass=1, accretion=True),
+                dict(quantity="mdot", which_mass=2, accretion=True),
+            ]
+        else:
+            return []
+
+    @property
+    def solver(self):
+        return "cbdiso_3d"
+
+    @property
+    def boundary_condition(self):
+        return "outflow"
+
+    @property
+    def default_end_time(self):
+        return 100.0
+
+    @property
+    def reference_time_scale(self):
+        return 2.0 * pi
+
+    @property
+    def orbital_elements(self):
+        return OrbitalElements(
+            semimajor_axis=1.0,
+            total_mass=1.0,
+            mass_ratio=self.mass_ratio,
+            eccentricity=self.eccentricity,
+        )
+
+    def point_masses(self, time):
+        m1, m2 = self.orbital_elements.orbital_state(time)
+
+        return (
+            PointMass(
+                softening_length=self.softening_length,
+                sink_model=SinkModel[self.sink_model.upper()],
+                sink_rate=self.sink_rate,
+                sink_radius=self.sink_radius,
+                **m1._asdict(),
+            ),
+            PointMass(
+                softening_length=self.softening_length,
+                sink_model=SinkModel[self.sink_model.upper()],
+                sink_rate=self.sink_rate,
+                sink_radius=self.sink_radius,
+                **m2._asdict(),
+            ),
+        )
+
+    def checkpoint_diagnostics(self, time):
+        return dict(point_masses=self.point_masses(time))
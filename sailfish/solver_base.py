@@ -10,6 +10,10 @@ class SolverBase(ABC):
     Base class for solver implementations.
     """
 
+    # Whether the `solution` and `primitive` properties return arrays that the
+    # solver goes on to modify, rather than new copies.
+    returns_live_state = False
+
     @property
     @abstractmethod
     def solution(self):
@@ -126,3 +130,86 @@ class SolverBase(ABC):
         to the solver by the setup when the setup is first constructed.
         """
         pass
+
+    def floor_counts(self):
+        """
+        Return how many zone updates applied each floor or ceiling.
+
+        Solvers do not need to implement this. If they do, the return value
+        should be a dictionary of counts keyed by the name of the floor or
+        ceiling, accumulated since the previous call.
+        """
+        pass
+
+    def field_averages(self):
+        """
+        Return time-averaged fields, accumulated since the previous call.
+
+        Solvers do not need to implement this. If they do, the return value
+        should be a dictionary with the start and end times of the averaging
+        window, and a dictionary of the averaged fields, or None if there is
+        nothing to report.
+        """
+        pass
+
+    def prolonged_solution(self, factor=2):
+        """
+        Return the solution on a mesh with `factor` times the resolution,
+        where factor is a power of two.
+
+        Solvers do not need to implement this, but it is required to run with
+        a resolution schedule. If they do, the return value should be a host
+        array which the solver accepts as its `solution` argument, with the
+        total of each conserved quantity unchanged.
+        """
+        pass
+
+    def pyramid(self, min_size=64):
+        """
+        Return the solution restricted to successively coarser meshes.
+
+        Solvers do not need to implement this. If they do, the return value
+        should be a list of arrays on the host, each with half the resolution
+        of the one before, ending before a level would have fewer than
+        min_size zones on a side.
+        """
+        return list()
+
+    def mapped_solution(self, name):
+        """
+        Save the solution without a copy, if the solver state is in
+        file-backed memory, and return a reference to the saved files.
+
+        Solvers do not need to implement this. If they do, the return value
+        should be a picklable object which the solver accepts as its
+        `solution` argument, or None if the state is not file-backed. The
+        name is used to label the saved files.
+        """
+        pass
+
+    def downsampled_field(self, name, factor=1, log_scale=False):
+        """
+        Return a field of the solution, downsampled for rendering to an image.
+
+        Solvers do not need to implement this. If they do, the named field
+        should be averaged over blocks of factor x factor zones, and returned
+        as a 2d array on the host.
+        """
+        pass
+
+    @property
+    def num_probe_samples(self):
+        """
+        Return the number of probe samples not yet returned by `probe_samples`.
+        """
+        return 0
+
+    def probe_samples(self):
+        """
+        Return the probe samples taken since the previous call.
+
+        Solvers do not need to implement this. If they do, the samples should
+        be returned as a 2d array with one row per sample, and the solver
+        should return None if there are no samples.
+        """
+        pass
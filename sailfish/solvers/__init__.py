@@ -25,6 +25,7 @@ def make_solver(name, physics, options, **kwargs):
     from . import scdg_1d
     from . import cbdgam_2d
     from . import cbdiso_2d
+    from . import cbdiso_3d
     from . import cbdisodg_2d
 
     solvers = dict(
@@ -33,6 +34,7 @@ def make_solver(name, physics, options, **kwargs):
         scdg_1d=scdg_1d,
         cbdgam_2d=cbdgam_2d,
         cbdiso_2d=cbdiso_2d,
+        cbdiso_3d=cbdiso_3d,
         cbdisodg_2d=cbdisodg_2d,
     )
     for ext_name in __solver_extension_modules:
@@ -13,6 +13,31 @@ TODO:
 // ============================================================================
 #define NCONS 4
 #define PLM_THETA 1.5
+#define RECONSTRUCTION_PLM 0
+#define RECONSTRUCTION_PPM 1
+#define RECONSTRUCTION_WENO5 2
+#define NUM_ACCUMULATORS 20 // 2 masses x (gravity, accretion) x 5 quantities
+#define NUM_AVERAGED_FIELDS 6
+#define NUM_IMAGE_FIELDS 5
+#define NUM_FLOOR_COUNTERS 4 // density floor, velocity ceiling, pressure floor, Mach ceiling
+#define DENSITY_FLOOR_ACTIVE (1 << 0)
+#define VELOCITY_CEILING_ACTIVE (1 << 1)
+#define PRESSURE_FLOOR_ACTIVE (1 << 2)
+#define MACH_CEILING_ACTIVE (1 << 3)
+
+// The reconstruction scheme is selected at compile time. PLM needs two guard
+// zones, and PPM and WENO5 need three.
+#ifndef RECONSTRUCTION
+#define RECONSTRUCTION RECONSTRUCTION_PLM
+#endif
+
+#ifndef NUM_GUARD
+#if (RECONSTRUCTION == RECONSTRUCTION_PLM)
+#define NUM_GUARD 2
+#else
+#define NUM_GUARD 3
+#endif
+#endif
 
 
 // ============================ MATH ==========================================
@@ -24,6 +49,25 @@ TODO:
 #define sign(x) copysign(1.0, x)
 #define minabs(a, b, c) min3(fabs(a), fabs(b), fabs(c))
 
+#if (EXEC_MODE == EXEC_GPU)
+#define ACCUMULATE(x, y) atomicAdd(&(x), y)
+#else
+#define ACCUMULATE(x, y) (x) += (y)
+#endif
+
+// Increment the counter of each floor or ceiling flagged in a bitmask returned
+// by conserved_to_primitive.
+PRIVATE void count_floors(int flags, double *counters)
+{
+    for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+    {
+        if (flags & (1 << n))
+        {
+            ACCUMULATE(counters[n], 1.0);
+        }
+    }
+}
+
 PRIVATE double plm_gradient_scalar(double yl, double y0, double yr)
 {
     double a = (y0 - yl) * PLM_THETA;
@@ -40,6 +84,114 @@ PRIVATE void plm_gradient(double *yl, double *y0, double *yr, double *g)
     }
 }
 
+#if (RECONSTRUCTION == RECONSTRUCTION_PPM)
+
+// Face values at the left (fm) and right (fp) of zone 0 in the stencil
+// (y2l, yl, y0, yr, y2r), by the piecewise parabolic method of Colella &
+// Woodward (1984). The fourth-order interface values are bounded by the
+// neighboring zone values, and the parabola is then made monotone.
+PRIVATE void reconstruct_scalar(double y2l, double yl, double y0, double yr, double y2r, double *fm, double *fp)
+{
+    double am = 7.0 / 12.0 * (yl + y0) - 1.0 / 12.0 * (y2l + yr);
+    double ap = 7.0 / 12.0 * (y0 + yr) - 1.0 / 12.0 * (yl + y2r);
+
+    am = max2(min2(yl, y0), min2(am, max2(yl, y0)));
+    ap = max2(min2(y0, yr), min2(ap, max2(y0, yr)));
+
+    if ((ap - y0) * (y0 - am) <= 0.0)
+    {
+        am = y0;
+        ap = y0;
+    }
+    else
+    {
+        double d = ap - am;
+        double m = 6.0 * (y0 - 0.5 * (am + ap));
+
+        if (d * m > d * d)
+        {
+            am = 3.0 * y0 - 2.0 * ap;
+        }
+        else if (d * m < -d * d)
+        {
+            ap = 3.0 * y0 - 2.0 * am;
+        }
+    }
+    *fm = am;
+    *fp = ap;
+}
+
+#elif (RECONSTRUCTION == RECONSTRUCTION_WENO5)
+
+// Fifth-order WENO value at the right face of zone 0, with the WENO-Z
+// nonlinear weights of Borges et al. (2008).
+PRIVATE double weno5_face(double y2l, double yl, double y0, double yr, double y2r)
+{
+    double q0 = (2.0 * y2l - 7.0 * yl + 11.0 * y0) / 6.0;
+    double q1 = (-yl + 5.0 * y0 + 2.0 * yr) / 6.0;
+    double q2 = (2.0 * y0 + 5.0 * yr - y2r) / 6.0;
+    double c0 = y2l - 2.0 * yl + y0;
+    double c1 = yl - 2.0 * y0 + yr;
+    double c2 = y0 - 2.0 * yr + y2r;
+    double e0 = y2l - 4.0 * yl + 3.0 * y0;
+    double e1 = yl - yr;
+    double e2 = 3.0 * y0 - 4.0 * yr + y2r;
+    double b0 = 13.0 / 12.0 * c0 * c0 + 0.25 * e0 * e0;
+    double b1 = 13.0 / 12.0 * c1 * c1 + 0.25 * e1 * e1;
+    double b2 = 13.0 / 12.0 * c2 * c2 + 0.25 * e2 * e2;
+    double tau = fabs(b0 - b2);
+    double r0 = tau / (b0 + 1e-40);
+    double r1 = tau / (b1 + 1e-40);
+    double r2 = tau / (b2 + 1e-40);
+    double w0 = 0.1 * (1.0 + r0 * r0);
+    double w1 = 0.6 * (1.0 + r1 * r1);
+    double w2 = 0.3 * (1.0 + r2 * r2);
+    return (w0 * q0 + w1 * q1 + w2 * q2) / (w0 + w1 + w2);
+}
+
+// Face values at the left (fm) and right (fp) of zone 0 in the stencil
+// (y2l, yl, y0, yr, y2r). The left face uses the mirrored stencil.
+PRIVATE void reconstruct_scalar(double y2l, double yl, double y0, double yr, double y2r, double *fm, double *fp)
+{
+    *fm = weno5_face(y2r, yr, y0, yl, y2l);
+    *fp = weno5_face(y2l, yl, y0, yr, y2r);
+}
+
+#endif
+
+#if (RECONSTRUCTION != RECONSTRUCTION_PLM)
+
+// Overwrite the face values fm and fp of zone 0 (already set from the PLM
+// gradient) with those of the higher-order reconstruction, unless any face
+// value would fall outside the range of the zone and its two neighbors. In
+// that case the zone keeps its PLM face values. Face densities and pressures
+// are then positive, and the velocity does not overshoot in the near-vacuum
+// around the sinks, where unbounded WENO5 faces were found to be unstable.
+PRIVATE void reconstruct_faces(double *y2l, double *yl, double *y0, double *yr, double *y2r, double *fm, double *fp)
+{
+    double hm[NCONS];
+    double hp[NCONS];
+    int bounded = 1;
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        double lo = min3(yl[q], y0[q], yr[q]);
+        double hi = max3(yl[q], y0[q], yr[q]);
+        reconstruct_scalar(y2l[q], yl[q], y0[q], yr[q], y2r[q], &hm[q], &hp[q]);
+        bounded &= hm[q] >= lo && hm[q] <= hi && hp[q] >= lo && hp[q] <= hi;
+    }
+    if (bounded)
+    {
+        for (int q = 0; q < NCONS; ++q)
+        {
+            fm[q] = hm[q];
+            fp[q] = hp[q];
+        }
+    }
+}
+
+#endif
+
 
 // ============================ INTERNAL STRUCTS ==============================
 // ============================================================================
@@ -59,6 +211,18 @@ struct PointMassList {
     struct PointMass masses[2];
 };
 
+// A zone as seen by a user-defined plugin function. The primitive variables
+// of the neighboring zones are at prim[+/- si] and prim[+/- sj].
+struct PluginZone {
+    double x;
+    double y;
+    double dx;
+    double dy;
+    double *prim;
+    int si;
+    int sj;
+};
+
 struct KeplerianBuffer {
     double surface_density;
     double surface_pressure;
@@ -105,14 +269,15 @@ PRIVATE double disk_height(
     return sqrt(pres / sigma) / sqrt(omegatilde2);
 }
 
-PRIVATE void point_mass_source_term(
+PRIVATE void point_mass_source_term_parts(
     struct PointMass *mass,
     double x1,
     double y1,
     double dt,
     double *prim,
     double h,
-    double *delta_cons,
+    double *delta_grav,
+    double *delta_sink,
     int constant_softening,
     double gamma_law_index)
 {
@@ -158,10 +323,14 @@ PRIVATE void point_mass_source_term(
         {
             double vx = prim[1];
             double vy = prim[2];
-            delta_cons[0] = dt * mdot;
-            delta_cons[1] = dt * mdot * prim[1] + dt * fx;
-            delta_cons[2] = dt * mdot * prim[2] + dt * fy;
-            delta_cons[3] = dt * (mdot * eps + 0.5 * mdot * (vx * vx + vy * vy)) + dt * (fx * vx + fy * vy);
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * prim[1];
+            delta_sink[2] = dt * mdot * prim[2];
+            delta_sink[3] = dt * (mdot * eps + 0.5 * mdot * (vx * vx + vy * vy));
+            delta_grav[0] = 0.0;
+            delta_grav[1] = dt * fx;
+            delta_grav[2] = dt * fy;
+            delta_grav[3] = dt * (fx * vx + fy * vy);
             break;
         }
         case 2: // torque-free
@@ -175,53 +344,89 @@ PRIVATE void point_mass_source_term(
             double dvdotrhat = (vx - vx0) * rhatx + (vy - vy0) * rhaty;
             double vxstar = dvdotrhat * rhatx + vx0;
             double vystar = dvdotrhat * rhaty + vy0;
-            delta_cons[0] = dt * mdot;
-            delta_cons[1] = dt * mdot * vxstar + dt * fx;
-            delta_cons[2] = dt * mdot * vystar + dt * fy;
-            delta_cons[3] = dt * (mdot * eps + 0.5 * mdot * (vxstar * vxstar + vystar * vystar)) + dt * (fx * vx + fy * vy);
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * vxstar;
+            delta_sink[2] = dt * mdot * vystar;
+            delta_sink[3] = dt * (mdot * eps + 0.5 * mdot * (vxstar * vxstar + vystar * vystar));
+            delta_grav[0] = 0.0;
+            delta_grav[1] = dt * fx;
+            delta_grav[2] = dt * fy;
+            delta_grav[3] = dt * (fx * vx + fy * vy);
             break;
         }
         case 3: // force-free
         {
             double vx = prim[1];
             double vy = prim[2];
-            delta_cons[0] = dt * mdot;
-            delta_cons[1] = dt * fx;
-            delta_cons[2] = dt * fy;
-            delta_cons[3] = dt * (fx * vx + fy * vy);
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
+            delta_sink[3] = 0.0;
+            delta_grav[0] = 0.0;
+            delta_grav[1] = dt * fx;
+            delta_grav[2] = dt * fy;
+            delta_grav[3] = dt * (fx * vx + fy * vy);
             break;
         }
         default: // sink is inactive
         {
-            delta_cons[0] = 0.0;
-            delta_cons[1] = 0.0;
-            delta_cons[2] = 0.0;
-            delta_cons[3] = 0.0;
+            for (int q = 0; q < NCONS; ++q)
+            {
+                delta_sink[q] = 0.0;
+                delta_grav[q] = 0.0;
+            }
             break;
         }
     }
 }
 
-PRIVATE void point_masses_source_term(
-    struct PointMassList *mass_list,
+PRIVATE void point_mass_source_term(
+    struct PointMass *mass,
     double x1,
     double y1,
     double dt,
     double *prim,
     double h,
-    double *cons,
+    double *delta_cons,
     int constant_softening,
     double gamma_law_index)
 {
-    for (int p = 0; p < 2; ++p)
+    double delta_grav[NCONS];
+    double delta_sink[NCONS];
+
+    point_mass_source_term_parts(mass, x1, y1, dt, prim, h, delta_grav, delta_sink, constant_softening, gamma_law_index);
+
+    for (int q = 0; q < NCONS; ++q)
     {
-        double delta_cons[NCONS];
-        point_mass_source_term(&mass_list->masses[p], x1, y1, dt, prim, h, delta_cons, constant_softening, gamma_law_index);
+        delta_cons[q] = delta_sink[q] + delta_grav[q];
+    }
+}
 
-        for (int q = 0; q < NCONS; ++q)
-        {
-            cons[q] += delta_cons[q];
-        }
+// Add one point mass's source terms at a zone, times a weight, to a row of
+// time-integrated accumulators. For each of the gravity and accretion terms,
+// the accumulated quantities are the rates of change of the gas mass and
+// momentum, the torque about the origin, and the power delivered to the
+// point mass (these correspond to the diagnostics mdot, fx, fy, torque, and
+// power). The row layout is [mass][term][quantity].
+PRIVATE void accumulate_point_mass_source_term(
+    struct PointMass *mass,
+    int p,
+    double x1,
+    double y1,
+    double weight,
+    double *delta_grav,
+    double *delta_sink,
+    double *accumulators)
+{
+    for (int t = 0; t < 2; ++t)
+    {
+        double *delta = t == 0 ? delta_grav : delta_sink;
+        double *acc = &accumulators[(2 * p + t) * 5];
+        ACCUMULATE(acc[0], weight * delta[0]);
+        ACCUMULATE(acc[1], weight * delta[1]);
+        ACCUMULATE(acc[2], weight * delta[2]);
+        ACCUMULATE(acc[3], weight * (x1 * delta[2] - y1 * delta[1]));
+        ACCUMULATE(acc[4], weight * (mass->vx * delta[1] + mass->vy * delta[2]));
     }
 }
 
@@ -295,13 +500,18 @@ PRIVATE void shear_strain(
 
 // ============================ HYDRO =========================================
 // ============================================================================
-PRIVATE void cooling_term(
+// Returns the specific internal energy after cooling for a time dt, with the
+// surface density held fixed. The cooling rate is proportional to
+// eps^4 / sigma^2, and this is the exact solution of that equation over dt,
+// so it stays positive for any dt. The result is limited by the Mach ceiling,
+// and MACH_CEILING_ACTIVE is set in flags if the limit was applied.
+PRIVATE double cooled_internal_energy(
     double cooling_coefficient,
     double mach_ceiling,
     double dt,
-    double *prim,
-    double *cons,
-    double gamma_law_index)
+    const double *prim,
+    double gamma_law_index,
+    int *flags)
 {
     double gamma = gamma_law_index;
     double sigma = prim[0];
@@ -311,12 +521,31 @@ PRIVATE void cooling_term(
     double vy = prim[2];
 
     double ek = 0.5 * (vx * vx + vy * vy);
-    eps_cooled = max2(eps_cooled, 2.0 * ek / gamma / (gamma - 1.0) * pow(mach_ceiling, -2.0));
+    double eps_min = 2.0 * ek / gamma / (gamma - 1.0) * pow(mach_ceiling, -2.0);
+    *flags = (eps_cooled < eps_min) * MACH_CEILING_ACTIVE;
+    return max2(eps_cooled, eps_min);
+}
 
-    cons[3] += sigma * (eps_cooled - eps);
+// Returns MACH_CEILING_ACTIVE if the cooled internal energy was limited by the
+// Mach ceiling.
+PRIVATE int cooling_term(
+    double cooling_coefficient,
+    double mach_ceiling,
+    double dt,
+    double *prim,
+    double *cons,
+    double gamma_law_index)
+{
+    int flags;
+    double eps = prim[3] / prim[0] / (gamma_law_index - 1.0);
+    double eps_cooled = cooled_internal_energy(cooling_coefficient, mach_ceiling, dt, prim, gamma_law_index, &flags);
+
+    cons[3] += prim[0] * (eps_cooled - eps);
+    return flags;
 }
 
-PRIVATE void conserved_to_primitive(
+// Returns a bitmask of the floors and ceilings which were applied.
+PRIVATE int conserved_to_primitive(
     const double *cons,
     double *prim,
     double velocity_ceiling,
@@ -325,10 +554,13 @@ PRIVATE void conserved_to_primitive(
     double gamma_law_index)
 {
     double gamma = gamma_law_index;
-    double pres  = max2(pressure_floor, (cons[3] - 0.5 * (cons[1] * cons[1] + cons[2] * cons[2]) / cons[0]) * (gamma - 1.0));
+    double pres_raw = (cons[3] - 0.5 * (cons[1] * cons[1] + cons[2] * cons[2]) / cons[0]) * (gamma - 1.0);
+    double pres  = max2(pressure_floor, pres_raw);
     double vx = sign(cons[1]) * min2(fabs(cons[1] / cons[0]), velocity_ceiling);
     double vy = sign(cons[2]) * min2(fabs(cons[2] / cons[0]), velocity_ceiling);
     double rho = cons[0];
+    int flags = (pres_raw < pressure_floor) * PRESSURE_FLOOR_ACTIVE
+        + (fabs(cons[1] / cons[0]) > velocity_ceiling || fabs(cons[2] / cons[0]) > velocity_ceiling) * VELOCITY_CEILING_ACTIVE;
 
     if (cons[0] < density_floor)
     {
@@ -336,12 +568,15 @@ PRIVATE void conserved_to_primitive(
         vx = 0.0;
         vy = 0.0;
         pres = pressure_floor;
+        flags = DENSITY_FLOOR_ACTIVE;
     }
 
     prim[0] = rho;
     prim[1] = vx;
     prim[2] = vy;
     prim[3] = pres;
+
+    return flags;
 }
 
 PRIVATE void primitive_to_conserved(const double *prim, double *cons, double gamma_law_index)
@@ -434,6 +669,225 @@ PRIVATE void riemann_hlle(const double *pl, const double *pr, double *flux, doub
 }
 
 
+PRIVATE void advance_rk_zone(
+    struct KeplerianBuffer *buffer,
+    struct PointMassList *mass_list,
+    double patch_xl,
+    double patch_yl,
+    double dx,
+    double dy,
+    int i,
+    int j,
+    double *un, // conserved RK-base data at zone (i, j)
+    double *pai, // primitive data at zone (i - 3, j), PPM and WENO5 only
+    double *pki, // primitive data at zone (i - 2, j)
+    double *pli, // primitive data at zone (i - 1, j)
+    double *pcc, // primitive data at zone (i, j)
+    double *pri, // primitive data at zone (i + 1, j)
+    double *pti, // primitive data at zone (i + 2, j)
+    double *pui, // primitive data at zone (i + 3, j), PPM and WENO5 only
+    double *pout, // updated primitive data at zone (i, j)
+    double *acc, // time-integrated accumulators for row i
+    double *floors, // floor and ceiling counters for row i
+    double gamma_law_index,
+    double alpha,
+    double a,
+    double dt,
+    double accumulator_weight,
+    double velocity_ceiling,
+    double cooling_coefficient,
+    double mach_ceiling,
+    double density_floor,
+    double pressure_floor,
+    int constant_softening)
+{
+    double xl = patch_xl + (i + 0.0) * dx;
+    double xc = patch_xl + (i + 0.5) * dx;
+    double xr = patch_xl + (i + 1.0) * dx;
+    double yl = patch_yl + (j + 0.0) * dy;
+    double yc = patch_yl + (j + 0.5) * dy;
+    double yr = patch_yl + (j + 1.0) * dy;
+
+    // ------------------------------------------------------------------------
+    //                 tj
+    //
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //      |  lr   |  rj   |   rr  |
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //  ki  |  li  -|+  c  -|+  ri  |  ti
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //      |  ll   |  lj   |   rl  |
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //
+    //                 kj
+    // ------------------------------------------------------------------------
+
+    double *pkj = &pcc[-2 * NCONS];
+    double *plj = &pcc[-1 * NCONS];
+    double *prj = &pcc[+1 * NCONS];
+    double *ptj = &pcc[+2 * NCONS];
+    double *pll = &pli[-1 * NCONS];
+    double *plr = &pli[+1 * NCONS];
+    double *prl = &pri[-1 * NCONS];
+    double *prr = &pri[+1 * NCONS];
+
+    double plip[NCONS];
+    double plim[NCONS];
+    double prip[NCONS];
+    double prim[NCONS];
+    double pljp[NCONS];
+    double pljm[NCONS];
+    double prjp[NCONS];
+    double prjm[NCONS];
+
+    double gxli[NCONS];
+    double gxri[NCONS];
+    double gyli[NCONS];
+    double gyri[NCONS];
+    double gxlj[NCONS];
+    double gxrj[NCONS];
+    double gylj[NCONS];
+    double gyrj[NCONS];
+    double gxcc[NCONS];
+    double gycc[NCONS];
+
+    plm_gradient(pki, pli, pcc, gxli);
+    plm_gradient(pli, pcc, pri, gxcc);
+    plm_gradient(pcc, pri, pti, gxri);
+    plm_gradient(pkj, plj, pcc, gylj);
+    plm_gradient(plj, pcc, prj, gycc);
+    plm_gradient(pcc, prj, ptj, gyrj);
+    plm_gradient(pll, pli, plr, gyli);
+    plm_gradient(prl, pri, prr, gyri);
+    plm_gradient(pll, plj, prl, gxlj);
+    plm_gradient(plr, prj, prr, gxrj);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        plim[q] = pli[q] + 0.5 * gxli[q];
+        plip[q] = pcc[q] - 0.5 * gxcc[q];
+        prim[q] = pcc[q] + 0.5 * gxcc[q];
+        prip[q] = pri[q] - 0.5 * gxri[q];
+
+        pljm[q] = plj[q] + 0.5 * gylj[q];
+        pljp[q] = pcc[q] - 0.5 * gycc[q];
+        prjm[q] = pcc[q] + 0.5 * gycc[q];
+        prjp[q] = prj[q] - 0.5 * gyrj[q];
+    }
+
+#if (RECONSTRUCTION != RECONSTRUCTION_PLM)
+    double *paj = &pcc[-3 * NCONS];
+    double *puj = &pcc[+3 * NCONS];
+    double unused[NCONS];
+
+    reconstruct_faces(pai, pki, pli, pcc, pri, unused, plim);
+    reconstruct_faces(pki, pli, pcc, pri, pti, plip, prim);
+    reconstruct_faces(pli, pcc, pri, pti, pui, prip, unused);
+    reconstruct_faces(paj, pkj, plj, pcc, prj, unused, pljm);
+    reconstruct_faces(pkj, plj, pcc, prj, ptj, pljp, prjm);
+    reconstruct_faces(plj, pcc, prj, ptj, puj, prjp, unused);
+#else
+    (void) pai;
+    (void) pui;
+#endif
+
+    double fli[NCONS];
+    double fri[NCONS];
+    double flj[NCONS];
+    double frj[NCONS];
+    double ucc[NCONS];
+
+    double cs2li = sound_speed_squared(gamma_law_index, pli);
+    double cs2ri = sound_speed_squared(gamma_law_index, pri);
+    double cs2lj = sound_speed_squared(gamma_law_index, plj);
+    double cs2rj = sound_speed_squared(gamma_law_index, prj);
+    double hcc = disk_height(mass_list, xc, yc, pcc);
+
+    riemann_hlle(plim, plip, fli, cs2li, 0, gamma_law_index);
+    riemann_hlle(prim, prip, fri, cs2ri, 0, gamma_law_index);
+    riemann_hlle(pljm, pljp, flj, cs2lj, 1, gamma_law_index);
+    riemann_hlle(prjm, prjp, frj, cs2rj, 1, gamma_law_index);
+
+    if (alpha > 0.0)
+    {
+        double sli[4];
+        double sri[4];
+        double slj[4];
+        double srj[4];
+        double scc[4];
+
+        shear_strain(gxli, gyli, dx, dy, sli);
+        shear_strain(gxri, gyri, dx, dy, sri);
+        shear_strain(gxlj, gylj, dx, dy, slj);
+        shear_strain(gxrj, gyrj, dx, dy, srj);
+        shear_strain(gxcc, gycc, dx, dy, scc);
+
+        double cs2cc = sound_speed_squared(gamma_law_index, pcc);
+        double hli = disk_height(mass_list, xl, yc, pli);
+        double hri = disk_height(mass_list, xr, yc, pri);
+        double hlj = disk_height(mass_list, xc, yl, plj);
+        double hrj = disk_height(mass_list, xc, yr, prj);
+
+        double nucc = alpha * hcc * sqrt(cs2cc);
+        double nuli = alpha * hli * sqrt(cs2li);
+        double nuri = alpha * hri * sqrt(cs2ri);
+        double nulj = alpha * hlj * sqrt(cs2lj);
+        double nurj = alpha * hrj * sqrt(cs2rj);
+
+        fli[1] -= 0.5 * (nuli * pli[0] * sli[0] + nucc * pcc[0] * scc[0]); // x-x
+        fli[2] -= 0.5 * (nuli * pli[0] * sli[1] + nucc * pcc[0] * scc[1]); // x-y
+        fri[1] -= 0.5 * (nucc * pcc[0] * scc[0] + nuri * pri[0] * sri[0]); // x-x
+        fri[2] -= 0.5 * (nucc * pcc[0] * scc[1] + nuri * pri[0] * sri[1]); // x-y
+        flj[1] -= 0.5 * (nulj * plj[0] * slj[2] + nucc * pcc[0] * scc[2]); // y-x
+        flj[2] -= 0.5 * (nulj * plj[0] * slj[3] + nucc * pcc[0] * scc[3]); // y-y
+        frj[1] -= 0.5 * (nucc * pcc[0] * scc[2] + nurj * prj[0] * srj[2]); // y-x
+        frj[2] -= 0.5 * (nucc * pcc[0] * scc[3] + nurj * prj[0] * srj[3]); // y-y
+
+        fli[3] -= 0.5 * (nuli * pli[0] * sli[0] * pli[1] + nucc * pcc[0] * scc[0] * pcc[1]); // v^x \tau^x_x
+        fri[3] -= 0.5 * (nucc * pcc[0] * scc[0] * pcc[1] + nuri * pri[0] * sri[0] * pri[1]);
+        fli[3] -= 0.5 * (nuli * pli[0] * sli[1] * pli[2] + nucc * pcc[0] * scc[1] * pcc[2]); // v^y \tau^x_y
+        fri[3] -= 0.5 * (nucc * pcc[0] * scc[1] * pcc[2] + nuri * pri[0] * sri[1] * pri[2]);
+        flj[3] -= 0.5 * (nulj * plj[0] * slj[2] * plj[1] + nucc * pcc[0] * scc[2] * pcc[1]); // v^x \tau^y_x
+        frj[3] -= 0.5 * (nucc * pcc[0] * scc[2] * pcc[1] + nurj * prj[0] * srj[2] * prj[1]);
+        flj[3] -= 0.5 * (nulj * plj[0] * slj[3] * plj[2] + nucc * pcc[0] * scc[3] * pcc[2]); // v^y \tau^y_y
+        frj[3] -= 0.5 * (nucc * pcc[0] * scc[3] * pcc[2] + nurj * prj[0] * srj[3] * prj[2]);
+    }
+
+    primitive_to_conserved(pcc, ucc, gamma_law_index);
+    buffer_source_term(buffer, xc, yc, dt, ucc, gamma_law_index);
+
+    for (int p = 0; p < 2; ++p)
+    {
+        double delta_grav[NCONS];
+        double delta_sink[NCONS];
+        struct PointMass *mass = &mass_list->masses[p];
+
+        point_mass_source_term_parts(mass, xc, yc, dt, pcc, hcc, delta_grav, delta_sink, constant_softening, gamma_law_index);
+        accumulate_point_mass_source_term(mass, p, xc, yc, accumulator_weight, delta_grav, delta_sink, acc);
+
+        for (int q = 0; q < NCONS; ++q)
+        {
+            ucc[q] += delta_sink[q] + delta_grav[q];
+        }
+    }
+    int flags = cooling_term(cooling_coefficient, mach_ceiling, dt, pcc, ucc, gamma_law_index);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        ucc[q] -= ((fri[q] - fli[q]) / dx + (frj[q] - flj[q]) / dy) * dt;
+        ucc[q] = (1.0 - a) * ucc[q] + a * un[q];
+    }
+
+    flags |= conserved_to_primitive(ucc, pout, velocity_ceiling, density_floor, pressure_floor, gamma_law_index);
+    count_floors(flags, floors);
+}
+
 // ============================ PUBLIC API ====================================
 // ============================================================================
 PUBLIC void cbdgam_2d_advance_rk(
@@ -443,9 +897,11 @@ PUBLIC void cbdgam_2d_advance_rk(
     double patch_xr,
     double patch_yl,
     double patch_yr,
-    double *conserved_rk, // :: $.shape == (ni + 4, nj + 4, 4)
-    double *primitive_rd, // :: $.shape == (ni + 4, nj + 4, 4)
-    double *primitive_wr, // :: $.shape == (ni + 4, nj + 4, 4)
+    double *conserved_rk, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *primitive_rd, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *primitive_wr, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *accumulators, // :: $.shape == (ni, 2, 2, 5)
+    double *floor_counters, // :: $.shape == (ni, 4)
     double gamma_law_index,
     double buffer_surface_density,
     double buffer_surface_pressure,
@@ -475,6 +931,7 @@ PUBLIC void cbdgam_2d_advance_rk(
     double alpha, // other
     double a,
     double dt,
+    double accumulator_weight, // weight of this RK stage in the time integral
     double velocity_ceiling,
     double cooling_coefficient,
     double mach_ceiling,
@@ -498,198 +955,271 @@ PUBLIC void cbdgam_2d_advance_rk(
     double dx = (patch_xr - patch_xl) / ni;
     double dy = (patch_yr - patch_yl) / nj;
 
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
     FOR_EACH_2D(ni, nj)
     {
-        double xl = patch_xl + (i + 0.0) * dx;
-        double xc = patch_xl + (i + 0.5) * dx;
-        double xr = patch_xl + (i + 1.0) * dx;
-        double yl = patch_yl + (j + 0.0) * dy;
-        double yc = patch_yl + (j + 0.5) * dy;
-        double yr = patch_yl + (j + 1.0) * dy;
-
-        // ------------------------------------------------------------------------
-        //                 tj
-        //
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //      |  lr   |  rj   |   rr  |
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //  ki  |  li  -|+  c  -|+  ri  |  ti
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //      |  ll   |  lj   |   rl  |
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //
-        //                 kj
-        // ------------------------------------------------------------------------
-
-        int ncc = (i     + ng) * si + (j     + ng) * sj;
-        int nli = (i - 1 + ng) * si + (j     + ng) * sj;
-        int nri = (i + 1 + ng) * si + (j     + ng) * sj;
-        int nlj = (i     + ng) * si + (j - 1 + ng) * sj;
-        int nrj = (i     + ng) * si + (j + 1 + ng) * sj;
-        int nki = (i - 2 + ng) * si + (j     + ng) * sj;
-        int nti = (i + 2 + ng) * si + (j     + ng) * sj;
-        int nkj = (i     + ng) * si + (j - 2 + ng) * sj;
-        int ntj = (i     + ng) * si + (j + 2 + ng) * sj;
-        int nll = (i - 1 + ng) * si + (j - 1 + ng) * sj;
-        int nlr = (i - 1 + ng) * si + (j + 1 + ng) * sj;
-        int nrl = (i + 1 + ng) * si + (j - 1 + ng) * sj;
-        int nrr = (i + 1 + ng) * si + (j + 1 + ng) * sj;
-
-        double *un = &conserved_rk[ncc];
-        double *pcc = &primitive_rd[ncc];
-        double *pli = &primitive_rd[nli];
-        double *pri = &primitive_rd[nri];
-        double *plj = &primitive_rd[nlj];
-        double *prj = &primitive_rd[nrj];
-        double *pki = &primitive_rd[nki];
-        double *pti = &primitive_rd[nti];
-        double *pkj = &primitive_rd[nkj];
-        double *ptj = &primitive_rd[ntj];
-        double *pll = &primitive_rd[nll];
-        double *plr = &primitive_rd[nlr];
-        double *prl = &primitive_rd[nrl];
-        double *prr = &primitive_rd[nrr];
-
-        double plip[NCONS];
-        double plim[NCONS];
-        double prip[NCONS];
-        double prim[NCONS];
-        double pljp[NCONS];
-        double pljm[NCONS];
-        double prjp[NCONS];
-        double prjm[NCONS];
-
-        double gxli[NCONS];
-        double gxri[NCONS];
-        double gyli[NCONS];
-        double gyri[NCONS];
-        double gxlj[NCONS];
-        double gxrj[NCONS];
-        double gylj[NCONS];
-        double gyrj[NCONS];
-        double gxcc[NCONS];
-        double gycc[NCONS];
-
-        plm_gradient(pki, pli, pcc, gxli);
-        plm_gradient(pli, pcc, pri, gxcc);
-        plm_gradient(pcc, pri, pti, gxri);
-        plm_gradient(pkj, plj, pcc, gylj);
-        plm_gradient(plj, pcc, prj, gycc);
-        plm_gradient(pcc, prj, ptj, gyrj);
-        plm_gradient(pll, pli, plr, gyli);
-        plm_gradient(prl, pri, prr, gyri);
-        plm_gradient(pll, plj, prl, gxlj);
-        plm_gradient(plr, prj, prr, gxrj);
+        int ncc = (i + ng) * si + (j + ng) * sj;
 
-        for (int q = 0; q < NCONS; ++q)
-        {
-            plim[q] = pli[q] + 0.5 * gxli[q];
-            plip[q] = pcc[q] - 0.5 * gxcc[q];
-            prim[q] = pcc[q] + 0.5 * gxcc[q];
-            prip[q] = pri[q] - 0.5 * gxri[q];
-
-            pljm[q] = plj[q] + 0.5 * gylj[q];
-            pljp[q] = pcc[q] - 0.5 * gycc[q];
-            prjm[q] = pcc[q] + 0.5 * gycc[q];
-            prjp[q] = prj[q] - 0.5 * gyrj[q];
-        }
+        advance_rk_zone(
+            &buffer,
+            &mass_list,
+            patch_xl,
+            patch_yl,
+            dx,
+            dy,
+            i,
+            j,
+            &conserved_rk[ncc],
+            &primitive_rd[ncc - 3 * si],
+            &primitive_rd[ncc - 2 * si],
+            &primitive_rd[ncc - 1 * si],
+            &primitive_rd[ncc],
+            &primitive_rd[ncc + 1 * si],
+            &primitive_rd[ncc + 2 * si],
+            &primitive_rd[ncc + 3 * si],
+            &primitive_wr[ncc],
+            &accumulators[i * NUM_ACCUMULATORS],
+            &floor_counters[i * NUM_FLOOR_COUNTERS],
+            gamma_law_index,
+            alpha,
+            a,
+            dt,
+            accumulator_weight,
+            velocity_ceiling,
+            cooling_coefficient,
+            mach_ceiling,
+            density_floor,
+            pressure_floor,
+            constant_softening);
+    }
+}
+
+// Same as cbdgam_2d_advance_rk, except that the primitive data is updated in
+// place. The i-range is split into chunks, and each chunk is swept in i,
+// holding updated rows in a three-row ring until the stencil no longer needs
+// the old data in those rows. Rows bordering a chunk are saved before the
+// sweep begins, since they are overwritten by the neighboring chunk. The
+// workspace array holds, per chunk, the four bordering rows and the ring.
+// This kernel is not available in GPU mode.
+// ----------------------------------------------------------------------------
+PUBLIC void cbdgam_2d_advance_rk_inplace(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double *conserved_rk, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    int num_chunks, // :: 1 <= $ <= ni
+    double *workspace, // :: $.shape == (num_chunks, 7, nj + 2 * NUM_GUARD, 4)
+    double *accumulators, // :: $.shape == (ni, 2, 2, 5)
+    double *floor_counters, // :: $.shape == (ni, 4)
+    double gamma_law_index,
+    double buffer_surface_density,
+    double buffer_surface_pressure,
+    double buffer_central_mass,
+    double buffer_driving_rate,
+    double buffer_outer_radius,
+    double buffer_onset_width,
+    int buffer_is_enabled,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double alpha, // other
+    double a,
+    double dt,
+    double accumulator_weight, // weight of this RK stage in the time integral
+    double velocity_ceiling,
+    double cooling_coefficient,
+    double mach_ceiling,
+    double density_floor,
+    double pressure_floor,
+    int constant_softening)
+{
+#if (EXEC_MODE != EXEC_GPU)
+    struct KeplerianBuffer buffer = {
+        buffer_surface_density,
+        buffer_surface_pressure,
+        buffer_central_mass,
+        buffer_driving_rate,
+        buffer_outer_radius,
+        buffer_onset_width,
+        buffer_is_enabled
+    };
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
 
-        double fli[NCONS];
-        double fri[NCONS];
-        double flj[NCONS];
-        double frj[NCONS];
-        double ucc[NCONS];
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
 
-        double cs2li = sound_speed_squared(gamma_law_index, pli);
-        double cs2ri = sound_speed_squared(gamma_law_index, pri);
-        double cs2lj = sound_speed_squared(gamma_law_index, plj);
-        double cs2rj = sound_speed_squared(gamma_law_index, prj);
-        double hcc = disk_height(&mass_list, xc, yc, pcc);
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
 
-        riemann_hlle(plim, plip, fli, cs2li, 0, gamma_law_index);
-        riemann_hlle(prim, prip, fri, cs2ri, 0, gamma_law_index);
-        riemann_hlle(pljm, pljp, flj, cs2lj, 1, gamma_law_index);
-        riemann_hlle(prjm, prjp, frj, cs2rj, 1, gamma_law_index);
+    int sw = 7 * si; // workspace size per chunk
 
-        if (alpha > 0.0)
+    FOR_EACH_1D(num_chunks)
+    {
+        int i0 = (i + 0) * ni / num_chunks;
+        int i1 = (i + 1) * ni / num_chunks;
+        double *halo = &workspace[i * sw];
+
+        for (int n = 0; n < 2 * si; ++n)
         {
-            double sli[4];
-            double sri[4];
-            double slj[4];
-            double srj[4];
-            double scc[4];
-
-            shear_strain(gxli, gyli, dx, dy, sli);
-            shear_strain(gxri, gyri, dx, dy, sri);
-            shear_strain(gxlj, gylj, dx, dy, slj);
-            shear_strain(gxrj, gyrj, dx, dy, srj);
-            shear_strain(gxcc, gycc, dx, dy, scc);
-
-            double cs2cc = sound_speed_squared(gamma_law_index, pcc);
-            double hli = disk_height(&mass_list, xl, yc, pli);
-            double hri = disk_height(&mass_list, xr, yc, pri);
-            double hlj = disk_height(&mass_list, xc, yl, plj);
-            double hrj = disk_height(&mass_list, xc, yr, prj);
-
-            double nucc = alpha * hcc * sqrt(cs2cc);
-            double nuli = alpha * hli * sqrt(cs2li);
-            double nuri = alpha * hri * sqrt(cs2ri);
-            double nulj = alpha * hlj * sqrt(cs2lj);
-            double nurj = alpha * hrj * sqrt(cs2rj);
-
-            fli[1] -= 0.5 * (nuli * pli[0] * sli[0] + nucc * pcc[0] * scc[0]); // x-x
-            fli[2] -= 0.5 * (nuli * pli[0] * sli[1] + nucc * pcc[0] * scc[1]); // x-y
-            fri[1] -= 0.5 * (nucc * pcc[0] * scc[0] + nuri * pri[0] * sri[0]); // x-x
-            fri[2] -= 0.5 * (nucc * pcc[0] * scc[1] + nuri * pri[0] * sri[1]); // x-y
-            flj[1] -= 0.5 * (nulj * plj[0] * slj[2] + nucc * pcc[0] * scc[2]); // y-x
-            flj[2] -= 0.5 * (nulj * plj[0] * slj[3] + nucc * pcc[0] * scc[3]); // y-y
-            frj[1] -= 0.5 * (nucc * pcc[0] * scc[2] + nurj * prj[0] * srj[2]); // y-x
-            frj[2] -= 0.5 * (nucc * pcc[0] * scc[3] + nurj * prj[0] * srj[3]); // y-y
-
-            fli[3] -= 0.5 * (nuli * pli[0] * sli[0] * pli[1] + nucc * pcc[0] * scc[0] * pcc[1]); // v^x \tau^x_x
-            fri[3] -= 0.5 * (nucc * pcc[0] * scc[0] * pcc[1] + nuri * pri[0] * sri[0] * pri[1]);
-            fli[3] -= 0.5 * (nuli * pli[0] * sli[1] * pli[2] + nucc * pcc[0] * scc[1] * pcc[2]); // v^y \tau^x_y
-            fri[3] -= 0.5 * (nucc * pcc[0] * scc[1] * pcc[2] + nuri * pri[0] * sri[1] * pri[2]);
-            flj[3] -= 0.5 * (nulj * plj[0] * slj[2] * plj[1] + nucc * pcc[0] * scc[2] * pcc[1]); // v^x \tau^y_x
-            frj[3] -= 0.5 * (nucc * pcc[0] * scc[2] * pcc[1] + nurj * prj[0] * srj[2] * prj[1]);
-            flj[3] -= 0.5 * (nulj * plj[0] * slj[3] * plj[2] + nucc * pcc[0] * scc[3] * pcc[2]); // v^y \tau^y_y
-            frj[3] -= 0.5 * (nucc * pcc[0] * scc[3] * pcc[2] + nurj * prj[0] * srj[3] * prj[2]);
+            halo[n] = primitive[(i0 - 2 + ng) * si + n];
+            halo[n + 2 * si] = primitive[(i1 + ng) * si + n];
         }
+    }
 
-        primitive_to_conserved(pcc, ucc, gamma_law_index);
-        buffer_source_term(&buffer, xc, yc, dt, ucc, gamma_law_index);
-        point_masses_source_term(&mass_list, xc, yc, dt, pcc, hcc, ucc, constant_softening, gamma_law_index);
-        cooling_term(cooling_coefficient, mach_ceiling, dt, pcc, ucc, gamma_law_index);
+    FOR_EACH_1D(num_chunks)
+    {
+        int i0 = (i + 0) * ni / num_chunks;
+        int i1 = (i + 1) * ni / num_chunks;
+        double *halo = &workspace[i * sw];
+        double *ring = &workspace[i * sw + 4 * si];
 
-        for (int q = 0; q < NCONS; ++q)
+        for (int r = i0; r < i1 + 2; ++r)
         {
-            ucc[q] -= ((fri[q] - fli[q]) / dx + (frj[q] - flj[q]) / dy) * dt;
-            ucc[q] = (1.0 - a) * ucc[q] + a * un[q];
+            if (r < i1)
+            {
+                double *rows[5];
+                double *pout = &ring[(r % 3) * si];
+
+                for (int d = 0; d < 5; ++d)
+                {
+                    int k = r + d - 2;
+
+                    if (k < i0)
+                        rows[d] = &halo[(k - i0 + 2) * si];
+                    else if (k >= i1)
+                        rows[d] = &halo[(k - i1 + 2) * si];
+                    else
+                        rows[d] = &primitive[(k + ng) * si];
+                }
+
+                for (int j = 0; j < nj; ++j)
+                {
+                    int n = (j + ng) * sj;
+
+                    advance_rk_zone(
+                        &buffer,
+                        &mass_list,
+                        patch_xl,
+                        patch_yl,
+                        dx,
+                        dy,
+                        r,
+                        j,
+                        &conserved_rk[(r + ng) * si + n],
+                        NULL,
+                        &rows[0][n],
+                        &rows[1][n],
+                        &rows[2][n],
+                        &rows[3][n],
+                        &rows[4][n],
+                        NULL,
+                        &pout[n],
+                        &accumulators[r * NUM_ACCUMULATORS],
+                        &floor_counters[r * NUM_FLOOR_COUNTERS],
+                        gamma_law_index,
+                        alpha,
+                        a,
+                        dt,
+                        accumulator_weight,
+                        velocity_ceiling,
+                        cooling_coefficient,
+                        mach_ceiling,
+                        density_floor,
+                        pressure_floor,
+                        constant_softening);
+                }
+            }
+
+            // Row r - 2 is no longer needed by the stencil, so its updated
+            // data is moved from the ring to the primitive array.
+            if (r - 2 >= i0)
+            {
+                double *src = &ring[((r - 2) % 3) * si];
+                double *dst = &primitive[(r - 2 + ng) * si];
+
+                for (int n = ng * sj; n < (nj + ng) * sj; ++n)
+                {
+                    dst[n] = src[n];
+                }
+            }
         }
+    }
+#endif
+}
+
+// Applies the cooling term to the primitive data for a time dt, as a step
+// separate from the hydrodynamics update. The cooled data is written to
+// primitive_wr, which may be the same array as primitive_rd. Guard zones are
+// not written.
+PUBLIC void cbdgam_2d_cool(
+    int ni,
+    int nj,
+    double *primitive_rd, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *primitive_wr, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *floor_counters, // :: $.shape == (ni, 4)
+    double cooling_coefficient,
+    double mach_ceiling,
+    double pressure_floor,
+    double dt,
+    double gamma_law_index)
+{
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
 
-        double *pout = &primitive_wr[ncc];
-        conserved_to_primitive(ucc, pout, velocity_ceiling, density_floor, pressure_floor, gamma_law_index);
+    FOR_EACH_2D(ni, nj)
+    {
+        int np = (i + ng) * si + (j + ng) * sj;
+        double *prd = &primitive_rd[np];
+        double *pwr = &primitive_wr[np];
+        int flags;
+        double eps = cooled_internal_energy(cooling_coefficient, mach_ceiling, dt, prd, gamma_law_index, &flags);
+        double pres = prd[0] * eps * (gamma_law_index - 1.0);
+
+        // Zones already at the pressure floor (such as those at the density
+        // floor) are not counted again.
+        flags |= (pres < pressure_floor && prd[3] > pressure_floor) * PRESSURE_FLOOR_ACTIVE;
+        pwr[0] = prd[0];
+        pwr[1] = prd[1];
+        pwr[2] = prd[2];
+        pwr[3] = max2(pres, pressure_floor);
+        count_floors(flags, &floor_counters[i * NUM_FLOOR_COUNTERS]);
     }
 }
 
 PUBLIC void cbdgam_2d_wavespeed(
     int ni,
     int nj,
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 4)
-    double *wavespeed, // :: $.shape == (ni + 4, nj + 4)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *wavespeed, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD)
     double gamma_law_index)
 {
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
     int ti = nj + 2 * ng;
@@ -710,11 +1240,11 @@ PUBLIC void cbdgam_2d_wavespeed(
 PUBLIC void cbdgam_2d_primitive_to_conserved(
     int ni,
     int nj,
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 4)
-    double *conserved, // :: $.shape == (ni + 4, nj + 4, 4)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *conserved, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
     double gamma_law_index)
 {
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
@@ -728,6 +1258,284 @@ PUBLIC void cbdgam_2d_primitive_to_conserved(
     }
 }
 
+// Add dt times a selection of primitive and derived fields to their running
+// sums. Bit k of the fields argument selects field k of: sigma, vx, vy,
+// sigma * vx, sigma * vy, and pressure. The selected fields are packed, in
+// that order, along the last axis of the field_sums array.
+PUBLIC void cbdgam_2d_accumulate_fields(
+    int ni,
+    int nj,
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *field_sums, // :: $.shape == (ni, nj, bin(fields).count("1"))
+    int fields, // :: 0 < $ < (1 << 6)
+    double dt)
+{
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+    int nf = 0;
+
+    for (int k = 0; k < NUM_AVERAGED_FIELDS; ++k)
+    {
+        nf += (fields >> k) & 1;
+    }
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double *pc = &primitive[(i + ng) * si + (j + ng) * sj];
+        double *fs = &field_sums[(i * nj + j) * nf];
+        double f[NUM_AVERAGED_FIELDS] = {pc[0], pc[1], pc[2], pc[0] * pc[1], pc[0] * pc[2], pc[3]};
+
+        for (int k = 0, m = 0; k < NUM_AVERAGED_FIELDS; ++k)
+        {
+            if (fields & (1 << k))
+            {
+                fs[m++] += dt * f[k];
+            }
+        }
+    }
+}
+
+// Downsample one field of the primitive data for rendering to an image, by
+// averaging blocks of factor x factor zones. The field selects one of: sigma,
+// vx, vy, the speed (velocity magnitude), and pressure. If log_scale is
+// nonzero, the base-10 logarithm of each block average is written.
+PUBLIC void cbdgam_2d_downsample_field(
+    int ni, // number of image pixels
+    int nj,
+    double *primitive, // :: $.shape == (ni * factor + 2 * NUM_GUARD, nj * factor + 2 * NUM_GUARD, 4)
+    double *image, // :: $.shape == (ni, nj)
+    int factor, // :: $ >= 1
+    int field, // :: 0 <= $ < 5
+    int log_scale)
+{
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj * factor + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double sum = 0.0;
+
+        for (int a = 0; a < factor; ++a)
+        {
+            for (int b = 0; b < factor; ++b)
+            {
+                double *pc = &primitive[(i * factor + a + ng) * si + (j * factor + b + ng) * sj];
+                double f[NUM_IMAGE_FIELDS] = {pc[0], pc[1], pc[2], sqrt(pc[1] * pc[1] + pc[2] * pc[2]), pc[3]};
+                sum += f[field];
+            }
+        }
+        double mean = sum / (factor * factor);
+        image[i * nj + j] = log_scale ? log10(mean) : mean;
+    }
+}
+
+// Restrict primitive data to a mesh with half the resolution, conserving the
+// mass, momentum, and total energy of each 2 x 2 block of zones. The fine array
+// has ng guard zones on each side, which are not used.
+PUBLIC void cbdgam_2d_restrict_primitive(
+    int ni, // number of coarse zones
+    int nj,
+    double *fine, // :: $.shape == (2 * ni + 2 * ng, 2 * nj + 2 * ng, 4)
+    double *coarse, // :: $.shape == (ni, nj, 4)
+    int ng, // :: $ >= 0
+    double gamma_law_index)
+{
+    int si = NCONS * (2 * nj + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double u[NCONS] = {0.0};
+
+        for (int a = 0; a < 2; ++a)
+        {
+            for (int b = 0; b < 2; ++b)
+            {
+                double *pf = &fine[(2 * i + a + ng) * si + (2 * j + b + ng) * sj];
+                double uf[NCONS];
+                primitive_to_conserved(pf, uf, gamma_law_index);
+
+                for (int q = 0; q < NCONS; ++q)
+                {
+                    u[q] += 0.25 * uf[q];
+                }
+            }
+        }
+        double *pc = &coarse[(i * nj + j) * NCONS];
+        pc[0] = u[0];
+        pc[1] = u[1] / u[0];
+        pc[2] = u[2] / u[0];
+        pc[3] = (u[3] - 0.5 * (u[1] * u[1] + u[2] * u[2]) / u[0]) * (gamma_law_index - 1.0);
+    }
+}
+
+// Sample the primitive data at a list of probe positions, by bilinear
+// interpolation between zone centers. Probes whose x-position is outside
+// this patch are given zeros, so that the samples from all patches can be
+// summed. The guard zones of the primitive array must be valid.
+PUBLIC void cbdgam_2d_sample_probes(
+    int num_probes,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    int ni,
+    int nj,
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *positions, // :: $.shape == (num_probes, 2)
+    double *samples) // :: $.shape == (num_probes, 4)
+{
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_1D(num_probes)
+    {
+        double x = positions[2 * i + 0];
+        double y = positions[2 * i + 1];
+        double *sample = &samples[i * NCONS];
+        int owner = (int) floor((x - patch_xl) / dx);
+
+        if (owner >= 0 && owner < ni)
+        {
+            double fi = (x - patch_xl) / dx - 0.5;
+            double fj = (y - patch_yl) / dy - 0.5;
+            int i0 = (int) floor(fi);
+            int j0 = min2(max2((int) floor(fj), -1), nj - 1);
+            double wx = fi - i0;
+            double wy = min2(max2(fj - j0, 0.0), 1.0);
+
+            double *p00 = &primitive[(i0 + ng) * si + (j0 + ng) * sj];
+            double *p10 = &p00[si];
+            double *p01 = &p00[sj];
+            double *p11 = &p00[si + sj];
+
+            for (int q = 0; q < NCONS; ++q)
+            {
+                sample[q] =
+                    (1.0 - wx) * (1.0 - wy) * p00[q] +
+                    (0.0 + wx) * (1.0 - wy) * p10[q] +
+                    (1.0 - wx) * (0.0 + wy) * p01[q] +
+                    (0.0 + wx) * (0.0 + wy) * p11[q];
+            }
+        }
+        else
+        {
+            for (int q = 0; q < NCONS; ++q)
+            {
+                sample[q] = 0.0;
+            }
+        }
+    }
+}
+
+// Bin the surface density, the advective angular momentum flux, the
+// gravitational torque density, and the azimuthal Fourier moments of the
+// surface density (m = 0 .. num_modes) into radial annuli between
+// inner_radius and outer_radius. The last axis of the profiles array holds
+// the zone count, those three quantities, and then the real and imaginary
+// parts of each Fourier moment. Each row of zones adds to its own set of
+// bins, which are summed over by the caller.
+PUBLIC void cbdgam_2d_radial_profiles(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double inner_radius, // :: $ >= 0.0
+    double outer_radius, // :: $ > inner_radius
+    int num_bins, // :: $ > 0
+    int num_modes, // :: $ >= 0
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *profiles, // :: $.shape == (ni, num_bins, 4 + 2 * (num_modes + 1))
+    int constant_softening,
+    double gamma_law_index)
+{
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
+
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+    int np = 4 + 2 * (num_modes + 1);
+
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+    double dr = (outer_radius - inner_radius) / num_bins;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double xc = patch_xl + (i + 0.5) * dx;
+        double yc = patch_yl + (j + 0.5) * dy;
+        double rc = sqrt(xc * xc + yc * yc);
+        int bin = (int) floor((rc - inner_radius) / dr);
+
+        if (rc >= inner_radius && bin < num_bins)
+        {
+            double *pc = &primitive[(i + ng) * si + (j + ng) * sj];
+            double *prof = &profiles[(i * num_bins + bin) * np];
+        double h = disk_height(&mass_list, xc, yc, pc);
+            double sigma = pc[0];
+            double cos_phi = rc > 0.0 ? xc / rc : 1.0;
+            double sin_phi = rc > 0.0 ? yc / rc : 0.0;
+            double vr = pc[1] * cos_phi + pc[2] * sin_phi;
+            double torque = 0.0;
+
+            for (int p = 0; p < 2; ++p)
+            {
+                double delta_grav[NCONS];
+                double delta_sink[NCONS];
+                point_mass_source_term_parts(&mass_list.masses[p], xc, yc, 1.0, pc, h, delta_grav, delta_sink, constant_softening, gamma_law_index);
+                torque += xc * delta_grav[2] - yc * delta_grav[1];
+            }
+
+            ACCUMULATE(prof[0], 1.0);
+            ACCUMULATE(prof[1], sigma);
+            ACCUMULATE(prof[2], sigma * vr * (xc * pc[2] - yc * pc[1]));
+            ACCUMULATE(prof[3], torque);
+
+            // cos(m phi) and sin(m phi) by the angle addition recurrence
+            double cm = 1.0;
+            double sm = 0.0;
+
+            for (int m = 0; m <= num_modes; ++m)
+            {
+                ACCUMULATE(prof[4 + 2 * m + 0], sigma * cm);
+                ACCUMULATE(prof[4 + 2 * m + 1], sigma * sm);
+                double c = cm * cos_phi - sm * sin_phi;
+                double s = sm * cos_phi + cm * sin_phi;
+                cm = c;
+                sm = s;
+            }
+        }
+    }
+}
+
 PUBLIC void cbdgam_2d_point_mass_source_term(
     int ni,
     int nj,
@@ -754,8 +1562,8 @@ PUBLIC void cbdgam_2d_point_mass_source_term(
     double sink_radius2,
     int sink_model2,
     int which_mass, // :: $ in [1, 2]
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 4)
-    double *cons_rate, // :: $.shape == (ni + 4, nj + 4, 4)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
+    double *cons_rate, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 4)
     int constant_softening,
     double gamma_law_index)
 {
@@ -763,7 +1571,7 @@ PUBLIC void cbdgam_2d_point_mass_source_term(
     struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
     struct PointMassList mass_list = {{m1, m2}};
 
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
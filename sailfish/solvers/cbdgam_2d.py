@@ -2,16 +2,26 @@
 Energy-conserving solver for the binary accretion problem in 2D.
 """
 
+import os
 from typing import NamedTuple
 from logging import getLogger
+from sailfish.kernel.allocate import Allocator
 from sailfish.kernel.library import Library
-from sailfish.kernel.system import get_array_module, execution_context, num_devices
+from sailfish.mapped import MappedArray, MappedSolution, replace_if_saved
+from sailfish.kernel.system import (
+    get_array_module,
+    execution_context,
+    num_devices,
+    num_threads,
+)
 from sailfish.mesh import PlanarCartesian2DMesh
 from sailfish.physics.circumbinary import (
     Physics,
     EquationOfState,
     ViscosityModel,
     Diagnostic,
+    Probe,
+    Plugin,
 )
 from sailfish.solver_base import SolverBase
 from sailfish.subdivide import subdivide, to_host, concat_on_host, lazy_reduce
@@ -19,12 +29,47 @@ from sailfish.subdivide import subdivide, to_host, concat_on_host, lazy_reduce
 
 logger = getLogger(__name__)
 
+# Point mass source term diagnostics which are time-integrated by the advance
+# kernels, in the order of the last axis of the patch accumulator arrays.
+ACCUMULATED_QUANTITIES = ("mdot", "fx", "fy", "torque", "power")
+
+# Floors and ceilings applied by the advance kernels, in the order of the last
+# axis of the patch floor counter arrays.
+FLOOR_COUNTERS = ("density_floor", "velocity_ceiling", "pressure_floor", "mach_ceiling")
+
+# Fields which may be time-averaged, in the order they are packed by the
+# accumulate_fields kernel.
+AVERAGED_FIELDS = ("sigma", "vx", "vy", "sigma_vx", "sigma_vy", "pressure")
+
+
+# Fields which may be rendered to images, in the order they are indexed by
+# the downsample_field kernel.
+IMAGE_FIELDS = ("sigma", "vx", "vy", "speed", "pressure")
+
+
+# Reconstruction schemes, in the order they are numbered by the RECONSTRUCTION
+# macro in the C code. PLM needs two guard zones, and the others need three.
+RECONSTRUCTIONS = ("plm", "ppm", "weno5")
+
+
+# Methods of integrating the cooling term: within each Runge-Kutta stage
+# (unsplit), or in half-steps before and after the hydrodynamics update
+# (split), which is stable for any cooling rate.
+COOLING_METHODS = ("unsplit", "split")
+
 
 class Options(NamedTuple):
     pressure_floor: float = 1e-12
     density_floor: float = 1e-10
     velocity_ceiling: float = 1e16
     mach_ceiling: float = 1e5
+    reconstruction: str = "plm"
+    cooling_method: str = "unsplit"
+    inplace_update: bool = False
+    averaged_fields: str = ""
+    probe_buffer_size: int = 1024
+    mapped_state_dir: str = ""
+    huge_pages: bool = False
 
 
 def initial_condition(setup, mesh, time):
@@ -43,6 +88,32 @@ def initial_condition(setup, mesh, time):
     return primitive
 
 
+def prolong_primitive(primitive, gamma_law_index):
+    """
+    Return a 2D array of primitive data on a mesh with twice the resolution,
+    conserving the mass, momentum, and energy in each zone.
+
+    Zones where the linear reconstruction would give a sub-zone a negative
+    pressure are instead copied to their sub-zones.
+    """
+    import numpy as np
+    from sailfish.prolong import prolong_conserved, prolong_piecewise_constant
+
+    sigma, vx, vy, pres = primitive.transpose(2, 0, 1)
+    energy = pres / (gamma_law_index - 1.0) + 0.5 * sigma * (vx * vx + vy * vy)
+    u = np.stack([sigma, sigma * vx, sigma * vy, energy], axis=-1)
+    u = prolong_conserved(u)
+    sigma, vx, vy = u[..., 0], u[..., 1] / u[..., 0], u[..., 2] / u[..., 0]
+    pres = (u[..., 3] - 0.5 * sigma * (vx * vx + vy * vy)) * (gamma_law_index - 1.0)
+    fine = np.stack([sigma, vx, vy, pres], axis=-1)
+
+    ni, nj = primitive.shape[:2]
+    bad = (pres <= 0.0).reshape(ni, 2, nj, 2).any(axis=(1, 3))
+    bad = prolong_piecewise_constant(bad)
+    fine[bad] = prolong_piecewise_constant(primitive)[bad]
+    return fine
+
+
 class Patch:
     """
     Holds the array buffer state for the solution on a subset of the
@@ -63,6 +134,10 @@ class Patch:
         lib,
         xp,
         execution_context,
+        num_chunks=1,
+        averaged_fields_mask=0,
+        num_probes=0,
+        mapped_primitive=None,
     ):
         i0, i1 = index_range
         ni, nj = i1 - i0, mesh.shape[1]
@@ -79,6 +154,9 @@ class Patch:
         self.buffer_outer_radius = buffer_outer_radius
         self.buffer_surface_density = buffer_surface_density
         self.buffer_surface_pressure = buffer_surface_pressure
+        self.averaged_fields_mask = averaged_fields_mask
+
+        alloc = Allocator(xp, huge_pages=options.huge_pages)
 
         with self.execution_context:
             x0 = self.xl + 0.5 * mesh.dx
@@ -87,10 +165,51 @@ class Patch:
             y1 = self.yr - 0.5 * mesh.dy
             self.coordinate_array_x = xp.linspace(x0, x1, ni)[:, None]
             self.coordinate_array_y = xp.linspace(y0, y1, nj)[None, :]
-            self.wavespeeds = self.xp.zeros(primitive.shape[:2])
-            self.primitive1 = self.xp.array(primitive)
-            self.primitive2 = self.xp.array(primitive)
-            self.conserved0 = self.xp.zeros(primitive.shape)
+            self.wavespeeds = alloc.zeros(primitive.shape[:2])
+            self.conserved0 = alloc.zeros(primitive.shape)
+            self.accumulators = alloc.zeros((ni, 2, 2, len(ACCUMULATED_QUANTITIES)))
+            self.floor_counters = alloc.zeros((ni, len(FLOOR_COUNTERS)))
+
+            if options.mapped_state_dir:
+                # The primitive arrays are in file-backed memory, so they can
+                # be saved to a checkpoint without a copy.
+                if mapped_primitive is None:
+                    mapped_primitive = MappedArray.create(
+                        options.mapped_state_dir, primitive.shape
+                    )
+                    mapped_primitive.array[...] = primitive
+                self.mapped = [
+                    mapped_primitive,
+                    MappedArray.create(options.mapped_state_dir, primitive.shape),
+                ]
+                self.primitive1 = self.mapped[0].array
+                self.primitive2 = self.mapped[1].array
+                self.workspace = None
+            elif options.inplace_update:
+                # The in-place update needs a small workspace per chunk of
+                # rows, rather than a second primitive array.
+                num_chunks = min(ni, num_chunks)
+                self.mapped = None
+                self.primitive1 = alloc.array(primitive)
+                self.primitive2 = None
+                self.workspace = alloc.zeros((num_chunks, 7) + primitive.shape[1:])
+            else:
+                self.mapped = None
+                self.primitive1 = alloc.array(primitive)
+                self.primitive2 = alloc.array(primitive)
+                self.workspace = None
+
+            if averaged_fields_mask:
+                num_fields = bin(averaged_fields_mask).count("1")
+                self.field_sums = alloc.zeros((ni, nj, num_fields))
+            else:
+                self.field_sums = None
+
+            if num_probes:
+                shape = (options.probe_buffer_size, num_probes, primitive.shape[2])
+                self.probe_buffer = alloc.zeros(shape)
+            else:
+                self.probe_buffer = None
 
     @property
     def cell_center_coordinate_arrays(self):
@@ -102,7 +221,7 @@ class Patch:
         return self.coordinate_array_x, self.coordinate_array_y
 
     def point_mass_source_term(self, which_mass, gravity=False, accretion=False):
-        ng = 2  # number of guard cells
+        ng = (self.primitive1.shape[1] - self.shape[1]) // 2  # number of guard cells
         if which_mass not in (1, 2):
             raise ValueError("the mass must be either 1 or 2")
 
@@ -142,46 +261,63 @@ class Patch:
             )
             return cons_rate[ng:-ng, ng:-ng]
 
-    def maximum_wavespeed(self):
-        with self.execution_context:
-            self.lib.cbdgam_2d_wavespeed[self.shape](
-                self.primitive1,
-                self.wavespeeds,
-                self.physics.gamma_law_index,
-            )
-            return self.wavespeeds.max()
+    def radial_profiles(self, inner_radius, outer_radius, num_bins, num_modes):
+        """
+        Return this patch's contributions to the radial profiles, summed
+        over rows of zones, with shape (num_bins, 4 + 2 * (num_modes + 1)).
+        """
+        m1, m2 = self.physics.point_masses(self.time)
 
-    def recompute_conserved(self):
         with self.execution_context:
-            return self.lib.cbdgam_2d_primitive_to_conserved[self.shape](
+            profiles = self.xp.zeros((self.shape[0], num_bins, 4 + 2 * (num_modes + 1)))
+            self.lib.cbdgam_2d_radial_profiles[self.shape](
+                self.xl,
+                self.xr,
+                self.yl,
+                self.yr,
+                m1.position_x,
+                m1.position_y,
+                m1.velocity_x,
+                m1.velocity_y,
+                m1.mass,
+                m1.softening_length,
+                m1.sink_rate,
+                m1.sink_radius,
+                m1.sink_model.value,
+                m2.position_x,
+                m2.position_y,
+                m2.velocity_x,
+                m2.velocity_y,
+                m2.mass,
+                m2.softening_length,
+                m2.sink_rate,
+                m2.sink_radius,
+                m2.sink_model.value,
+                inner_radius,
+                outer_radius,
+                num_bins,
+                num_modes,
                 self.primitive1,
-                self.conserved0,
+                profiles,
+                int(self.physics.constant_softening),
                 self.physics.gamma_law_index,
             )
+            return profiles.sum(axis=0)
 
-    def advance_rk(self, rk_param, dt):
+    def plugin_field(self, lib, plugin):
+        """
+        Return an array of the plugin function's values on each zone, with
+        shape (ni, nj, len(plugin.fields)). The guard zones must be current.
+        """
         m1, m2 = self.physics.point_masses(self.time)
-        buffer_central_mass = m1.mass + m2.mass
-        buffer_surface_density = self.buffer_surface_density
-        buffer_surface_pressure = self.buffer_surface_pressure
 
         with self.execution_context:
-            self.lib.cbdgam_2d_advance_rk[self.shape](
+            field = self.xp.zeros(self.shape + (len(plugin.fields),))
+            getattr(lib, f"plugin_{plugin.name}")[self.shape](
                 self.xl,
                 self.xr,
                 self.yl,
                 self.yr,
-                self.conserved0,
-                self.primitive1,
-                self.primitive2,
-                self.physics.gamma_law_index,
-                buffer_surface_density,
-                buffer_surface_pressure,
-                buffer_central_mass,
-                self.physics.buffer_driving_rate,
-                self.buffer_outer_radius,
-                self.physics.buffer_onset_width,
-                int(self.physics.buffer_is_enabled),
                 m1.position_x,
                 m1.position_y,
                 m1.velocity_x,
@@ -200,19 +336,222 @@ class Patch:
                 m2.sink_rate,
                 m2.sink_radius,
                 m2.sink_model.value,
-                self.physics.alpha,
-                rk_param,
+                self.primitive1,
+                field,
+            )
+            return field
+
+    def maximum_wavespeed(self):
+        with self.execution_context:
+            self.lib.cbdgam_2d_wavespeed[self.shape](
+                self.primitive1,
+                self.wavespeeds,
+                self.physics.gamma_law_index,
+            )
+            return self.wavespeeds.max()
+
+    def recompute_conserved(self):
+        with self.execution_context:
+            return self.lib.cbdgam_2d_primitive_to_conserved[self.shape](
+                self.primitive1,
+                self.conserved0,
+                self.physics.gamma_law_index,
+            )
+
+    def accumulate_fields(self, dt):
+        """
+        Add dt times each of the selected fields to its running sum.
+        """
+        with self.execution_context:
+            self.lib.cbdgam_2d_accumulate_fields[self.shape](
+                self.primitive1,
+                self.field_sums,
+                self.averaged_fields_mask,
                 dt,
-                self.options.velocity_ceiling,
+            )
+
+    def downsample_field(self, field, factor, log_scale):
+        """
+        Return one field on this patch, averaged over blocks of factor x
+        factor zones, and optionally converted to a base-10 logarithm.
+        """
+        ni, nj = self.shape
+
+        with self.execution_context:
+            image = self.xp.zeros((ni // factor, nj // factor))
+            self.lib.cbdgam_2d_downsample_field[image.shape](
+                self.primitive1,
+                image,
+                factor,
+                field,
+                int(log_scale),
+            )
+            return image
+
+    def restrict_primitive(self, fine, ng):
+        """
+        Return primitive data restricted to half the resolution of the given
+        array, which has ng guard zones on each side.
+        """
+        ni = (fine.shape[0] - 2 * ng) // 2
+        nj = (fine.shape[1] - 2 * ng) // 2
+
+        with self.execution_context:
+            coarse = self.xp.zeros((ni, nj, fine.shape[2]))
+            self.lib.cbdgam_2d_restrict_primitive[ni, nj](
+                fine,
+                coarse,
+                ng,
+                self.physics.gamma_law_index,
+            )
+            return coarse
+
+    def sample_probes(self, positions, row):
+        """
+        Sample the primitive data at the given probe positions into a row of
+        the probe ring buffer.
+        """
+        with self.execution_context:
+            self.lib.cbdgam_2d_sample_probes[len(positions)](
+                self.xl,
+                self.xr,
+                self.yl,
+                self.yr,
+                self.shape[0],
+                self.shape[1],
+                self.primitive1,
+                self.xp.array(positions),
+                self.probe_buffer[row],
+            )
+
+    def advance_rk(self, rk_param, dt, weight):
+        m1, m2 = self.physics.point_masses(self.time)
+        buffer_central_mass = m1.mass + m2.mass
+        buffer_surface_density = self.buffer_surface_density
+        buffer_surface_pressure = self.buffer_surface_pressure
+
+        args = (
+            self.physics.gamma_law_index,
+            buffer_surface_density,
+            buffer_surface_pressure,
+            buffer_central_mass,
+            self.physics.buffer_driving_rate,
+            self.buffer_outer_radius,
+            self.physics.buffer_onset_width,
+            int(self.physics.buffer_is_enabled),
+            m1.position_x,
+            m1.position_y,
+            m1.velocity_x,
+            m1.velocity_y,
+            m1.mass,
+            m1.softening_length,
+            m1.sink_rate,
+            m1.sink_radius,
+            m1.sink_model.value,
+            m2.position_x,
+            m2.position_y,
+            m2.velocity_x,
+            m2.velocity_y,
+            m2.mass,
+            m2.softening_length,
+            m2.sink_rate,
+            m2.sink_radius,
+            m2.sink_model.value,
+            self.physics.alpha,
+            rk_param,
+            dt,
+            weight,
+            self.options.velocity_ceiling,
+            self.physics.cooling_coefficient if not self.split_cooling else 0.0,
+            self.options.mach_ceiling,
+            self.options.density_floor,
+            self.options.pressure_floor,
+            int(self.physics.constant_softening),
+        )
+
+        with self.execution_context:
+            if self.workspace is not None:
+                self.lib.cbdgam_2d_advance_rk_inplace[self.shape](
+                    self.xl,
+                    self.xr,
+                    self.yl,
+                    self.yr,
+                    self.conserved0,
+                    self.primitive1,
+                    self.workspace.shape[0],
+                    self.workspace,
+                    self.accumulators,
+                    self.floor_counters,
+                    *args,
+                )
+            else:
+                self.lib.cbdgam_2d_advance_rk[self.shape](
+                    self.xl,
+                    self.xr,
+                    self.yl,
+                    self.yr,
+                    self.conserved0,
+                    self.primitive1,
+                    self.primitive2,
+                    self.accumulators,
+                    self.floor_counters,
+                    *args,
+                )
+                self.swap_primitive()
+
+        self.time = self.time0 * rk_param + (self.time + dt) * (1.0 - rk_param)
+
+    @property
+    def split_cooling(self):
+        return (
+            self.options.cooling_method == "split"
+            and self.physics.cooling_coefficient != 0.0
+        )
+
+    def cool(self, dt):
+        """
+        Apply the cooling term for a time dt, separately from the hydrodynamics
+        update. The cooling is integrated exactly in each zone.
+        """
+        with self.execution_context:
+            if self.primitive2 is None:
+                primitive_wr = self.primitive1
+            else:
+                primitive_wr = self.primitive2
+
+            self.lib.cbdgam_2d_cool[self.shape](
+                self.primitive1,
+                primitive_wr,
+                self.floor_counters,
                 self.physics.cooling_coefficient,
                 self.options.mach_ceiling,
-                self.options.density_floor,
                 self.options.pressure_floor,
-                int(self.physics.constant_softening),
+                dt,
+                self.physics.gamma_law_index,
             )
+            if primitive_wr is not self.primitive1:
+                self.swap_primitive()
 
-        self.time = self.time0 * rk_param + (self.time + dt) * (1.0 - rk_param)
-        self.primitive1, self.primitive2 = self.primitive2, self.primitive1
+    def swap_primitive(self):
+        """
+        Exchange the input and output primitive arrays after an update. A
+        file-backed array that was saved to a checkpoint is not written to
+        again, so it is replaced by a new array.
+        """
+        if self.mapped is not None:
+            m1, m2 = self.mapped
+            self.mapped = [m2, replace_if_saved(m1, self.options.mapped_state_dir)]
+            self.primitive1 = self.mapped[0].array
+            self.primitive2 = self.mapped[1].array
+        else:
+            self.primitive1, self.primitive2 = self.primitive2, self.primitive1
+
+    def save_primitive(self, filename):
+        """
+        Save the file-backed primitive array to the given file name.
+        """
+        self.mapped[0].save(filename)
+        self.primitive1 = self.mapped[0].array
 
     def new_iteration(self):
         self.time0 = self.time
@@ -244,6 +583,8 @@ class Solver(SolverBase):
         physics["diagnostics"] = [
             Diagnostic(**v) for v in physics.get("diagnostics", [])
         ]
+        physics["probes"] = [Probe(**v) for v in physics.get("probes", [])]
+        physics["plugins"] = [Plugin(**v) for v in physics.get("plugins", [])]
 
         self._physics = physics = Physics(**physics)
         self._options = options = Options(**options)
@@ -263,21 +604,58 @@ class Solver(SolverBase):
         if physics.eos_type != EquationOfState.GAMMA_LAW:
             raise ValueError("solver only supports isothermal equation of states")
 
+        if options.inplace_update and mode == "gpu":
+            raise ValueError("solver does not support in-place update in gpu mode")
+
+        if options.reconstruction not in RECONSTRUCTIONS:
+            raise ValueError(f"reconstruction must be one of {RECONSTRUCTIONS}")
+
+        if options.cooling_method not in COOLING_METHODS:
+            raise ValueError(f"cooling_method must be one of {COOLING_METHODS}")
+
+        if options.inplace_update and options.reconstruction != "plm":
+            raise ValueError("solver only supports in-place update with plm")
+
+        if options.mapped_state_dir and (mode == "gpu" or options.inplace_update):
+            raise ValueError(
+                "solver does not support file-backed state in gpu mode "
+                "or with in-place update"
+            )
+
+        averaged_fields = [f for f in options.averaged_fields.split(",") if f]
+
+        for field in averaged_fields:
+            if field not in AVERAGED_FIELDS:
+                raise ValueError(f"averaged field must be one of {AVERAGED_FIELDS}")
+
+        averaged_fields_mask = sum(
+            1 << n for n, f in enumerate(AVERAGED_FIELDS) if f in averaged_fields
+        )
+
         xp = get_array_module(mode)
-        ng = 2  # number of guard zones
+        ng = 2 if options.reconstruction == "plm" else 3  # number of guard zones
         nq = 4  # number of conserved quantities
         with open(__file__.replace(".py", ".c")) as f:
             code = f.read()
-        lib = Library(code, mode=mode, debug=False)
+        define_macros = dict(
+            RECONSTRUCTION=RECONSTRUCTIONS.index(options.reconstruction),
+            NUM_GUARD=ng,
+        )
+        lib = Library(code, mode=mode, debug=False, define_macros=define_macros)
 
         logger.info(f"initiate with time={time:0.4f}")
         logger.info(f"subdivide grid over {num_patches} patches")
         logger.info(f"mesh is {mesh}")
         logger.info(f"boundary condition is outflow")
+        logger.info(f"reconstruction is {options.reconstruction}")
 
         self.mesh = mesh
         self.setup = setup
         self.num_guard = ng
+        self.code = code
+        self.mode = mode
+        self.define_macros = define_macros
+        self.plugin_libs = dict()
         self.num_cons = nq
         self.xp = xp
         self.patches = []
@@ -285,8 +663,21 @@ class Solver(SolverBase):
         self.domain_radius = self.mesh.x1
         self.buffer_onset_width = 0.1
 
+        index_ranges = list(subdivide(ni, num_patches))
+        mapped_solution = None
+
         if solution is None:
             primitive = initial_condition(setup, mesh, time)
+        elif type(solution) is MappedSolution:
+            if (
+                options.mapped_state_dir
+                and solution.index_ranges == index_ranges
+                and solution.num_guard == ng
+            ):
+                # The saved patch arrays are mapped straight back in.
+                mapped_solution = solution
+            else:
+                primitive = solution.load()
         else:
             primitive = solution
 
@@ -306,9 +697,14 @@ class Solver(SolverBase):
             buffer_surface_density = 0.0
             buffer_surface_pressure = 0.0
 
-        for n, (a, b) in enumerate(subdivide(ni, num_patches)):
-            prim = np.zeros([b - a + 2 * ng, nj + 2 * ng, nq])
-            prim[ng:-ng, ng:-ng] = primitive[a:b]
+        for n, (a, b) in enumerate(index_ranges):
+            if mapped_solution is not None:
+                mapped_primitive = mapped_solution.open_patch(n)
+                prim = mapped_primitive.array
+            else:
+                mapped_primitive = None
+                prim = np.zeros([b - a + 2 * ng, nj + 2 * ng, nq])
+                prim[ng:-ng, ng:-ng] = primitive[a:b]
             patch = Patch(
                 time,
                 prim,
@@ -322,15 +718,48 @@ class Solver(SolverBase):
                 lib,
                 xp,
                 execution_context(mode, device_id=n % num_devices(mode)),
+                num_chunks=4 * num_threads(mode) if mode == "omp" else 1,
+                averaged_fields_mask=averaged_fields_mask,
+                num_probes=len(physics.probes),
+                mapped_primitive=mapped_primitive,
             )
             self.patches.append(patch)
 
+        self.accumulator_start_time = time
+        self.averaged_fields = [f for f in AVERAGED_FIELDS if f in averaged_fields]
+        self.field_sums_start_time = time
+        self.num_iterations = 0
+        self.probe_times = np.zeros(options.probe_buffer_size)
+        self.probe_head = 0
+        self.probe_tail = 0
+
     @property
     def solution(self):
         return concat_on_host(
             [p.primitive for p in self.patches], (self.num_guard, self.num_guard)
         )
 
+    def mapped_solution(self, name):
+        if not self._options.mapped_state_dir:
+            return None
+
+        filenames = list()
+
+        for n, patch in enumerate(self.patches):
+            filename = os.path.join(
+                os.path.abspath(self._options.mapped_state_dir),
+                f"{name}.patch{n:03d}.f64",
+            )
+            patch.save_primitive(filename)
+            filenames.append(filename)
+
+        return MappedSolution(
+            filenames,
+            list(subdivide(self.mesh.shape[0], len(self.patches))),
+            [p.primitive1.shape for p in self.patches],
+            self.num_guard,
+        )
+
     @property
     def primitive(self):
         """
@@ -341,14 +770,36 @@ class Solver(SolverBase):
     def reductions(self):
         """
         Generate runtime reductions on the solution data for time series.
+
+        Point mass source term diagnostics (mdot, fx, fy, torque, and power)
+        without a radial cut are averaged over the time since the previous
+        call, from the accumulators updated by the advance kernels. The
+        accumulators are then reset. On the first call, or if no time has
+        elapsed, the source terms are instead sampled from the current
+        solution.
         """
         diagnostics = self._physics.diagnostics
-        udots1_acc = [p.point_mass_source_term(1, accretion=True) for p in self.patches]
-        udots2_acc = [p.point_mass_source_term(2, accretion=True) for p in self.patches]
-        udots1_grv = [p.point_mass_source_term(1, gravity=True) for p in self.patches]
-        udots2_grv = [p.point_mass_source_term(2, gravity=True) for p in self.patches]
+        udots = dict()
         da = self.mesh.dx * self.mesh.dy
         ng = self.num_guard
+        elapsed = self.time - self.accumulator_start_time
+
+        def get_udots(mass, accretion):
+            """
+            Return the source term rates of one point mass, for either the
+            accretion or the gravity term, on each patch. The kernels are only
+            launched for diagnostics which are not read from the accumulators.
+            """
+            key = (mass, accretion)
+
+            if key not in udots:
+                udots[key] = [
+                    p.point_mass_source_term(
+                        mass, gravity=not accretion, accretion=accretion
+                    )
+                    for p in self.patches
+                ]
+            return udots[key]
 
         def get_field(patch, quantity, cut, mass, gravity=False, accretion=False):
             """
@@ -394,19 +845,18 @@ class Solver(SolverBase):
             q = quantity
             i = self.patches.index(patch)
 
-            if accretion:
-                udots1 = udots1_acc
-                udots2 = udots2_acc
-            elif gravity:
-                udots1 = udots1_grv
-                udots2 = udots2_grv
+            if not accretion and not gravity:
+                raise ValueError("source term diagnostics need gravity or accretion")
 
             if mass == "both":
-                f = udots1[i][..., q] + udots2[i][..., q]
+                f = (
+                    get_udots(1, accretion)[i][..., q]
+                    + get_udots(2, accretion)[i][..., q]
+                )
             elif mass == 1:
-                f = udots1[i][..., q]
+                f = get_udots(1, accretion)[i][..., q]
             elif mass == 2:
-                f = udots2[i][..., q]
+                f = get_udots(2, accretion)[i][..., q]
 
             return apply_radial_cut(f)
 
@@ -425,23 +875,308 @@ class Solver(SolverBase):
                     result.append(f.sum())
             return result
 
+        def get_sum_accumulators(d):
+            masses = [1, 2] if d.which_mass == "both" else [d.which_mass]
+            term = 1 if d.accretion else 0
+            q = ACCUMULATED_QUANTITIES.index(d.quantity)
+
+            if d.quantity == "power" and d.which_mass == "both":
+                raise ValueError("Mass option for 'power' must be 1 or 2.")
+
+            result = []
+            for p in self.patches:
+                with p.execution_context:
+                    f = sum(p.accumulators[:, m - 1, term, q] for m in masses)
+                    result.append(f.sum() / elapsed)
+            return result
+
+        def get_radial_profiles(d):
+            """
+            Return a dictionary of radial profiles binned into annuli, which
+            span the radial cut or else the whole domain. The profiles are
+            integrated over the area of each annulus.
+            """
+            import numpy as np
+
+            r0, r1 = d.radial_cut or (0.0, self.mesh.x1)
+            m = d.num_modes
+            f = sum(
+                to_host(p.radial_profiles(r0, r1, d.num_bins, m)) for p in self.patches
+            )
+            f *= da
+            edges = np.linspace(r0, r1, d.num_bins + 1)
+            return dict(
+                radius=0.5 * (edges[1:] + edges[:-1]),
+                area=f[:, 0],
+                sigma=f[:, 1],
+                angular_momentum_flux=f[:, 2],
+                torque_density=f[:, 3],
+                modes=f[:, 4::2] + 1.0j * f[:, 5::2],
+            )
+
+        def get_plugin_sums(d):
+            """
+            Return a dictionary of the plugin's fields, integrated over the
+            radial cut or else the whole domain.
+            """
+            plugin, lib = self.plugin_library(d.plugin)
+            sums = 0.0
+            self.set_bc("primitive1")
+
+            for p in self.patches:
+                with p.execution_context:
+                    f = p.plugin_field(lib, plugin)
+
+                    if d.radial_cut is not None:
+                        x, y = p.cell_center_coordinate_arrays
+                        r = (x**2 + y**2) ** 0.5
+                        r0, r1 = d.radial_cut
+                        f *= ((r0 < r) * (r < r1))[..., None]
+
+                    sums += to_host(f.sum(axis=(0, 1)))
+
+            return dict(zip(plugin.fields, sums * da))
+
         pass1 = []
         pass2 = []
 
         for d in diagnostics:
             if d.quantity == "time":
                 pass1.append(self.time / self.setup.reference_time_scale)
+            elif (
+                d.quantity in ACCUMULATED_QUANTITIES
+                and d.radial_cut is None
+                and elapsed > 0.0
+            ):
+                pass1.append(get_sum_accumulators(d))
+            elif d.quantity == "radial_profiles":
+                pass1.append(get_radial_profiles(d))
+            elif d.quantity == "plugin":
+                pass1.append(get_plugin_sums(d))
             else:
                 pass1.append(get_sum_fields(d))
 
         for item in pass1:
-            if type(item) is not float:
+            if type(item) is list:
                 pass2.append(sum(to_host(x) for x in item) * da)
             else:
                 pass2.append(item)
 
+        self.reset_accumulators()
         return pass2
 
+    def reset_accumulators(self):
+        """
+        Zero the time-integrated point mass source terms on each patch.
+        """
+        for patch in self.patches:
+            with patch.execution_context:
+                patch.accumulators[...] = 0.0
+
+        self.accumulator_start_time = self.time
+
+    def floor_counts(self):
+        """
+        Return the number of zone updates, since the previous call, in which
+        each floor or ceiling was applied, and reset the counters.
+
+        Zones are counted once per Runge-Kutta stage, and once per cooling
+        half-step if the cooling is split. The result is a
+        dictionary keyed by the names in `FLOOR_COUNTERS`.
+        """
+        counts = [0] * len(FLOOR_COUNTERS)
+
+        for patch in self.patches:
+            with patch.execution_context:
+                f = to_host(patch.floor_counters.sum(axis=0))
+                counts = [c + int(n) for c, n in zip(counts, f)]
+                patch.floor_counters[...] = 0.0
+
+        return dict(zip(FLOOR_COUNTERS, counts))
+
+    def field_averages(self):
+        """
+        Return time averages of the selected fields since the previous call.
+
+        The fields are chosen with the `averaged_fields` solver option, a
+        comma-separated list of names from `AVERAGED_FIELDS`. The running
+        sums are reset after they are read. The sums are not written to
+        checkpoints, so after a restart the first average starts at the time
+        of the restart. None is returned if no fields are selected, or if no
+        time has elapsed.
+        """
+        elapsed = self.time - self.field_sums_start_time
+
+        if not self.averaged_fields or elapsed == 0.0:
+            return None
+
+        sums = concat_on_host([p.field_sums for p in self.patches])
+        result = dict(
+            start_time=self.field_sums_start_time,
+            end_time=self.time,
+            fields={
+                f: sums[..., n] / elapsed for n, f in enumerate(self.averaged_fields)
+            },
+        )
+
+        for patch in self.patches:
+            with patch.execution_context:
+                patch.field_sums[...] = 0.0
+
+        self.field_sums_start_time = self.time
+        return result
+
+    def prolonged_solution(self, factor=2):
+        primitive = self.solution
+
+        while factor > 1:
+            primitive = prolong_primitive(primitive, self._physics.gamma_law_index)
+            factor //= 2
+
+        return primitive
+
+    def pyramid(self, min_size=64):
+        """
+        Return the primitive data restricted to a sequence of meshes, each
+        with half the resolution of the one before, as arrays on the host.
+
+        Each patch is restricted where its data resides. The sequence ends
+        before a level would have fewer than min_size zones on a side, or
+        when a patch can no longer be divided evenly.
+        """
+        import numpy as np
+
+        ng = self.num_guard
+        arrays = [patch.primitive1 for patch in self.patches]
+        levels = list()
+
+        while True:
+            shapes = [(a.shape[0] - 2 * ng, a.shape[1] - 2 * ng) for a in arrays]
+            ni = sum(s[0] for s in shapes)
+            nj = shapes[0][1]
+
+            if any(s[0] % 2 or s[1] % 2 for s in shapes) or min(ni, nj) < 2 * min_size:
+                break
+
+            arrays = [p.restrict_primitive(a, ng) for p, a in zip(self.patches, arrays)]
+            levels.append(np.concatenate([to_host(a) for a in arrays]))
+            ng = 0
+
+        return levels
+
+    def plugin_library(self, plugin):
+        """
+        Return a kernel library with the given plugin compiled in. Libraries
+        are built on first use, and kept for the lifetime of the solver.
+        """
+        if type(plugin) is str:
+            try:
+                plugin = next(p for p in self._physics.plugins if p.name == plugin)
+            except StopIteration:
+                raise ValueError(f"no plugin named {plugin}")
+
+        key = (plugin.name, plugin.code, tuple(plugin.fields))
+
+        if key not in self.plugin_libs:
+            logger.info(f"compile plugin {plugin.name}")
+            self.plugin_libs[key] = Library(
+                f"{self.code}\n{plugin.code}\n{plugin.kernel_code()}",
+                mode=self.mode,
+                debug=False,
+                define_macros=self.define_macros,
+            )
+
+        return plugin, self.plugin_libs[key]
+
+    def plugin_field(self, plugin):
+        """
+        Return the values of a user-defined plugin function on each zone, as
+        an array on the host with shape (ni, nj, len(plugin.fields)).
+
+        The plugin is either a :obj:`Plugin` instance or the name of one in
+        the physics `plugins` list. Each patch is evaluated where its data
+        resides.
+        """
+        import numpy as np
+
+        plugin, lib = self.plugin_library(plugin)
+        self.set_bc("primitive1")
+        fields = [p.plugin_field(lib, plugin) for p in self.patches]
+        return np.concatenate([to_host(f) for f in fields])
+
+    def downsampled_field(self, name, factor=1, log_scale=False):
+        """
+        Return a field from `IMAGE_FIELDS`, averaged over blocks of factor x
+        factor zones, as a 2d array on the host.
+
+        Each patch is downsampled where its data resides, so only the
+        downsampled image is copied to the host. The factor must divide the
+        number of zones on each patch in both directions.
+        """
+        import numpy as np
+
+        if name not in IMAGE_FIELDS:
+            raise ValueError(f"unknown image field {name}, options are {IMAGE_FIELDS}")
+
+        for patch in self.patches:
+            if patch.shape[0] % factor or patch.shape[1] % factor:
+                raise ValueError(
+                    f"downsample factor {factor} does not divide patch shape {patch.shape}"
+                )
+
+        field = IMAGE_FIELDS.index(name)
+        images = [p.downsample_field(field, factor, log_scale) for p in self.patches]
+        return np.concatenate([to_host(a) for a in images])
+
+    def sample_probes(self):
+        """
+        Sample the primitive data at the probe positions into the next row
+        of the probe ring buffer.
+        """
+        import numpy as np
+
+        positions = np.array(self._physics.probe_positions(self.time))
+        row = self.probe_head % self._options.probe_buffer_size
+        self.set_bc("primitive1")
+
+        for patch in self.patches:
+            patch.sample_probes(positions, row)
+
+        self.probe_times[row] = self.time
+        self.probe_head += 1
+
+    @property
+    def num_probe_samples(self):
+        return self.probe_head - self.probe_tail
+
+    def probe_samples(self):
+        """
+        Return the probe samples taken since the previous call, and clear them.
+
+        The result is an array with one row per sample: the time, followed by
+        the primitive variables at each probe. If more samples were taken
+        than the ring buffer holds (the `probe_buffer_size` solver option),
+        the oldest ones are lost.
+        """
+        import numpy as np
+
+        if self.num_probe_samples == 0:
+            return None
+
+        size = self._options.probe_buffer_size
+        lost = self.num_probe_samples - size
+
+        if lost > 0:
+            logger.warning(f"{lost} probe samples overwritten; drain them more often")
+
+        first = max(self.probe_tail, self.probe_head - size)
+        rows = [n % size for n in range(first, self.probe_head)]
+        samples = sum(to_host(p.probe_buffer[rows]) for p in self.patches)
+        times = self.probe_times[rows]
+        self.probe_tail = self.probe_head
+
+        return np.column_stack([times, samples.reshape(len(rows), -1)])
+
     @property
     def time(self):
         return self.patches[0].time
@@ -471,14 +1206,38 @@ class Solver(SolverBase):
         )
 
     def advance(self, dt):
+        if self.averaged_fields:
+            for patch in self.patches:
+                patch.accumulate_fields(dt)
+
+        # With split cooling, the hydrodynamics update is bracketed by two
+        # half-steps of cooling (Strang splitting), so it is second order
+        # accurate in time. The third argument to advance_rk is the weight of
+        # each stage's source terms in the time-integrated accumulators.
+        if self.patches[0].split_cooling:
+            self.cool(0.5 * dt)
+
         self.new_iteration()
-        self.advance_rk(0.0, dt)
-        self.advance_rk(0.5, dt)
+        self.advance_rk(0.0, dt, 0.5)
+        self.advance_rk(0.5, dt, 0.5)
+
+        if self.patches[0].split_cooling:
+            self.cool(0.5 * dt)
+
+        self.num_iterations += 1
+
+        if self._physics.probes:
+            if self.num_iterations % self._physics.probe_cadence == 0:
+                self.sample_probes()
+
+    def cool(self, dt):
+        for patch in self.patches:
+            patch.cool(dt)
 
-    def advance_rk(self, rk_param, dt):
+    def advance_rk(self, rk_param, dt, weight):
         self.set_bc("primitive1")
         for patch in self.patches:
-            patch.advance_rk(rk_param, dt)
+            patch.advance_rk(rk_param, dt, weight)
 
     def set_bc(self, array):
         ng = self.num_guard
@@ -9,6 +9,29 @@ DESCRIPTION: Isothermal solver for a binary accretion problem in 2D planar
 // ============================================================================
 #define NCONS 3
 #define PLM_THETA 1.8
+#define RECONSTRUCTION_PLM 0
+#define RECONSTRUCTION_PPM 1
+#define RECONSTRUCTION_WENO5 2
+#define NUM_ACCUMULATORS 20 // 2 masses x (gravity, accretion) x 5 quantities
+#define NUM_AVERAGED_FIELDS 5
+#define NUM_IMAGE_FIELDS 4
+#define NUM_FLOOR_COUNTERS 2 // density floor, velocity ceiling
+#define DENSITY_FLOOR_ACTIVE (1 << 0)
+#define VELOCITY_CEILING_ACTIVE (1 << 1)
+
+// The reconstruction scheme is selected at compile time. PLM needs two guard
+// zones, and PPM and WENO5 need three.
+#ifndef RECONSTRUCTION
+#define RECONSTRUCTION RECONSTRUCTION_PLM
+#endif
+
+#ifndef NUM_GUARD
+#if (RECONSTRUCTION == RECONSTRUCTION_PLM)
+#define NUM_GUARD 2
+#else
+#define NUM_GUARD 3
+#endif
+#endif
 
 
 // ============================ MATH ==========================================
@@ -20,6 +43,25 @@ DESCRIPTION: Isothermal solver for a binary accretion problem in 2D planar
 #define sign(x) copysign(1.0, x)
 #define minabs(a, b, c) min3(fabs(a), fabs(b), fabs(c))
 
+#if (EXEC_MODE == EXEC_GPU)
+#define ACCUMULATE(x, y) atomicAdd(&(x), y)
+#else
+#define ACCUMULATE(x, y) (x) += (y)
+#endif
+
+// Increment the counter of each floor or ceiling flagged in a bitmask returned
+// by conserved_to_primitive.
+PRIVATE void count_floors(int flags, double *counters)
+{
+    for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+    {
+        if (flags & (1 << n))
+        {
+            ACCUMULATE(counters[n], 1.0);
+        }
+    }
+}
+
 PRIVATE double plm_gradient_scalar(double yl, double y0, double yr)
 {
     double a = (y0 - yl) * PLM_THETA;
@@ -36,6 +78,114 @@ PRIVATE void plm_gradient(double *yl, double *y0, double *yr, double *g)
     }
 }
 
+#if (RECONSTRUCTION == RECONSTRUCTION_PPM)
+
+// Face values at the left (fm) and right (fp) of zone 0 in the stencil
+// (y2l, yl, y0, yr, y2r), by the piecewise parabolic method of Colella &
+// Woodward (1984). The fourth-order interface values are bounded by the
+// neighboring zone values, and the parabola is then made monotone.
+PRIVATE void reconstruct_scalar(double y2l, double yl, double y0, double yr, double y2r, double *fm, double *fp)
+{
+    double am = 7.0 / 12.0 * (yl + y0) - 1.0 / 12.0 * (y2l + yr);
+    double ap = 7.0 / 12.0 * (y0 + yr) - 1.0 / 12.0 * (yl + y2r);
+
+    am = max2(min2(yl, y0), min2(am, max2(yl, y0)));
+    ap = max2(min2(y0, yr), min2(ap, max2(y0, yr)));
+
+    if ((ap - y0) * (y0 - am) <= 0.0)
+    {
+        am = y0;
+        ap = y0;
+    }
+    else
+    {
+        double d = ap - am;
+        double m = 6.0 * (y0 - 0.5 * (am + ap));
+
+        if (d * m > d * d)
+        {
+            am = 3.0 * y0 - 2.0 * ap;
+        }
+        else if (d * m < -d * d)
+        {
+            ap = 3.0 * y0 - 2.0 * am;
+        }
+    }
+    *fm = am;
+    *fp = ap;
+}
+
+#elif (RECONSTRUCTION == RECONSTRUCTION_WENO5)
+
+// Fifth-order WENO value at the right face of zone 0, with the WENO-Z
+// nonlinear weights of Borges et al. (2008).
+PRIVATE double weno5_face(double y2l, double yl, double y0, double yr, double y2r)
+{
+    double q0 = (2.0 * y2l - 7.0 * yl + 11.0 * y0) / 6.0;
+    double q1 = (-yl + 5.0 * y0 + 2.0 * yr) / 6.0;
+    double q2 = (2.0 * y0 + 5.0 * yr - y2r) / 6.0;
+    double c0 = y2l - 2.0 * yl + y0;
+    double c1 = yl - 2.0 * y0 + yr;
+    double c2 = y0 - 2.0 * yr + y2r;
+    double e0 = y2l - 4.0 * yl + 3.0 * y0;
+    double e1 = yl - yr;
+    double e2 = 3.0 * y0 - 4.0 * yr + y2r;
+    double b0 = 13.0 / 12.0 * c0 * c0 + 0.25 * e0 * e0;
+    double b1 = 13.0 / 12.0 * c1 * c1 + 0.25 * e1 * e1;
+    double b2 = 13.0 / 12.0 * c2 * c2 + 0.25 * e2 * e2;
+    double tau = fabs(b0 - b2);
+    double r0 = tau / (b0 + 1e-40);
+    double r1 = tau / (b1 + 1e-40);
+    double r2 = tau / (b2 + 1e-40);
+    double w0 = 0.1 * (1.0 + r0 * r0);
+    double w1 = 0.6 * (1.0 + r1 * r1);
+    double w2 = 0.3 * (1.0 + r2 * r2);
+    return (w0 * q0 + w1 * q1 + w2 * q2) / (w0 + w1 + w2);
+}
+
+// Face values at the left (fm) and right (fp) of zone 0 in the stencil
+// (y2l, yl, y0, yr, y2r). The left face uses the mirrored stencil.
+PRIVATE void reconstruct_scalar(double y2l, double yl, double y0, double yr, double y2r, double *fm, double *fp)
+{
+    *fm = weno5_face(y2r, yr, y0, yl, y2l);
+    *fp = weno5_face(y2l, yl, y0, yr, y2r);
+}
+
+#endif
+
+#if (RECONSTRUCTION != RECONSTRUCTION_PLM)
+
+// Overwrite the face values fm and fp of zone 0 (already set from the PLM
+// gradient) with those of the higher-order reconstruction, unless any face
+// value would fall outside the range of the zone and its two neighbors. In
+// that case the zone keeps its PLM face values. Face densities are then
+// positive, and the velocity does not overshoot in the near-vacuum around the
+// sinks, where unbounded WENO5 faces were found to be unstable.
+PRIVATE void reconstruct_faces(double *y2l, double *yl, double *y0, double *yr, double *y2r, double *fm, double *fp)
+{
+    double hm[NCONS];
+    double hp[NCONS];
+    int bounded = 1;
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        double lo = min3(yl[q], y0[q], yr[q]);
+        double hi = max3(yl[q], y0[q], yr[q]);
+        reconstruct_scalar(y2l[q], yl[q], y0[q], yr[q], y2r[q], &hm[q], &hp[q]);
+        bounded &= hm[q] >= lo && hm[q] <= hi && hp[q] >= lo && hp[q] <= hi;
+    }
+    if (bounded)
+    {
+        for (int q = 0; q < NCONS; ++q)
+        {
+            fm[q] = hm[q];
+            fp[q] = hp[q];
+        }
+    }
+}
+
+#endif
+
 
 // ============================ INTERNAL STRUCTS ==============================
 // ============================================================================
@@ -55,6 +205,18 @@ struct PointMassList {
     struct PointMass masses[2];
 };
 
+// A zone as seen by a user-defined plugin function. The primitive variables
+// of the neighboring zones are at prim[+/- si] and prim[+/- sj].
+struct PluginZone {
+    double x;
+    double y;
+    double dx;
+    double dy;
+    double *prim;
+    int si;
+    int sj;
+};
+
 struct KeplerianBuffer {
     double surface_density;
     double central_mass;
@@ -94,13 +256,14 @@ PRIVATE double gravitational_potential(
     return phi;
 }
 
-PRIVATE void point_mass_source_term(
+PRIVATE void point_mass_source_term_parts(
     struct PointMass *mass,
     double x1,
     double y1,
     double dt,
     double *prim,
-    double *delta_cons)
+    double *delta_grav,
+    double *delta_sink)
 {
     double x0 = mass->x;
     double y0 = mass->y;
@@ -128,17 +291,17 @@ PRIVATE void point_mass_source_term(
     }
 
     // gravitational force
-    delta_cons[0] += 0.0;
-    delta_cons[1] += fx * dt;
-    delta_cons[2] += fy * dt;
+    delta_grav[0] = 0.0;
+    delta_grav[1] = fx * dt;
+    delta_grav[2] = fy * dt;
 
     switch (mass->sink_model)
     {
         case 1: // acceleration-free
         {
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += dt * mdot * prim[1];
-            delta_cons[2] += dt * mdot * prim[2];
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * prim[1];
+            delta_sink[2] = dt * mdot * prim[2];
             break;
         }
         case 2: // torque-free
@@ -152,39 +315,73 @@ PRIVATE void point_mass_source_term(
             double dvdotrhat = (vx - vx0) * rhatx + (vy - vy0) * rhaty;
             double vxstar = dvdotrhat * rhatx + vx0;
             double vystar = dvdotrhat * rhaty + vy0;
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += dt * mdot * vxstar;
-            delta_cons[2] += dt * mdot * vystar;
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * vxstar;
+            delta_sink[2] = dt * mdot * vystar;
             break;
         }
         case 3: // force-free
         {
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += 0.0;
-            delta_cons[2] += 0.0;
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
             break;
         }
         default: // sink is inactive
         {
-            delta_cons[0] += 0.0;
-            delta_cons[1] += 0.0;
-            delta_cons[2] += 0.0;
+            delta_sink[0] = 0.0;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
             break;
         }
     }
 }
 
-PRIVATE void point_masses_source_term(
-    struct PointMassList *mass_list,
+PRIVATE void point_mass_source_term(
+    struct PointMass *mass,
     double x1,
     double y1,
     double dt,
     double *prim,
     double *delta_cons)
 {
-    for (int p = 0; p < 2; ++p)
+    double delta_grav[NCONS];
+    double delta_sink[NCONS];
+
+    point_mass_source_term_parts(mass, x1, y1, dt, prim, delta_grav, delta_sink);
+
+    for (int q = 0; q < NCONS; ++q)
     {
-        point_mass_source_term(&mass_list->masses[p], x1, y1, dt, prim, delta_cons);
+        delta_cons[q] += delta_grav[q];
+        delta_cons[q] += delta_sink[q];
+    }
+}
+
+// Add one point mass's source terms at a zone, times a weight, to a row of
+// time-integrated accumulators. For each of the gravity and accretion terms,
+// the accumulated quantities are the rates of change of the gas mass and
+// momentum, the torque about the origin, and the power delivered to the
+// point mass (these correspond to the diagnostics mdot, fx, fy, torque, and
+// power). The row layout is [mass][term][quantity].
+PRIVATE void accumulate_point_mass_source_term(
+    struct PointMass *mass,
+    int p,
+    double x1,
+    double y1,
+    double weight,
+    double *delta_grav,
+    double *delta_sink,
+    double *accumulators)
+{
+    for (int t = 0; t < 2; ++t)
+    {
+        double *delta = t == 0 ? delta_grav : delta_sink;
+        double *acc = &accumulators[(2 * p + t) * 5];
+        ACCUMULATE(acc[0], weight * delta[0]);
+        ACCUMULATE(acc[1], weight * delta[1]);
+        ACCUMULATE(acc[2], weight * delta[2]);
+        ACCUMULATE(acc[3], weight * (x1 * delta[2] - y1 * delta[1]));
+        ACCUMULATE(acc[4], weight * (mass->vx * delta[1] + mass->vy * delta[2]));
     }
 }
 
@@ -265,7 +462,8 @@ PRIVATE void shear_strain(
 
 // ============================ HYDRO =========================================
 // ============================================================================
-PRIVATE void conserved_to_primitive(
+// Returns a bitmask of the floors and ceilings which were applied.
+PRIVATE int conserved_to_primitive(
     const double *cons,
     double *prim,
     double velocity_ceiling,
@@ -280,6 +478,9 @@ PRIVATE void conserved_to_primitive(
     prim[0] = rho;
     prim[1] = vx;
     prim[2] = vy;
+
+    return (cons[0] < density_floor) * DENSITY_FLOOR_ACTIVE
+        + (fabs(px / rho) > velocity_ceiling || fabs(py / rho) > velocity_ceiling) * VELOCITY_CEILING_ACTIVE;
 }
 
 PRIVATE void primitive_to_conserved(
@@ -380,6 +581,203 @@ PRIVATE void riemann_hlle(
 }
 
 
+PRIVATE void advance_rk_zone(
+    struct KeplerianBuffer *buffer,
+    struct PointMassList *mass_list,
+    double patch_xl,
+    double patch_yl,
+    double dx,
+    double dy,
+    int i,
+    int j,
+    double *un, // conserved RK-base data at zone (i, j)
+    double *pai, // primitive data at zone (i - 3, j), PPM and WENO5 only
+    double *pki, // primitive data at zone (i - 2, j)
+    double *pli, // primitive data at zone (i - 1, j)
+    double *pcc, // primitive data at zone (i, j)
+    double *pri, // primitive data at zone (i + 1, j)
+    double *pti, // primitive data at zone (i + 2, j)
+    double *pui, // primitive data at zone (i + 3, j), PPM and WENO5 only
+    double *pout, // updated primitive data at zone (i, j)
+    double *acc, // time-integrated accumulators for row i
+    double *floors, // floor and ceiling counters for row i
+    double cs2,
+    double mach_squared,
+    int eos_type,
+    double nu,
+    double a,
+    double dt,
+    double accumulator_weight,
+    double velocity_ceiling,
+    double density_floor)
+{
+    double xl = patch_xl + (i + 0.0) * dx;
+    double xc = patch_xl + (i + 0.5) * dx;
+    double xr = patch_xl + (i + 1.0) * dx;
+    double yl = patch_yl + (j + 0.0) * dy;
+    double yc = patch_yl + (j + 0.5) * dy;
+    double yr = patch_yl + (j + 1.0) * dy;
+
+    // ------------------------------------------------------------------------
+    //                 tj
+    //
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //      |  lr   |  rj   |   rr  |
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //  ki  |  li  -|+  c  -|+  ri  |  ti
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //      |       |       |       |
+    //      |  ll   |  lj   |   rl  |
+    //      |       |       |       |
+    //      +-------+-------+-------+
+    //
+    //                 kj
+    // ------------------------------------------------------------------------
+
+    double *pkj = &pcc[-2 * NCONS];
+    double *plj = &pcc[-1 * NCONS];
+    double *prj = &pcc[+1 * NCONS];
+    double *ptj = &pcc[+2 * NCONS];
+    double *pll = &pli[-1 * NCONS];
+    double *plr = &pli[+1 * NCONS];
+    double *prl = &pri[-1 * NCONS];
+    double *prr = &pri[+1 * NCONS];
+
+    double plip[NCONS];
+    double plim[NCONS];
+    double prip[NCONS];
+    double prim[NCONS];
+    double pljp[NCONS];
+    double pljm[NCONS];
+    double prjp[NCONS];
+    double prjm[NCONS];
+
+    double gxli[NCONS];
+    double gxri[NCONS];
+    double gyli[NCONS];
+    double gyri[NCONS];
+    double gxlj[NCONS];
+    double gxrj[NCONS];
+    double gylj[NCONS];
+    double gyrj[NCONS];
+    double gxcc[NCONS];
+    double gycc[NCONS];
+
+    plm_gradient(pki, pli, pcc, gxli);
+    plm_gradient(pli, pcc, pri, gxcc);
+    plm_gradient(pcc, pri, pti, gxri);
+    plm_gradient(pkj, plj, pcc, gylj);
+    plm_gradient(plj, pcc, prj, gycc);
+    plm_gradient(pcc, prj, ptj, gyrj);
+    plm_gradient(pll, pli, plr, gyli);
+    plm_gradient(prl, pri, prr, gyri);
+    plm_gradient(pll, plj, prl, gxlj);
+    plm_gradient(plr, prj, prr, gxrj);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        plim[q] = pli[q] + 0.5 * gxli[q];
+        plip[q] = pcc[q] - 0.5 * gxcc[q];
+        prim[q] = pcc[q] + 0.5 * gxcc[q];
+        prip[q] = pri[q] - 0.5 * gxri[q];
+
+        pljm[q] = plj[q] + 0.5 * gylj[q];
+        pljp[q] = pcc[q] - 0.5 * gycc[q];
+        prjm[q] = pcc[q] + 0.5 * gycc[q];
+        prjp[q] = prj[q] - 0.5 * gyrj[q];
+    }
+
+#if (RECONSTRUCTION != RECONSTRUCTION_PLM)
+    double *paj = &pcc[-3 * NCONS];
+    double *puj = &pcc[+3 * NCONS];
+    double unused[NCONS];
+
+    reconstruct_faces(pai, pki, pli, pcc, pri, unused, plim);
+    reconstruct_faces(pki, pli, pcc, pri, pti, plip, prim);
+    reconstruct_faces(pli, pcc, pri, pti, pui, prip, unused);
+    reconstruct_faces(paj, pkj, plj, pcc, prj, unused, pljm);
+    reconstruct_faces(pkj, plj, pcc, prj, ptj, pljp, prjm);
+    reconstruct_faces(plj, pcc, prj, ptj, puj, prjp, unused);
+#else
+    (void) pai;
+    (void) pui;
+#endif
+
+    double fli[NCONS];
+    double fri[NCONS];
+    double flj[NCONS];
+    double frj[NCONS];
+    double ucc[NCONS];
+
+    double cs2li = sound_speed_squared(cs2, mach_squared, eos_type, xl, yc, mass_list);
+    double cs2ri = sound_speed_squared(cs2, mach_squared, eos_type, xr, yc, mass_list);
+    double cs2lj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yl, mass_list);
+    double cs2rj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yr, mass_list);
+
+    riemann_hlle(plim, plip, fli, cs2li, 0);
+    riemann_hlle(prim, prip, fri, cs2ri, 0);
+    riemann_hlle(pljm, pljp, flj, cs2lj, 1);
+    riemann_hlle(prjm, prjp, frj, cs2rj, 1);
+
+    if (nu > 0.0)
+    {
+        double sli[4];
+        double sri[4];
+        double slj[4];
+        double srj[4];
+        double scc[4];
+
+        shear_strain(gxli, gyli, dx, dy, sli);
+        shear_strain(gxri, gyri, dx, dy, sri);
+        shear_strain(gxlj, gylj, dx, dy, slj);
+        shear_strain(gxrj, gyrj, dx, dy, srj);
+        shear_strain(gxcc, gycc, dx, dy, scc);
+
+        fli[1] -= 0.5 * nu * (pli[0] * sli[0] + pcc[0] * scc[0]); // x-x
+        fli[2] -= 0.5 * nu * (pli[0] * sli[1] + pcc[0] * scc[1]); // x-y
+        fri[1] -= 0.5 * nu * (pcc[0] * scc[0] + pri[0] * sri[0]); // x-x
+        fri[2] -= 0.5 * nu * (pcc[0] * scc[1] + pri[0] * sri[1]); // x-y
+        flj[1] -= 0.5 * nu * (plj[0] * slj[2] + pcc[0] * scc[2]); // y-x
+        flj[2] -= 0.5 * nu * (plj[0] * slj[3] + pcc[0] * scc[3]); // y-y
+        frj[1] -= 0.5 * nu * (pcc[0] * scc[2] + prj[0] * srj[2]); // y-x
+        frj[2] -= 0.5 * nu * (pcc[0] * scc[3] + prj[0] * srj[3]); // y-y
+    }
+    double delta_cons[3] = {0.0, 0.0, 0.0};
+    primitive_to_conserved(pcc, ucc);
+    buffer_source_term(buffer, xc, yc, dt, ucc, delta_cons);
+
+    for (int p = 0; p < 2; ++p)
+    {
+        double delta_grav[NCONS];
+        double delta_sink[NCONS];
+        struct PointMass *mass = &mass_list->masses[p];
+
+        point_mass_source_term_parts(mass, xc, yc, dt, pcc, delta_grav, delta_sink);
+        accumulate_point_mass_source_term(mass, p, xc, yc, accumulator_weight, delta_grav, delta_sink, acc);
+
+        for (int q = 0; q < NCONS; ++q)
+        {
+            delta_cons[q] += delta_grav[q];
+            delta_cons[q] += delta_sink[q];
+        }
+    }
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        delta_cons[q] -= ((fri[q] - fli[q]) / dx + (frj[q] - flj[q]) / dy) * dt;
+    }
+    for (int q = 0; q < NCONS; ++q)
+    {
+        ucc[q] += delta_cons[q];
+        ucc[q] = (1.0 - a) * ucc[q] + a * un[q];
+    }
+    count_floors(conserved_to_primitive(ucc, pout, velocity_ceiling, density_floor), floors);
+}
+
 // ============================ PUBLIC API ====================================
 // ============================================================================
 PUBLIC void cbdiso_2d_advance_rk(
@@ -389,9 +787,11 @@ PUBLIC void cbdiso_2d_advance_rk(
     double patch_xr,
     double patch_yl,
     double patch_yr,
-    double *conserved_rk, // :: $.shape == (ni + 4, nj + 4, 3)
-    double *primitive_rd, // :: $.shape == (ni + 4, nj + 4, 3)
-    double *primitive_wr, // :: $.shape == (ni + 4, nj + 4, 3)
+    double *conserved_rk, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *primitive_rd, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *primitive_wr, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *accumulators, // :: $.shape == (ni, 2, 2, 5)
+    double *floor_counters, // :: $.shape == (ni, 2)
     double buffer_surface_density,
     double buffer_central_mass,
     double buffer_driving_rate,
@@ -422,6 +822,7 @@ PUBLIC void cbdiso_2d_advance_rk(
     double nu, // kinematic viscosity coefficient
     double a, // RK parameter
     double dt, // timestep
+    double accumulator_weight, // weight of this RK stage in the time integral
     double velocity_ceiling,
     double density_floor)
 {
@@ -440,176 +841,222 @@ PUBLIC void cbdiso_2d_advance_rk(
     double dx = (patch_xr - patch_xl) / ni;
     double dy = (patch_yr - patch_yl) / nj;
 
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
     FOR_EACH_2D(ni, nj)
     {
-        double xl = patch_xl + (i + 0.0) * dx;
-        double xc = patch_xl + (i + 0.5) * dx;
-        double xr = patch_xl + (i + 1.0) * dx;
-        double yl = patch_yl + (j + 0.0) * dy;
-        double yc = patch_yl + (j + 0.5) * dy;
-        double yr = patch_yl + (j + 1.0) * dy;
-
-        // ------------------------------------------------------------------------
-        //                 tj
-        //
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //      |  lr   |  rj   |   rr  |
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //  ki  |  li  -|+  c  -|+  ri  |  ti
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //      |       |       |       |
-        //      |  ll   |  lj   |   rl  |
-        //      |       |       |       |
-        //      +-------+-------+-------+
-        //
-        //                 kj
-        // ------------------------------------------------------------------------
-
-        int ncc = (i     + ng) * si + (j     + ng) * sj;
-        int nli = (i - 1 + ng) * si + (j     + ng) * sj;
-        int nri = (i + 1 + ng) * si + (j     + ng) * sj;
-        int nlj = (i     + ng) * si + (j - 1 + ng) * sj;
-        int nrj = (i     + ng) * si + (j + 1 + ng) * sj;
-        int nki = (i - 2 + ng) * si + (j     + ng) * sj;
-        int nti = (i + 2 + ng) * si + (j     + ng) * sj;
-        int nkj = (i     + ng) * si + (j - 2 + ng) * sj;
-        int ntj = (i     + ng) * si + (j + 2 + ng) * sj;
-        int nll = (i - 1 + ng) * si + (j - 1 + ng) * sj;
-        int nlr = (i - 1 + ng) * si + (j + 1 + ng) * sj;
-        int nrl = (i + 1 + ng) * si + (j - 1 + ng) * sj;
-        int nrr = (i + 1 + ng) * si + (j + 1 + ng) * sj;
-
-        double *un = &conserved_rk[ncc];
-        double *pcc = &primitive_rd[ncc];
-        double *pli = &primitive_rd[nli];
-        double *pri = &primitive_rd[nri];
-        double *plj = &primitive_rd[nlj];
-        double *prj = &primitive_rd[nrj];
-        double *pki = &primitive_rd[nki];
-        double *pti = &primitive_rd[nti];
-        double *pkj = &primitive_rd[nkj];
-        double *ptj = &primitive_rd[ntj];
-        double *pll = &primitive_rd[nll];
-        double *plr = &primitive_rd[nlr];
-        double *prl = &primitive_rd[nrl];
-        double *prr = &primitive_rd[nrr];
-
-        double plip[NCONS];
-        double plim[NCONS];
-        double prip[NCONS];
-        double prim[NCONS];
-        double pljp[NCONS];
-        double pljm[NCONS];
-        double prjp[NCONS];
-        double prjm[NCONS];
-
-        double gxli[NCONS];
-        double gxri[NCONS];
-        double gyli[NCONS];
-        double gyri[NCONS];
-        double gxlj[NCONS];
-        double gxrj[NCONS];
-        double gylj[NCONS];
-        double gyrj[NCONS];
-        double gxcc[NCONS];
-        double gycc[NCONS];
-
-        plm_gradient(pki, pli, pcc, gxli);
-        plm_gradient(pli, pcc, pri, gxcc);
-        plm_gradient(pcc, pri, pti, gxri);
-        plm_gradient(pkj, plj, pcc, gylj);
-        plm_gradient(plj, pcc, prj, gycc);
-        plm_gradient(pcc, prj, ptj, gyrj);
-        plm_gradient(pll, pli, plr, gyli);
-        plm_gradient(prl, pri, prr, gyri);
-        plm_gradient(pll, plj, prl, gxlj);
-        plm_gradient(plr, prj, prr, gxrj);
+        int ncc = (i + ng) * si + (j + ng) * sj;
 
-        for (int q = 0; q < NCONS; ++q)
-        {
-            plim[q] = pli[q] + 0.5 * gxli[q];
-            plip[q] = pcc[q] - 0.5 * gxcc[q];
-            prim[q] = pcc[q] + 0.5 * gxcc[q];
-            prip[q] = pri[q] - 0.5 * gxri[q];
-
-            pljm[q] = plj[q] + 0.5 * gylj[q];
-            pljp[q] = pcc[q] - 0.5 * gycc[q];
-            prjm[q] = pcc[q] + 0.5 * gycc[q];
-            prjp[q] = prj[q] - 0.5 * gyrj[q];
-        }
+        advance_rk_zone(
+            &buffer,
+            &mass_list,
+            patch_xl,
+            patch_yl,
+            dx,
+            dy,
+            i,
+            j,
+            &conserved_rk[ncc],
+            &primitive_rd[ncc - 3 * si],
+            &primitive_rd[ncc - 2 * si],
+            &primitive_rd[ncc - 1 * si],
+            &primitive_rd[ncc],
+            &primitive_rd[ncc + 1 * si],
+            &primitive_rd[ncc + 2 * si],
+            &primitive_rd[ncc + 3 * si],
+            &primitive_wr[ncc],
+            &accumulators[i * NUM_ACCUMULATORS],
+            &floor_counters[i * NUM_FLOOR_COUNTERS],
+            cs2,
+            mach_squared,
+            eos_type,
+            nu,
+            a,
+            dt,
+            accumulator_weight,
+            velocity_ceiling,
+            density_floor);
+    }
+}
+
+// Same as cbdiso_2d_advance_rk, except that the primitive data is updated in
+// place. The i-range is split into chunks, and each chunk is swept in i,
+// holding updated rows in a three-row ring until the stencil no longer needs
+// the old data in those rows. Rows bordering a chunk are saved before the
+// sweep begins, since they are overwritten by the neighboring chunk. The
+// workspace array holds, per chunk, the four bordering rows and the ring.
+// This kernel is not available in GPU mode.
+// ----------------------------------------------------------------------------
+PUBLIC void cbdiso_2d_advance_rk_inplace(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double *conserved_rk, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    int num_chunks, // :: 1 <= $ <= ni
+    double *workspace, // :: $.shape == (num_chunks, 7, nj + 2 * NUM_GUARD, 3)
+    double *accumulators, // :: $.shape == (ni, 2, 2, 5)
+    double *floor_counters, // :: $.shape == (ni, 2)
+    double buffer_surface_density,
+    double buffer_central_mass,
+    double buffer_driving_rate,
+    double buffer_outer_radius,
+    double buffer_onset_width,
+    int buffer_is_enabled,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double cs2, // equation of state
+    double mach_squared,
+    int eos_type,
+    double nu, // kinematic viscosity coefficient
+    double a, // RK parameter
+    double dt, // timestep
+    double accumulator_weight, // weight of this RK stage in the time integral
+    double velocity_ceiling,
+    double density_floor)
+{
+#if (EXEC_MODE != EXEC_GPU)
+    struct KeplerianBuffer buffer = {
+        buffer_surface_density,
+        buffer_central_mass,
+        buffer_driving_rate,
+        buffer_outer_radius,
+        buffer_onset_width,
+        buffer_is_enabled
+    };
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
+
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
 
-        double fli[NCONS];
-        double fri[NCONS];
-        double flj[NCONS];
-        double frj[NCONS];
-        double ucc[NCONS];
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
 
-        double cs2li = sound_speed_squared(cs2, mach_squared, eos_type, xl, yc, &mass_list);
-        double cs2ri = sound_speed_squared(cs2, mach_squared, eos_type, xr, yc, &mass_list);
-        double cs2lj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yl, &mass_list);
-        double cs2rj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yr, &mass_list);
+    int sw = 7 * si; // workspace size per chunk
 
-        riemann_hlle(plim, plip, fli, cs2li, 0);
-        riemann_hlle(prim, prip, fri, cs2ri, 0);
-        riemann_hlle(pljm, pljp, flj, cs2lj, 1);
-        riemann_hlle(prjm, prjp, frj, cs2rj, 1);
+    FOR_EACH_1D(num_chunks)
+    {
+        int i0 = (i + 0) * ni / num_chunks;
+        int i1 = (i + 1) * ni / num_chunks;
+        double *halo = &workspace[i * sw];
 
-        if (nu > 0.0)
+        for (int n = 0; n < 2 * si; ++n)
         {
-            double sli[4];
-            double sri[4];
-            double slj[4];
-            double srj[4];
-            double scc[4];
-
-            shear_strain(gxli, gyli, dx, dy, sli);
-            shear_strain(gxri, gyri, dx, dy, sri);
-            shear_strain(gxlj, gylj, dx, dy, slj);
-            shear_strain(gxrj, gyrj, dx, dy, srj);
-            shear_strain(gxcc, gycc, dx, dy, scc);
-
-            fli[1] -= 0.5 * nu * (pli[0] * sli[0] + pcc[0] * scc[0]); // x-x
-            fli[2] -= 0.5 * nu * (pli[0] * sli[1] + pcc[0] * scc[1]); // x-y
-            fri[1] -= 0.5 * nu * (pcc[0] * scc[0] + pri[0] * sri[0]); // x-x
-            fri[2] -= 0.5 * nu * (pcc[0] * scc[1] + pri[0] * sri[1]); // x-y
-            flj[1] -= 0.5 * nu * (plj[0] * slj[2] + pcc[0] * scc[2]); // y-x
-            flj[2] -= 0.5 * nu * (plj[0] * slj[3] + pcc[0] * scc[3]); // y-y
-            frj[1] -= 0.5 * nu * (pcc[0] * scc[2] + prj[0] * srj[2]); // y-x
-            frj[2] -= 0.5 * nu * (pcc[0] * scc[3] + prj[0] * srj[3]); // y-y
+            halo[n] = primitive[(i0 - 2 + ng) * si + n];
+            halo[n + 2 * si] = primitive[(i1 + ng) * si + n];
         }
-        double delta_cons[3] = {0.0, 0.0, 0.0};
-        primitive_to_conserved(pcc, ucc);
-        buffer_source_term(&buffer, xc, yc, dt, ucc, delta_cons);
-        point_masses_source_term(&mass_list, xc, yc, dt, pcc, delta_cons);
+    }
 
-        for (int q = 0; q < NCONS; ++q)
-        {
-            delta_cons[q] -= ((fri[q] - fli[q]) / dx + (frj[q] - flj[q]) / dy) * dt;
-        }
-        for (int q = 0; q < NCONS; ++q)
+    FOR_EACH_1D(num_chunks)
+    {
+        int i0 = (i + 0) * ni / num_chunks;
+        int i1 = (i + 1) * ni / num_chunks;
+        double *halo = &workspace[i * sw];
+        double *ring = &workspace[i * sw + 4 * si];
+
+        for (int r = i0; r < i1 + 2; ++r)
         {
-            ucc[q] += delta_cons[q];
-            ucc[q] = (1.0 - a) * ucc[q] + a * un[q];
+            if (r < i1)
+            {
+                double *rows[5];
+                double *pout = &ring[(r % 3) * si];
+
+                for (int d = 0; d < 5; ++d)
+                {
+                    int k = r + d - 2;
+
+                    if (k < i0)
+                        rows[d] = &halo[(k - i0 + 2) * si];
+                    else if (k >= i1)
+                        rows[d] = &halo[(k - i1 + 2) * si];
+                    else
+                        rows[d] = &primitive[(k + ng) * si];
+                }
+
+                for (int j = 0; j < nj; ++j)
+                {
+                    int n = (j + ng) * sj;
+
+                    advance_rk_zone(
+                        &buffer,
+                        &mass_list,
+                        patch_xl,
+                        patch_yl,
+                        dx,
+                        dy,
+                        r,
+                        j,
+                        &conserved_rk[(r + ng) * si + n],
+                        NULL,
+                        &rows[0][n],
+                        &rows[1][n],
+                        &rows[2][n],
+                        &rows[3][n],
+                        &rows[4][n],
+                        NULL,
+                        &pout[n],
+                        &accumulators[r * NUM_ACCUMULATORS],
+                        &floor_counters[r * NUM_FLOOR_COUNTERS],
+                        cs2,
+                        mach_squared,
+                        eos_type,
+                        nu,
+                        a,
+                        dt,
+                        accumulator_weight,
+                        velocity_ceiling,
+                        density_floor);
+                }
+            }
+
+            // Row r - 2 is no longer needed by the stencil, so its updated
+            // data is moved from the ring to the primitive array.
+            if (r - 2 >= i0)
+            {
+                double *src = &ring[((r - 2) % 3) * si];
+                double *dst = &primitive[(r - 2 + ng) * si];
+
+                for (int n = ng * sj; n < (nj + ng) * sj; ++n)
+                {
+                    dst[n] = src[n];
+                }
+            }
         }
-        conserved_to_primitive(ucc, &primitive_wr[ncc], velocity_ceiling, density_floor);
     }
+#endif
 }
 
 PUBLIC void cbdiso_2d_primitive_to_conserved(
     int ni,
     int nj,
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 3)
-    double *conserved) // :: $.shape == (ni + 4, nj + 4, 3)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *conserved) // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
 {
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
@@ -623,6 +1070,279 @@ PUBLIC void cbdiso_2d_primitive_to_conserved(
     }
 }
 
+// Add dt times a selection of primitive and derived fields to their running
+// sums. Bit k of the fields argument selects field k of: sigma, vx, vy,
+// sigma * vx, and sigma * vy. The selected fields are packed, in that order,
+// along the last axis of the field_sums array.
+PUBLIC void cbdiso_2d_accumulate_fields(
+    int ni,
+    int nj,
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *field_sums, // :: $.shape == (ni, nj, bin(fields).count("1"))
+    int fields, // :: 0 < $ < (1 << 5)
+    double dt)
+{
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+    int nf = 0;
+
+    for (int k = 0; k < NUM_AVERAGED_FIELDS; ++k)
+    {
+        nf += (fields >> k) & 1;
+    }
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double *pc = &primitive[(i + ng) * si + (j + ng) * sj];
+        double *fs = &field_sums[(i * nj + j) * nf];
+        double f[NUM_AVERAGED_FIELDS] = {pc[0], pc[1], pc[2], pc[0] * pc[1], pc[0] * pc[2]};
+
+        for (int k = 0, m = 0; k < NUM_AVERAGED_FIELDS; ++k)
+        {
+            if (fields & (1 << k))
+            {
+                fs[m++] += dt * f[k];
+            }
+        }
+    }
+}
+
+// Downsample one field of the primitive data for rendering to an image, by
+// averaging blocks of factor x factor zones. The field selects one of: sigma,
+// vx, vy, and the speed (velocity magnitude). If log_scale is nonzero, the
+// base-10 logarithm of each block average is written.
+PUBLIC void cbdiso_2d_downsample_field(
+    int ni, // number of image pixels
+    int nj,
+    double *primitive, // :: $.shape == (ni * factor + 2 * NUM_GUARD, nj * factor + 2 * NUM_GUARD, 3)
+    double *image, // :: $.shape == (ni, nj)
+    int factor, // :: $ >= 1
+    int field, // :: 0 <= $ < 4
+    int log_scale)
+{
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj * factor + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double sum = 0.0;
+
+        for (int a = 0; a < factor; ++a)
+        {
+            for (int b = 0; b < factor; ++b)
+            {
+                double *pc = &primitive[(i * factor + a + ng) * si + (j * factor + b + ng) * sj];
+                double f[NUM_IMAGE_FIELDS] = {pc[0], pc[1], pc[2], sqrt(pc[1] * pc[1] + pc[2] * pc[2])};
+                sum += f[field];
+            }
+        }
+        double mean = sum / (factor * factor);
+        image[i * nj + j] = log_scale ? log10(mean) : mean;
+    }
+}
+
+// Restrict primitive data to a mesh with half the resolution, conserving the
+// mass and momentum of each 2 x 2 block of zones. The fine array
+// has ng guard zones on each side, which are not used.
+PUBLIC void cbdiso_2d_restrict_primitive(
+    int ni, // number of coarse zones
+    int nj,
+    double *fine, // :: $.shape == (2 * ni + 2 * ng, 2 * nj + 2 * ng, 3)
+    double *coarse, // :: $.shape == (ni, nj, 3)
+    int ng) // :: $ >= 0
+{
+    int si = NCONS * (2 * nj + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double u[NCONS] = {0.0};
+
+        for (int a = 0; a < 2; ++a)
+        {
+            for (int b = 0; b < 2; ++b)
+            {
+                double *pf = &fine[(2 * i + a + ng) * si + (2 * j + b + ng) * sj];
+                double uf[NCONS];
+                primitive_to_conserved(pf, uf);
+
+                for (int q = 0; q < NCONS; ++q)
+                {
+                    u[q] += 0.25 * uf[q];
+                }
+            }
+        }
+        double *pc = &coarse[(i * nj + j) * NCONS];
+        pc[0] = u[0];
+        pc[1] = u[1] / u[0];
+        pc[2] = u[2] / u[0];
+    }
+}
+
+// Sample the primitive data at a list of probe positions, by bilinear
+// interpolation between zone centers. Probes whose x-position is outside
+// this patch are given zeros, so that the samples from all patches can be
+// summed. The guard zones of the primitive array must be valid.
+PUBLIC void cbdiso_2d_sample_probes(
+    int num_probes,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    int ni,
+    int nj,
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *positions, // :: $.shape == (num_probes, 2)
+    double *samples) // :: $.shape == (num_probes, 3)
+{
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+
+    FOR_EACH_1D(num_probes)
+    {
+        double x = positions[2 * i + 0];
+        double y = positions[2 * i + 1];
+        double *sample = &samples[i * NCONS];
+        int owner = (int) floor((x - patch_xl) / dx);
+
+        if (owner >= 0 && owner < ni)
+        {
+            double fi = (x - patch_xl) / dx - 0.5;
+            double fj = (y - patch_yl) / dy - 0.5;
+            int i0 = (int) floor(fi);
+            int j0 = min2(max2((int) floor(fj), -1), nj - 1);
+            double wx = fi - i0;
+            double wy = min2(max2(fj - j0, 0.0), 1.0);
+
+            double *p00 = &primitive[(i0 + ng) * si + (j0 + ng) * sj];
+            double *p10 = &p00[si];
+            double *p01 = &p00[sj];
+            double *p11 = &p00[si + sj];
+
+            for (int q = 0; q < NCONS; ++q)
+            {
+                sample[q] =
+                    (1.0 - wx) * (1.0 - wy) * p00[q] +
+                    (0.0 + wx) * (1.0 - wy) * p10[q] +
+                    (1.0 - wx) * (0.0 + wy) * p01[q] +
+                    (0.0 + wx) * (0.0 + wy) * p11[q];
+            }
+        }
+        else
+        {
+            for (int q = 0; q < NCONS; ++q)
+            {
+                sample[q] = 0.0;
+            }
+        }
+    }
+}
+
+// Bin the surface density, the advective angular momentum flux, the
+// gravitational torque density, and the azimuthal Fourier moments of the
+// surface density (m = 0 .. num_modes) into radial annuli between
+// inner_radius and outer_radius. The last axis of the profiles array holds
+// the zone count, those three quantities, and then the real and imaginary
+// parts of each Fourier moment. Each row of zones adds to its own set of
+// bins, which are summed over by the caller.
+PUBLIC void cbdiso_2d_radial_profiles(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double inner_radius, // :: $ >= 0.0
+    double outer_radius, // :: $ > inner_radius
+    int num_bins, // :: $ > 0
+    int num_modes, // :: $ >= 0
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *profiles) // :: $.shape == (ni, num_bins, 4 + 2 * (num_modes + 1))
+{
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
+
+    int ng = NUM_GUARD; // number of guard zones
+    int si = NCONS * (nj + 2 * ng);
+    int sj = NCONS;
+    int np = 4 + 2 * (num_modes + 1);
+
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+    double dr = (outer_radius - inner_radius) / num_bins;
+
+    FOR_EACH_2D(ni, nj)
+    {
+        double xc = patch_xl + (i + 0.5) * dx;
+        double yc = patch_yl + (j + 0.5) * dy;
+        double rc = sqrt(xc * xc + yc * yc);
+        int bin = (int) floor((rc - inner_radius) / dr);
+
+        if (rc >= inner_radius && bin < num_bins)
+        {
+            double *pc = &primitive[(i + ng) * si + (j + ng) * sj];
+            double *prof = &profiles[(i * num_bins + bin) * np];
+            double sigma = pc[0];
+            double cos_phi = rc > 0.0 ? xc / rc : 1.0;
+            double sin_phi = rc > 0.0 ? yc / rc : 0.0;
+            double vr = pc[1] * cos_phi + pc[2] * sin_phi;
+            double torque = 0.0;
+
+            for (int p = 0; p < 2; ++p)
+            {
+                double delta_grav[NCONS];
+                double delta_sink[NCONS];
+                point_mass_source_term_parts(&mass_list.masses[p], xc, yc, 1.0, pc, delta_grav, delta_sink);
+                torque += xc * delta_grav[2] - yc * delta_grav[1];
+            }
+
+            ACCUMULATE(prof[0], 1.0);
+            ACCUMULATE(prof[1], sigma);
+            ACCUMULATE(prof[2], sigma * vr * (xc * pc[2] - yc * pc[1]));
+            ACCUMULATE(prof[3], torque);
+
+            // cos(m phi) and sin(m phi) by the angle addition recurrence
+            double cm = 1.0;
+            double sm = 0.0;
+
+            for (int m = 0; m <= num_modes; ++m)
+            {
+                ACCUMULATE(prof[4 + 2 * m + 0], sigma * cm);
+                ACCUMULATE(prof[4 + 2 * m + 1], sigma * sm);
+                double c = cm * cos_phi - sm * sin_phi;
+                double s = sm * cos_phi + cm * sin_phi;
+                cm = c;
+                sm = s;
+            }
+        }
+    }
+}
+
 PUBLIC void cbdiso_2d_point_mass_source_term(
     int ni,
     int nj,
@@ -639,12 +1359,12 @@ PUBLIC void cbdiso_2d_point_mass_source_term(
     double sink_rate1,
     double sink_radius1,
     int sink_model1,
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 3)
-    double *cons_rate) // :: $.shape == (ni + 4, nj + 4, 3)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *cons_rate) // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
 {
     struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
 
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
 
@@ -691,14 +1411,14 @@ PUBLIC void cbdiso_2d_wavespeed(
     double sink_rate2,
     double sink_radius2,
     int sink_model2,
-    double *primitive, // :: $.shape == (ni + 4, nj + 4, 3)
-    double *wavespeed) // :: $.shape == (ni + 4, nj + 4)
+    double *primitive, // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD, 3)
+    double *wavespeed) // :: $.shape == (ni + 2 * NUM_GUARD, nj + 2 * NUM_GUARD)
 {
     struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
     struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
     struct PointMassList mass_list = {{m1, m2}};
 
-    int ng = 2; // number of guard zones
+    int ng = NUM_GUARD; // number of guard zones
     int si = NCONS * (nj + 2 * ng);
     int sj = NCONS;
     int ti = nj + 2 * ng;
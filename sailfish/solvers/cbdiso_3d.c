@@ -0,0 +1,642 @@
+/*
+MODULE: cbdiso_3d
+
+DESCRIPTION: Isothermal solver for a binary accretion problem in 3D planar
+  cartesian coordinates. The point masses orbit in the z = 0 plane.
+*/
+
+// ============================ PHYSICS =======================================
+// ============================================================================
+#define NCONS 4
+#define PLM_THETA 1.8
+#define NUM_ACCUMULATORS 24 // 2 masses x (gravity, accretion) x 6 quantities
+#define NUM_FLOOR_COUNTERS 2 // density floor, velocity ceiling
+#define DENSITY_FLOOR_ACTIVE (1 << 0)
+#define VELOCITY_CEILING_ACTIVE (1 << 1)
+
+
+// ============================ MATH ==========================================
+// ============================================================================
+#define min2(a, b) ((a) < (b) ? (a) : (b))
+#define max2(a, b) ((a) > (b) ? (a) : (b))
+#define min3(a, b, c) min2(a, min2(b, c))
+#define max3(a, b, c) max2(a, max2(b, c))
+#define sign(x) copysign(1.0, x)
+#define minabs(a, b, c) min3(fabs(a), fabs(b), fabs(c))
+
+#if (EXEC_MODE == EXEC_GPU)
+#define ACCUMULATE(x, y) atomicAdd(&(x), y)
+#else
+#define ACCUMULATE(x, y) (x) += (y)
+#endif
+
+// Increment the counter of each floor or ceiling flagged in a bitmask returned
+// by conserved_to_primitive.
+PRIVATE void count_floors(int flags, double *counters)
+{
+    for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+    {
+        if (flags & (1 << n))
+        {
+            ACCUMULATE(counters[n], 1.0);
+        }
+    }
+}
+
+PRIVATE double plm_gradient_scalar(double yl, double y0, double yr)
+{
+    double a = (y0 - yl) * PLM_THETA;
+    double b = (yr - yl) * 0.5;
+    double c = (yr - y0) * PLM_THETA;
+    return 0.25 * fabs(sign(a) + sign(b)) * (sign(a) + sign(c)) * minabs(a, b, c);
+}
+
+PRIVATE void plm_gradient(double *yl, double *y0, double *yr, double *g)
+{
+    for (int q = 0; q < NCONS; ++q)
+    {
+        g[q] = plm_gradient_scalar(yl[q], y0[q], yr[q]);
+    }
+}
+
+
+// ============================ INTERNAL STRUCTS ==============================
+// ============================================================================
+struct PointMass {
+    double x;
+    double y;
+    double vx;
+    double vy;
+    double mass;
+    double softening_length;
+    double sink_rate;
+    double sink_radius;
+    int sink_model;
+};
+
+struct PointMassList {
+    struct PointMass masses[2];
+};
+
+
+// ============================ GRAVITY =======================================
+// ============================================================================
+PRIVATE double gravitational_potential(
+    struct PointMassList *mass_list,
+    double x1,
+    double y1,
+    double z1)
+{
+    double phi = 0.0;
+
+    for (int p = 0; p < 2; ++p)
+    {
+        if (mass_list->masses[p].mass > 0.0)
+        {
+            double x0 = mass_list->masses[p].x;
+            double y0 = mass_list->masses[p].y;
+            double mp = mass_list->masses[p].mass;
+            double rs = mass_list->masses[p].softening_length;
+
+            double dx = x1 - x0;
+            double dy = y1 - y0;
+            double r2 = dx * dx + dy * dy + z1 * z1;
+            double r2_softened = r2 + rs * rs;
+
+            phi -= mp / sqrt(r2_softened);
+        }
+    }
+    return phi;
+}
+
+PRIVATE void point_mass_source_term_parts(
+    struct PointMass *mass,
+    double x1,
+    double y1,
+    double z1,
+    double dt,
+    double *prim,
+    double *delta_grav,
+    double *delta_sink)
+{
+    double x0 = mass->x;
+    double y0 = mass->y;
+    double rho = prim[0];
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    double dz = z1;
+    double r2 = dx * dx + dy * dy + dz * dz;
+    double dr = sqrt(r2);
+    double r_sink = mass->sink_radius;
+    double r_soft = mass->softening_length;
+
+    double fgrav_numerator = rho * mass->mass * pow(r2 + r_soft * r_soft, -1.5);
+    double fx = -fgrav_numerator * dx;
+    double fy = -fgrav_numerator * dy;
+    double fz = -fgrav_numerator * dz;
+    double sink_rate = (dr < 4.0 * r_sink) ? mass->sink_rate * exp(-pow(dr / r_sink, 4.0)) : 0.0;
+    double mdot = 0.0;
+
+    if (sink_rate > 0.0)
+    {
+        mdot = -sink_rate * rho;
+    }
+    else if (sink_rate < 0.0)
+    {
+        mdot = -sink_rate; // add constant M-dot for uniform sink.
+    }
+
+    // gravitational force
+    delta_grav[0] = 0.0;
+    delta_grav[1] = fx * dt;
+    delta_grav[2] = fy * dt;
+    delta_grav[3] = fz * dt;
+
+    switch (mass->sink_model)
+    {
+        case 1: // acceleration-free
+        {
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * prim[1];
+            delta_sink[2] = dt * mdot * prim[2];
+            delta_sink[3] = dt * mdot * prim[3];
+            break;
+        }
+        case 2: // torque-free
+        {
+            double vx = prim[1];
+            double vy = prim[2];
+            double vz = prim[3];
+            double vx0 = mass->vx;
+            double vy0 = mass->vy;
+            double rhatx = dx / (dr + 1e-12);
+            double rhaty = dy / (dr + 1e-12);
+            double rhatz = dz / (dr + 1e-12);
+            double dvdotrhat = (vx - vx0) * rhatx + (vy - vy0) * rhaty + vz * rhatz;
+            double vxstar = dvdotrhat * rhatx + vx0;
+            double vystar = dvdotrhat * rhaty + vy0;
+            double vzstar = dvdotrhat * rhatz;
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * vxstar;
+            delta_sink[2] = dt * mdot * vystar;
+            delta_sink[3] = dt * mdot * vzstar;
+            break;
+        }
+        case 3: // force-free
+        {
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
+            delta_sink[3] = 0.0;
+            break;
+        }
+        default: // sink is inactive
+        {
+            delta_sink[0] = 0.0;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
+            delta_sink[3] = 0.0;
+            break;
+        }
+    }
+}
+
+// Add one point mass's source terms at a zone, times a weight, to a column of
+// time-integrated accumulators. The quantities are the same as in cbdiso_2d,
+// with the addition of the z-force: mdot, fx, fy, fz, torque (z-component,
+// about the origin), and power. The layout is [mass][term][quantity].
+PRIVATE void accumulate_point_mass_source_term(
+    struct PointMass *mass,
+    int p,
+    double x1,
+    double y1,
+    double weight,
+    double *delta_grav,
+    double *delta_sink,
+    double *accumulators)
+{
+    for (int t = 0; t < 2; ++t)
+    {
+        double *delta = t == 0 ? delta_grav : delta_sink;
+        double *acc = &accumulators[(2 * p + t) * 6];
+        ACCUMULATE(acc[0], weight * delta[0]);
+        ACCUMULATE(acc[1], weight * delta[1]);
+        ACCUMULATE(acc[2], weight * delta[2]);
+        ACCUMULATE(acc[3], weight * delta[3]);
+        ACCUMULATE(acc[4], weight * (x1 * delta[2] - y1 * delta[1]));
+        ACCUMULATE(acc[5], weight * (mass->vx * delta[1] + mass->vy * delta[2]));
+    }
+}
+
+
+// ============================ EOS ===========================================
+// ============================================================================
+// In locally isothermal mode the sound speed is set from the potential in the
+// mid-plane, so it is uniform on vertical columns (a vertically isothermal
+// disk, with scale height H = r / mach).
+PRIVATE double sound_speed_squared(
+    double cs2,
+    double mach_squared,
+    int eos_type,
+    double x,
+    double y,
+    struct PointMassList *mass_list)
+{
+    switch (eos_type)
+    {
+        case 1: // globally isothermal
+            return cs2;
+        case 2: // locally Isothermal
+            return -gravitational_potential(mass_list, x, y, 0.0) / mach_squared;
+        default:
+            return 1.0; // WARNING
+    }
+}
+
+
+// ============================ HYDRO =========================================
+// ============================================================================
+// Returns a bitmask of the floors and ceilings which were applied.
+PRIVATE int conserved_to_primitive(
+    const double *cons,
+    double *prim,
+    double velocity_ceiling,
+    double density_floor)
+{
+    double rho = max2(cons[0], density_floor);
+    double px = cons[1];
+    double py = cons[2];
+    double pz = cons[3];
+    double vx = sign(px) * min2(fabs(px / rho), velocity_ceiling);
+    double vy = sign(py) * min2(fabs(py / rho), velocity_ceiling);
+    double vz = sign(pz) * min2(fabs(pz / rho), velocity_ceiling);
+
+    prim[0] = rho;
+    prim[1] = vx;
+    prim[2] = vy;
+    prim[3] = vz;
+
+    return (cons[0] < density_floor) * DENSITY_FLOOR_ACTIVE
+        + (fabs(px / rho) > velocity_ceiling || fabs(py / rho) > velocity_ceiling || fabs(pz / rho) > velocity_ceiling) * VELOCITY_CEILING_ACTIVE;
+}
+
+PRIVATE void primitive_to_conserved(
+    const double *prim,
+    double *cons)
+{
+    double rho = prim[0];
+
+    cons[0] = rho;
+    cons[1] = rho * prim[1];
+    cons[2] = rho * prim[2];
+    cons[3] = rho * prim[3];
+}
+
+PRIVATE void primitive_to_flux(
+    const double *prim,
+    const double *cons,
+    double *flux,
+    double cs2,
+    int direction)
+{
+    double vn = prim[direction + 1];
+    double pressure = prim[0] * cs2;
+
+    flux[0] = vn * cons[0];
+    flux[1] = vn * cons[1] + pressure * (direction == 0);
+    flux[2] = vn * cons[2] + pressure * (direction == 1);
+    flux[3] = vn * cons[3] + pressure * (direction == 2);
+}
+
+PRIVATE double primitive_max_wavespeed(
+    const double *prim,
+    double cs2)
+{
+    double cs = sqrt(cs2);
+    double ax = fabs(prim[1]) + cs;
+    double ay = fabs(prim[2]) + cs;
+    double az = fabs(prim[3]) + cs;
+    return max3(ax, ay, az);
+}
+
+PRIVATE void riemann_hlle(
+    const double *pl,
+    const double *pr,
+    double *flux,
+    double cs2,
+    int direction)
+{
+    double ul[NCONS];
+    double ur[NCONS];
+    double fl[NCONS];
+    double fr[NCONS];
+    double cs = sqrt(cs2);
+
+    primitive_to_conserved(pl, ul);
+    primitive_to_conserved(pr, ur);
+    primitive_to_flux(pl, ul, fl, cs2, direction);
+    primitive_to_flux(pr, ur, fr, cs2, direction);
+
+    const double am = min3(0.0, pl[direction + 1] - cs, pr[direction + 1] - cs);
+    const double ap = max3(0.0, pl[direction + 1] + cs, pr[direction + 1] + cs);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        flux[q] = (fl[q] * ap - fr[q] * am - (ul[q] - ur[q]) * ap * am) / (ap - am);
+    }
+}
+
+// Add the flux difference along one axis to delta_cons. The pointer pcc is to
+// the primitive data at the zone being updated, and s is the stride to the
+// next zone along the axis. The face sound speeds are cs2l and cs2r.
+PRIVATE void add_flux_difference(
+    double *pcc,
+    int s,
+    int direction,
+    double cs2l,
+    double cs2r,
+    double dt_over_dx,
+    double *delta_cons)
+{
+    double *pki = &pcc[-2 * s];
+    double *pli = &pcc[-1 * s];
+    double *pri = &pcc[+1 * s];
+    double *pti = &pcc[+2 * s];
+
+    double gli[NCONS];
+    double gcc[NCONS];
+    double gri[NCONS];
+    double plim[NCONS];
+    double plip[NCONS];
+    double prim[NCONS];
+    double prip[NCONS];
+    double fli[NCONS];
+    double fri[NCONS];
+
+    plm_gradient(pki, pli, pcc, gli);
+    plm_gradient(pli, pcc, pri, gcc);
+    plm_gradient(pcc, pri, pti, gri);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        plim[q] = pli[q] + 0.5 * gli[q];
+        plip[q] = pcc[q] - 0.5 * gcc[q];
+        prim[q] = pcc[q] + 0.5 * gcc[q];
+        prip[q] = pri[q] - 0.5 * gri[q];
+    }
+
+    riemann_hlle(plim, plip, fli, cs2l, direction);
+    riemann_hlle(prim, prip, fri, cs2r, direction);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        delta_cons[q] -= (fri[q] - fli[q]) * dt_over_dx;
+    }
+}
+
+PRIVATE void advance_rk_zone(
+    struct PointMassList *mass_list,
+    double patch_xl,
+    double patch_yl,
+    double patch_zl,
+    double dx,
+    double dy,
+    double dz,
+    int i,
+    int j,
+    int k,
+    int si,
+    int sj,
+    int sk,
+    double *un, // conserved RK-base data at zone (i, j, k)
+    double *pcc, // primitive data at zone (i, j, k)
+    double *pout, // updated primitive data at zone (i, j, k)
+    double *acc, // time-integrated accumulators for column (i, j)
+    double *floors, // floor and ceiling counters for column (i, j)
+    double cs2,
+    double mach_squared,
+    int eos_type,
+    double a,
+    double dt,
+    double accumulator_weight,
+    double velocity_ceiling,
+    double density_floor)
+{
+    double xl = patch_xl + (i + 0.0) * dx;
+    double xc = patch_xl + (i + 0.5) * dx;
+    double xr = patch_xl + (i + 1.0) * dx;
+    double yl = patch_yl + (j + 0.0) * dy;
+    double yc = patch_yl + (j + 0.5) * dy;
+    double yr = patch_yl + (j + 1.0) * dy;
+    double zc = patch_zl + (k + 0.5) * dz;
+
+    // The sound speed is uniform along z, so the z-faces use the zone value.
+    double cs2li = sound_speed_squared(cs2, mach_squared, eos_type, xl, yc, mass_list);
+    double cs2ri = sound_speed_squared(cs2, mach_squared, eos_type, xr, yc, mass_list);
+    double cs2lj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yl, mass_list);
+    double cs2rj = sound_speed_squared(cs2, mach_squared, eos_type, xc, yr, mass_list);
+    double cs2cc = sound_speed_squared(cs2, mach_squared, eos_type, xc, yc, mass_list);
+
+    double delta_cons[NCONS] = {0.0, 0.0, 0.0, 0.0};
+    double ucc[NCONS];
+
+    add_flux_difference(pcc, si, 0, cs2li, cs2ri, dt / dx, delta_cons);
+    add_flux_difference(pcc, sj, 1, cs2lj, cs2rj, dt / dy, delta_cons);
+    add_flux_difference(pcc, sk, 2, cs2cc, cs2cc, dt / dz, delta_cons);
+
+    for (int p = 0; p < 2; ++p)
+    {
+        double delta_grav[NCONS];
+        double delta_sink[NCONS];
+        struct PointMass *mass = &mass_list->masses[p];
+
+        point_mass_source_term_parts(mass, xc, yc, zc, dt, pcc, delta_grav, delta_sink);
+        accumulate_point_mass_source_term(mass, p, xc, yc, accumulator_weight, delta_grav, delta_sink, acc);
+
+        for (int q = 0; q < NCONS; ++q)
+        {
+            delta_cons[q] += delta_grav[q];
+            delta_cons[q] += delta_sink[q];
+        }
+    }
+
+    primitive_to_conserved(pcc, ucc);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        ucc[q] += delta_cons[q];
+        ucc[q] = (1.0 - a) * ucc[q] + a * un[q];
+    }
+    count_floors(conserved_to_primitive(ucc, pout, velocity_ceiling, density_floor), floors);
+}
+
+
+// ============================ PUBLIC API ====================================
+// ============================================================================
+PUBLIC void cbdiso_3d_advance_rk(
+    int ni,
+    int nj,
+    int nk,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double patch_zl,
+    double patch_zr,
+    double *conserved_rk, // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+    double *primitive_rd, // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+    double *primitive_wr, // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+    double *accumulators, // :: $.shape == (ni, nj, 2, 2, 6)
+    double *floor_counters, // :: $.shape == (ni, nj, 2)
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double cs2, // equation of state
+    double mach_squared,
+    int eos_type,
+    double a, // RK parameter
+    double dt, // timestep
+    double accumulator_weight, // weight of this RK stage in the time integral
+    double velocity_ceiling,
+    double density_floor)
+{
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
+
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+    double dz = (patch_zr - patch_zl) / nk;
+
+    int ng = 2; // number of guard zones
+    int si = NCONS * (nj + 2 * ng) * (nk + 2 * ng);
+    int sj = NCONS * (nk + 2 * ng);
+    int sk = NCONS;
+
+    FOR_EACH_3D(ni, nj, nk)
+    {
+        int ncc = (i + ng) * si + (j + ng) * sj + (k + ng) * sk;
+
+        advance_rk_zone(
+            &mass_list,
+            patch_xl,
+            patch_yl,
+            patch_zl,
+            dx,
+            dy,
+            dz,
+            i,
+            j,
+            k,
+            si,
+            sj,
+            sk,
+            &conserved_rk[ncc],
+            &primitive_rd[ncc],
+            &primitive_wr[ncc],
+            &accumulators[(i * nj + j) * NUM_ACCUMULATORS],
+            &floor_counters[(i * nj + j) * NUM_FLOOR_COUNTERS],
+            cs2,
+            mach_squared,
+            eos_type,
+            a,
+            dt,
+            accumulator_weight,
+            velocity_ceiling,
+            density_floor);
+    }
+}
+
+PUBLIC void cbdiso_3d_primitive_to_conserved(
+    int ni,
+    int nj,
+    int nk,
+    double *primitive, // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+    double *conserved) // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+{
+    int ng = 2; // number of guard zones
+    int si = NCONS * (nj + 2 * ng) * (nk + 2 * ng);
+    int sj = NCONS * (nk + 2 * ng);
+    int sk = NCONS;
+
+    FOR_EACH_3D(ni, nj, nk)
+    {
+        int n = (i + ng) * si + (j + ng) * sj + (k + ng) * sk;
+
+        double *pc = &primitive[n];
+        double *uc = &conserved[n];
+        primitive_to_conserved(pc, uc);
+    }
+}
+
+PUBLIC void cbdiso_3d_wavespeed(
+    int ni, // mesh
+    int nj,
+    int nk,
+    double patch_xl,
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double soundspeed2, // equation of state
+    double mach_squared,
+    int eos_type,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double *primitive, // :: $.shape == (ni + 4, nj + 4, nk + 4, 4)
+    double *wavespeed) // :: $.shape == (ni, nj, nk)
+{
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
+
+    int ng = 2; // number of guard zones
+    int si = NCONS * (nj + 2 * ng) * (nk + 2 * ng);
+    int sj = NCONS * (nk + 2 * ng);
+    int sk = NCONS;
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
+
+    FOR_EACH_3D(ni, nj, nk)
+    {
+        int np = (i + ng) * si + (j + ng) * sj + (k + ng) * sk;
+        int na = (i * nj + j) * nk + k;
+
+        double x = patch_xl + (i + 0.5) * dx;
+        double y = patch_yl + (j + 0.5) * dy;
+
+        double *pc = &primitive[np];
+        double cs2 = sound_speed_squared(soundspeed2, mach_squared, eos_type, x, y, &mass_list);
+        wavespeed[na] = primitive_max_wavespeed(pc, cs2);
+    }
+}
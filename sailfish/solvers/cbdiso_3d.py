@@ -0,0 +1,565 @@
+"""
+Isothermal solver for the binary accretion problem in 3D planar coordinates.
+
+The mesh is decomposed into a uniform level of a `Node8` tree: with `8^L`
+patches, each axis is split into `2^L` blocks, and the patches are stored
+(and updated) in the tree's pre-order, which is a Morton order of the blocks.
+Guard zones are exchanged through the six faces of each block. Within a
+patch, the kernels traverse the zones in tiles of `tile_size` columns along
+the contiguous z-axis (see `FOR_EACH_3D` in the kernel library), and in omp
+mode the tiles are distributed over threads.
+"""
+
+from logging import getLogger
+from typing import NamedTuple
+from sailfish.grid.node import Node8, CartesianMesh, geo_to_top
+from sailfish.kernel.allocate import Allocator
+from sailfish.kernel.library import Library
+from sailfish.kernel.system import get_array_module, execution_context, num_devices
+from sailfish.mesh import PlanarCartesian3DMesh
+from sailfish.physics.circumbinary import (
+    Physics,
+    EquationOfState,
+    ViscosityModel,
+    Diagnostic,
+)
+from sailfish.solver_base import SolverBase
+from sailfish.subdivide import to_host, lazy_reduce
+
+
+logger = getLogger(__name__)
+
+# Point mass source term diagnostics which are time-integrated by the advance
+# kernel, in the order of the last axis of the patch accumulator arrays.
+ACCUMULATED_QUANTITIES = ("mdot", "fx", "fy", "fz", "torque", "power")
+
+# Floors and ceilings applied by the advance kernel, in the order of the last
+# axis of the patch floor counter arrays.
+FLOOR_COUNTERS = ("density_floor", "velocity_ceiling")
+
+
+class Options(NamedTuple):
+    """
+    Contains parameters which are solver specific options.
+    """
+
+    velocity_ceiling: float = 1e12
+    density_floor: float = 1e-12
+    rk_order: int = 2
+    tile_size: int = 8
+    huge_pages: bool = False
+
+
+def initial_condition(setup, mesh, time):
+    """
+    Generate a 3D array of primitive data from a mesh and a setup.
+    """
+    import numpy as np
+
+    ni, nj, nk = mesh.shape
+    primitive = np.zeros([ni, nj, nk, 4])
+
+    for i in range(ni):
+        for j in range(nj):
+            for k in range(nk):
+                coords = mesh.cell_coordinates(i, j, k)
+                setup.primitive(time, coords, primitive[i, j, k])
+
+    return primitive
+
+
+def block_level(num_patches):
+    """
+    Return the level L of a uniform oct-tree with the given number of leaf
+    blocks, which must be 8^L.
+    """
+    level = 0
+
+    while 8**level < num_patches:
+        level += 1
+
+    if 8**level != num_patches:
+        raise ValueError("solver requires num_patches to be a power of 8")
+
+    return level
+
+
+class Patch:
+    """
+    Holds the array buffer state for the solution on one block of the
+    solution domain.
+    """
+
+    def __init__(
+        self,
+        time,
+        primitive,
+        index,
+        extent,
+        physics,
+        options,
+        lib,
+        xp,
+        execution_context,
+    ):
+        (self.xl, self.xr), (self.yl, self.yr), (self.zl, self.zr) = extent
+        ni, nj, nk = (n - 4 for n in primitive.shape[:3])
+        self.index = index
+        self.lib = lib
+        self.xp = xp
+        self.execution_context = execution_context
+        self.time = self.time0 = time
+        self.shape = (ni, nj, nk)  # not including guard zones
+        self.physics = physics
+        self.options = options
+
+        alloc = Allocator(xp, huge_pages=options.huge_pages)
+
+        with self.execution_context:
+            self.wavespeeds = alloc.zeros(self.shape)
+            self.primitive1 = alloc.array(primitive)
+            self.primitive2 = alloc.array(primitive)
+            self.conserved0 = alloc.zeros(primitive.shape)
+            self.accumulators = alloc.zeros((ni, nj, 2, 2, len(ACCUMULATED_QUANTITIES)))
+            self.floor_counters = alloc.zeros((ni, nj, len(FLOOR_COUNTERS)))
+
+    def point_mass_args(self):
+        m1, m2 = self.physics.point_masses(self.time)
+        return (
+            m1.position_x,
+            m1.position_y,
+            m1.velocity_x,
+            m1.velocity_y,
+            m1.mass,
+            m1.softening_length,
+            m1.sink_rate,
+            m1.sink_radius,
+            m1.sink_model.value,
+            m2.position_x,
+            m2.position_y,
+            m2.velocity_x,
+            m2.velocity_y,
+            m2.mass,
+            m2.softening_length,
+            m2.sink_rate,
+            m2.sink_radius,
+            m2.sink_model.value,
+        )
+
+    def maximum_wavespeed(self):
+        """
+        Return the maximum wavespeed over a given patch.
+        """
+        with self.execution_context:
+            self.lib.cbdiso_3d_wavespeed[self.shape](
+                self.xl,
+                self.xr,
+                self.yl,
+                self.yr,
+                self.physics.sound_speed**2,
+                self.physics.mach_number**2,
+                self.physics.eos_type.value,
+                *self.point_mass_args(),
+                self.primitive1,
+                self.wavespeeds,
+            )
+            return self.wavespeeds.max()
+
+    def recompute_conserved(self):
+        """
+        Convert the most recent primitive array to conserved.
+        """
+        with self.execution_context:
+            return self.lib.cbdiso_3d_primitive_to_conserved[self.shape](
+                self.primitive1,
+                self.conserved0,
+            )
+
+    def advance_rk(self, rk_param, dt, weight):
+        """
+        Update the primitive data by one Runge-Kutta stage, writing it to
+        primitive2, and swap the two arrays. The point mass source terms of
+        this stage are added, times the given weight, to the accumulators.
+        """
+        with self.execution_context:
+            self.lib.cbdiso_3d_advance_rk[self.shape](
+                self.xl,
+                self.xr,
+                self.yl,
+                self.yr,
+                self.zl,
+                self.zr,
+                self.conserved0,
+                self.primitive1,
+                self.primitive2,
+                self.accumulators,
+                self.floor_counters,
+                *self.point_mass_args(),
+                self.physics.sound_speed**2,
+                self.physics.mach_number**2,
+                self.physics.eos_type.value,
+                rk_param,
+                dt,
+                weight,
+                self.options.velocity_ceiling,
+                self.options.density_floor,
+            )
+        self.primitive1, self.primitive2 = self.primitive2, self.primitive1
+        self.time = self.time0 * rk_param + (self.time + dt) * (1.0 - rk_param)
+
+    def new_iteration(self):
+        self.time0 = self.time
+        self.recompute_conserved()
+
+    @property
+    def primitive(self):
+        return self.primitive1
+
+
+class Solver(SolverBase):
+    """
+    Adapter class to drive the cbdiso_3d C extension module.
+    """
+
+    def __init__(
+        self,
+        setup=None,
+        mesh=None,
+        time=0.0,
+        solution=None,
+        num_patches=1,
+        mode="cpu",
+        physics=dict(),
+        options=dict(),
+    ):
+        import numpy as np
+
+        physics["diagnostics"] = [
+            Diagnostic(**v) for v in physics.get("diagnostics", [])
+        ]
+
+        self._physics = physics = Physics(**physics)
+        self._options = options = Options(**options)
+
+        if type(mesh) is not PlanarCartesian3DMesh:
+            raise ValueError("solver only supports 3D cartesian mesh")
+
+        if setup.boundary_condition != "outflow":
+            raise ValueError("solver only supports outflow boundary condition")
+
+        if physics.viscosity_model != ViscosityModel.NONE:
+            raise ValueError("solver does not support viscosity")
+
+        if physics.eos_type not in (
+            EquationOfState.GLOBALLY_ISOTHERMAL,
+            EquationOfState.LOCALLY_ISOTHERMAL,
+        ):
+            raise ValueError("solver only supports isothermal equation of states")
+
+        if physics.buffer_is_enabled:
+            raise ValueError("solver does not support the buffer zone")
+
+        if physics.cooling_coefficient != 0.0:
+            raise ValueError("solver does not support thermal cooling")
+
+        if physics.probes:
+            raise ValueError("solver does not support probes")
+
+        for d in physics.diagnostics:
+            if d.quantity not in ("time", "mass") + ACCUMULATED_QUANTITIES:
+                raise ValueError(f"solver does not support diagnostic {d.quantity}")
+            if d.quantity in ACCUMULATED_QUANTITIES and d.radial_cut is not None:
+                raise ValueError(
+                    f"solver does not support a radial cut on {d.quantity}"
+                )
+
+        if options.tile_size < 1:
+            raise ValueError("tile_size must be a positive integer")
+
+        level = block_level(num_patches)
+        blocks = 1 << level
+
+        xp = get_array_module(mode)
+        ng = 2  # number of guard zones
+
+        if any(n % blocks or n // blocks < ng for n in mesh.shape):
+            raise ValueError(
+                f"mesh shape {mesh.shape} is not divisible into {blocks} blocks "
+                f"per axis of at least {ng} zones"
+            )
+
+        nq = 4  # number of conserved quantities
+        with open(__file__.replace(".py", ".c")) as f:
+            code = f.read()
+        lib = Library(
+            code,
+            mode=mode,
+            debug=False,
+            define_macros=dict(TILE_SIZE_3D=options.tile_size),
+        )
+
+        logger.info(f"initiate with time={time:0.4f}")
+        logger.info(f"subdivide grid over {num_patches} patches ({blocks}^3 blocks)")
+        logger.info(f"mesh is {mesh}")
+        logger.info(f"boundary condition is outflow")
+
+        if solution is None:
+            primitive = initial_condition(setup, mesh, time)
+        else:
+            primitive = solution
+
+        self.mesh = mesh
+        self.setup = setup
+        self.num_guard = ng
+        self.num_cons = nq
+        self.xp = xp
+        self.level = level
+        self.block_shape = tuple(n // blocks for n in mesh.shape)
+        self.tree = Node8()
+
+        block_mesh = CartesianMesh(
+            self.block_shape,
+            extent=((mesh.x0, mesh.x1), (mesh.y0, mesh.y1), (mesh.z0, mesh.z1)),
+        )
+        bi, bj, bk = self.block_shape
+
+        for n, index in enumerate(np.ndindex(blocks, blocks, blocks)):
+            i, j, k = index
+            prim = np.zeros([bi + 2 * ng, bj + 2 * ng, bk + 2 * ng, nq])
+            prim[ng:-ng, ng:-ng, ng:-ng] = primitive[
+                i * bi : (i + 1) * bi,
+                j * bj : (j + 1) * bj,
+                k * bk : (k + 1) * bk,
+            ]
+            self.tree.require(geo_to_top(level, index, astuple=True)).value = Patch(
+                time,
+                prim,
+                index,
+                block_mesh.patch_extent(index, level),
+                physics,
+                options,
+                lib,
+                xp,
+                execution_context(mode, device_id=n % num_devices(mode)),
+            )
+
+        self.patches = [p for p in self.tree.values() if p is not None]
+        self.accumulator_start_time = time
+
+    def block(self, index):
+        """
+        Return the patch at the given block index, or None if the index is
+        outside the domain.
+        """
+        blocks = 1 << self.level
+
+        if any(n < 0 or n >= blocks for n in index):
+            return None
+
+        return self.tree.at(geo_to_top(self.level, index)).value
+
+    @property
+    def solution(self):
+        import numpy as np
+
+        ng = self.num_guard
+        bi, bj, bk = self.block_shape
+        result = np.zeros(self.mesh.shape + (self.num_cons,))
+
+        for patch in self.patches:
+            i, j, k = patch.index
+            result[
+                i * bi : (i + 1) * bi,
+                j * bj : (j + 1) * bj,
+                k * bk : (k + 1) * bk,
+            ] = to_host(patch.primitive[ng:-ng, ng:-ng, ng:-ng])
+
+        return result
+
+    @property
+    def primitive(self):
+        """
+        This solver uses primitive data as the solution array.
+        """
+        return None
+
+    def reductions(self):
+        """
+        Generate runtime reductions on the solution data for time series.
+
+        Point mass source term diagnostics are averaged over the time since
+        the previous call, from the accumulators updated by the advance
+        kernel, and the accumulators are then reset. They are zero if no time
+        has elapsed. The mass may have a cut on the cylindrical radius.
+        """
+        ng = self.num_guard
+        dv = self.mesh.dx * self.mesh.dy * self.mesh.dz
+        elapsed = self.time - self.accumulator_start_time
+        result = []
+
+        for d in self._physics.diagnostics:
+            if d.quantity == "time":
+                result.append(self.time / self.setup.reference_time_scale)
+
+            elif d.quantity == "mass":
+                total = 0.0
+
+                for p in self.patches:
+                    with p.execution_context:
+                        rho = p.primitive[ng:-ng, ng:-ng, ng:-ng, 0]
+
+                        if d.radial_cut is not None:
+                            xp = p.xp
+                            ni, nj, _ = p.shape
+                            x = xp.linspace(p.xl, p.xr, 2 * ni + 1)[1::2, None, None]
+                            y = xp.linspace(p.yl, p.yr, 2 * nj + 1)[None, 1::2, None]
+                            r = (x**2 + y**2) ** 0.5
+                            r0, r1 = d.radial_cut
+                            rho = rho * (r0 < r) * (r < r1)
+
+                        total += float(to_host(rho.sum()))
+
+                result.append(total * dv)
+
+            elif elapsed > 0.0:
+                masses = [1, 2] if d.which_mass == "both" else [d.which_mass]
+                term = 1 if d.accretion else 0
+                q = ACCUMULATED_QUANTITIES.index(d.quantity)
+
+                if d.quantity == "power" and d.which_mass == "both":
+                    raise ValueError("Mass option for 'power' must be 1 or 2.")
+
+                total = 0.0
+
+                for p in self.patches:
+                    with p.execution_context:
+                        f = sum(p.accumulators[..., m - 1, term, q] for m in masses)
+                        total += float(to_host(f.sum()))
+
+                result.append(total * dv / elapsed)
+
+            else:
+                result.append(0.0)
+
+        self.reset_accumulators()
+        return result
+
+    def reset_accumulators(self):
+        """
+        Zero the time-integrated point mass source terms on each patch.
+        """
+        for patch in self.patches:
+            with patch.execution_context:
+                patch.accumulators[...] = 0.0
+
+        self.accumulator_start_time = self.time
+
+    def floor_counts(self):
+        """
+        Return the number of zone updates, since the previous call, in which
+        each floor or ceiling was applied, and reset the counters.
+        """
+        counts = [0] * len(FLOOR_COUNTERS)
+
+        for patch in self.patches:
+            with patch.execution_context:
+                f = to_host(patch.floor_counters.sum(axis=(0, 1)))
+                counts = [c + int(n) for c, n in zip(counts, f)]
+                patch.floor_counters[...] = 0.0
+
+        return dict(zip(FLOOR_COUNTERS, counts))
+
+    @property
+    def time(self):
+        return self.patches[0].time
+
+    @property
+    def options(self):
+        return self._options._asdict()
+
+    @property
+    def physics(self):
+        return self._physics._asdict()
+
+    @property
+    def recommended_cfl(self):
+        return 0.3
+
+    @property
+    def maximum_cfl(self):
+        return 0.3
+
+    def maximum_wavespeed(self):
+        """
+        Return the global maximum wavespeed over the whole domain.
+        """
+        return lazy_reduce(
+            max,
+            float,
+            (patch.maximum_wavespeed for patch in self.patches),
+            (patch.execution_context for patch in self.patches),
+        )
+
+    def advance(self, dt):
+        self.new_iteration()
+        if self._options.rk_order == 1:
+            self.advance_rk(0.0, dt, 1.0)
+        elif self._options.rk_order == 2:
+            self.advance_rk(0.0, dt, 0.5)
+            self.advance_rk(0.5, dt, 0.5)
+        elif self._options.rk_order == 3:
+            self.advance_rk(0.0, dt, 1.0 / 6.0)
+            self.advance_rk(0.75, dt, 1.0 / 6.0)
+            self.advance_rk(1.0 / 3.0, dt, 2.0 / 3.0)
+
+    def advance_rk(self, rk_param, dt, weight):
+        self.set_bc()
+        for patch in self.patches:
+            patch.advance_rk(rk_param, dt, weight)
+
+    def set_bc(self):
+        """
+        Fill the guard zones of each patch's primitive array, through each of
+        its six faces: from the neighboring block if there is one, and with
+        an outflow condition on the domain boundary. On the z faces the
+        outflow condition is a diode: the vertical velocity in the guard zones
+        is zeroed where it would point into the domain, so gas above the disk
+        cannot be fed back in. The edge and corner guard zones are not used by
+        the stencil, and are not filled.
+        """
+        for patch in self.patches:
+            for axis in range(3):
+                for side in (-1, 1):
+                    index = list(patch.index)
+                    index[axis] += side
+                    self.set_bc_face(patch, self.block(tuple(index)), axis, side)
+
+    def set_bc_face(self, pc, pn, axis, side):
+        ng = self.num_guard
+        a = pc.primitive1
+
+        def face(lower, upper):
+            s = [slice(ng, -ng)] * 3
+            s[axis] = slice(lower, upper)
+            return tuple(s)
+
+        with pc.execution_context:
+            if pn is not None:
+                b = pn.primitive1
+                if side == -1:
+                    a[face(None, ng)] = b[face(-2 * ng, -ng)]
+                else:
+                    a[face(-ng, None)] = b[face(ng, 2 * ng)]
+            else:
+                if side == -1:
+                    a[face(None, ng)] = a[face(ng, ng + 1)]
+                else:
+                    a[face(-ng, None)] = a[face(-ng - 1, -ng)]
+                if axis == 2:
+                    g = a[face(None, ng) if side == -1 else face(-ng, None)]
+                    vz = g[..., 3]
+                    vz[vz * side < 0.0] = 0.0
+
+    def new_iteration(self):
+        for patch in self.patches:
+            patch.new_iteration()
@@ -12,6 +12,12 @@ DESCRIPTION: Isothermal DG solver for a binary accretion problem in 2D planar
 #define L_ENDPOINT 99999990
 #define R_ENDPOINT 99999991
 
+// Number of columns of the rows summed by the diagnostics kernel: the point
+// mass source terms, [mass][term][quantity] with the quantities mdot, fx, fy,
+// torque, and power, followed by the mass, the angular momentum, and the
+// real and imaginary parts of the eccentricity vector and of sigma_m1.
+#define NUM_DIAGNOSTIC_SUMS 26
+
 
 // ============================ MATH ==========================================
 // ============================================================================
@@ -22,6 +28,12 @@ DESCRIPTION: Isothermal DG solver for a binary accretion problem in 2D planar
 #define sign(x) copysign(1.0, x)
 #define minabs(a, b, c) min3(fabs(a), fabs(b), fabs(c))
 
+#if (EXEC_MODE == EXEC_GPU)
+#define ACCUMULATE(x, y) atomicAdd(&(x), y)
+#else
+#define ACCUMULATE(x, y) (x) += (y)
+#endif
+
 
 // ============================ INTERNAL STRUCTS ==============================
 // ============================================================================
@@ -80,13 +92,14 @@ PRIVATE double gravitational_potential(
     return phi;
 }
 
-PRIVATE void point_mass_source_term(
+PRIVATE void point_mass_source_term_parts(
     struct PointMass *mass,
     double x1,
     double y1,
     double dt,
     double *prim,
-    double *delta_cons)
+    double *delta_grav,
+    double *delta_sink)
 {
     double x0 = mass->x;
     double y0 = mass->y;
@@ -105,17 +118,17 @@ PRIVATE void point_mass_source_term(
     double mdot = sigma * sink_rate * -1.0;
 
     // gravitational force
-    delta_cons[0] += 0.0;
-    delta_cons[1] += fx * dt;
-    delta_cons[2] += fy * dt;
+    delta_grav[0] = 0.0;
+    delta_grav[1] = fx * dt;
+    delta_grav[2] = fy * dt;
 
     switch (mass->sink_model)
     {
         case 1: // acceleration-free
         {
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += dt * mdot * prim[1];
-            delta_cons[2] += dt * mdot * prim[2];
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * prim[1];
+            delta_sink[2] = dt * mdot * prim[2];
             break;
         }
         case 2: // torque-free
@@ -129,28 +142,48 @@ PRIVATE void point_mass_source_term(
             double dvdotrhat = (vx - vx0) * rhatx + (vy - vy0) * rhaty;
             double vxstar = dvdotrhat * rhatx + vx0;
             double vystar = dvdotrhat * rhaty + vy0;
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += dt * mdot * vxstar;
-            delta_cons[2] += dt * mdot * vystar;
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = dt * mdot * vxstar;
+            delta_sink[2] = dt * mdot * vystar;
             break;
         }
         case 3: // force-free
         {
-            delta_cons[0] += dt * mdot;
-            delta_cons[1] += 0.0;
-            delta_cons[2] += 0.0;
+            delta_sink[0] = dt * mdot;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
             break;
         }
         default: // sink is inactive
         {
-            delta_cons[0] += 0.0;
-            delta_cons[1] += 0.0;
-            delta_cons[2] += 0.0;
+            delta_sink[0] = 0.0;
+            delta_sink[1] = 0.0;
+            delta_sink[2] = 0.0;
             break;
         }
     }
 }
 
+PRIVATE void point_mass_source_term(
+    struct PointMass *mass,
+    double x1,
+    double y1,
+    double dt,
+    double *prim,
+    double *delta_cons)
+{
+    double delta_grav[NCONS];
+    double delta_sink[NCONS];
+
+    point_mass_source_term_parts(mass, x1, y1, dt, prim, delta_grav, delta_sink);
+
+    for (int q = 0; q < NCONS; ++q)
+    {
+        delta_cons[q] += delta_grav[q];
+        delta_cons[q] += delta_sink[q];
+    }
+}
+
 PRIVATE void point_masses_source_term(
     struct PointMassList *mass_list,
     double x1,
@@ -983,126 +1016,140 @@ PUBLIC void cbdisodg_2d_advance_rk(
 }
 
 
-// PUBLIC void cbdisodg_2d_point_mass_source_term(
-//     int ni,
-//     int nj,
-//     double patch_xl, // mesh
-//     double patch_xr,
-//     double patch_yl,
-//     double patch_yr,
-//     double x1, // point mass 1
-//     double y1,
-//     double vx1,
-//     double vy1,
-//     double mass1,
-//     double softening_length1,
-//     double sink_rate1,
-//     double sink_radius1,
-//     int sink_model1,
-//     double x2, // point mass 2
-//     double y2,
-//     double vx2,
-//     double vy2,
-//     double mass2,
-//     double softening_length2,
-//     double sink_rate2,
-//     double sink_radius2,
-//     int sink_model2,
-//     double velocity_ceiling,
-//     int which_mass, // :: $ in [1, 2]
-//     double *weights, // :: $.shape == (ni + 2, nj + 2, 3, 6)
-//     double *cons_rate) // :: $.shape == (ni + 2, nj + 2, 3)
-// {
-//     struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
-//     struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
-//     struct PointMassList mass_list = {{m1, m2}};
-
-//     // Gaussian quadrature points in scaled domain xsi=[-1,1]
-//     double g[3] = {-0.774596669241483, 0.000000000000000, 0.774596669241483};
-//     // Gaussian weights at quadrature points
-//     double w[3] = { 0.555555555555556, 0.888888888888889, 0.555555555555556};
-//         // Scaled LeGendre polynomials at quadrature points
-//     double p[3][3] = {{ 1.000000000000000, 1.000000000000000, 1.000000000000000},
-//                       {-1.341640786499873, 0.000000000000000, 1.341640786499873},
-//                       { 0.894427190999914, -1.11803398874990, 0.894427190999914}};
+// Integrate the diagnostic quantities over each zone with the Gauss
+// quadrature of the advance kernel, and sum them over each row of zones. The
+// solution is reconstructed from the modal weights at each quadrature node,
+// and the radial cut is applied to the nodes, so a zone cut by the annulus
+// contributes only its nodes inside it. The sums are integrals divided by
+// the zone area dx * dy.
+PUBLIC void cbdisodg_2d_diagnostics(
+    int ni,
+    int nj,
+    double patch_xl, // mesh
+    double patch_xr,
+    double patch_yl,
+    double patch_yr,
+    double x1, // point mass 1
+    double y1,
+    double vx1,
+    double vy1,
+    double mass1,
+    double softening_length1,
+    double sink_rate1,
+    double sink_radius1,
+    int sink_model1,
+    double x2, // point mass 2
+    double y2,
+    double vx2,
+    double vy2,
+    double mass2,
+    double softening_length2,
+    double sink_rate2,
+    double sink_radius2,
+    int sink_model2,
+    double velocity_ceiling,
+    double inner_radius, // radial cut
+    double outer_radius, // :: $ > inner_radius
+    double *weights, // :: $.shape == (ni + 2, nj + 2, 3, 3, 3)
+    double *sums) // :: $.shape == (ni, 26) # 26 = NUM_DIAGNOSTIC_SUMS
+{
+    static double gauss_weights_1d[ORDER] = {0.555555555555556, 0.888888888888889, 0.555555555555556};
+    double gauss_xsi_1d[ORDER] = {-0.774596669241483, 0.000000000000000, 0.774596669241483};
 
-//     int ng = 1; // number of guard zones
-//     int si = NCONS * NPOLY * (nj + 2 * ng);
-//     int sj = NCONS * NPOLY;
+    struct PointMass m1 = {x1, y1, vx1, vy1, mass1, softening_length1, sink_rate1, sink_radius1, sink_model1};
+    struct PointMass m2 = {x2, y2, vx2, vy2, mass2, softening_length2, sink_rate2, sink_radius2, sink_model2};
+    struct PointMassList mass_list = {{m1, m2}};
 
-//     double dx = (patch_xr - patch_xl) / ni;
-//     double dy = (patch_yr - patch_yl) / nj;
+    int ng = 1; // number of guard zones
+    int si = NCONS * ORDER * ORDER * (nj + 2 * ng);
+    int sj = NCONS * ORDER * ORDER;
+    double dx = (patch_xr - patch_xl) / ni;
+    double dy = (patch_yr - patch_yl) / nj;
 
-//     FOR_EACH_2D(ni, nj)
-//     {
-//         int ncc = (i + ng) * si + (j + ng) * sj;
-//         double *ucc = &weights[ncc];
-//         double *udot = &cons_rate[ncc];
-//         double xc = patch_xl + (i + 0.5) * dx;
-//         double yc = patch_yl + (j + 0.5) * dy;
-//         // double *pc = &primitive[ncc];
-//         // double *uc = &cons_rate[ncc];
-//         // point_mass_source_term(&mass_list.masses[which_mass - 1], xc, yc, 1.0, pc, uc);
-
-//         double u_dot[NCONS];
-//         double u_dot_sum[NCONS];
-//         double phi[NPOLY];
+    double phi_volume[ORDER][ORDER][ORDER][ORDER]; // i_quad x j_quad x m x n
 
-//         for (int q = 0; q < NCONS; ++q)
-//         {
-//             u_dot[q]     = 0.0;
-//             u_dot_sum[q] = 0.0;
-//         }
+    for (int i_quad = 0; i_quad < ORDER; ++i_quad)
+        for (int j_quad = 0; j_quad < ORDER; ++j_quad)
+            for (int m = 0; m < ORDER; ++m)
+                for (int n = 0; n < ORDER; ++n)
+                    phi_volume[i_quad][j_quad][m][n] = basis_phi_2d(i_quad, j_quad, m, n, 0, 0);
 
-//         for (int ic = 0; ic < 3; ++ic)
-//         {
-//             for (int jc = 0; jc < 3; ++jc)
-//             {
-//                 double xp = xc + 0.5 * g[ic] * dx;
-//                 double yp = yc + 0.5 * g[jc] * dy;
+    FOR_EACH_2D(ni, nj)
+    {
+        double *ucc = &weights[(i + ng) * si + (j + ng) * sj];
+        double xc = patch_xl + (i + 0.5) * dx;
+        double yc = patch_yl + (j + 0.5) * dy;
+        double zone_sums[NUM_DIAGNOSTIC_SUMS];
 
-//                 // 2D basis functions phi_l(x,y) = P_m(x) * P_n(y) at cell points
-//                 int il = 0;
-//                 for (int m = 0; m < 3; ++m)
-//                 {
-//                     for (int n = 0; n < 3; ++n)
-//                     {
-//                         if ((n + m) < 3)
-//                         {
-//                             phi[il]  =  p[m][ic] *  p[n][jc];
-//                             il += 1;
-//                         }
-//                     }
-//                 }
+        for (int k = 0; k < NUM_DIAGNOSTIC_SUMS; ++k)
+        {
+            zone_sums[k] = 0.0;
+        }
 
-//                 double uij[NCONS];
-//                 double pij[NCONS];
+        for (int i_quad = 0; i_quad < ORDER; ++i_quad)
+        {
+            for (int j_quad = 0; j_quad < ORDER; ++j_quad)
+            {
+                double x = xc + 0.5 * gauss_xsi_1d[i_quad] * dx;
+                double y = yc + 0.5 * gauss_xsi_1d[j_quad] * dy;
+                double r = sqrt(x * x + y * y);
 
-//                 for (int q = 0; q < NCONS; ++q)
-//                 {
-//                     uij[q] = 0.0;
+                if (r <= inner_radius || r >= outer_radius)
+                {
+                    continue;
+                }
+                double gw = 0.25 * gauss_weights_1d[i_quad] * gauss_weights_1d[j_quad];
+                double cons[NCONS];
+                double prim[NCONS];
+                reconstruct_2d(i_quad, j_quad, phi_volume, ucc, cons);
+                conserved_to_primitive(cons, prim, velocity_ceiling);
 
-//                     for (int l = 0; l < NPOLY; ++l)
-//                     {
-//                         uij[q] += ucc[NPOLY * q + l] * phi[l];
-//                     }
-//                 }
+                for (int p = 0; p < 2; ++p)
+                {
+                    struct PointMass *mass = &mass_list.masses[p];
+                    double delta_grav[NCONS];
+                    double delta_sink[NCONS];
+                    point_mass_source_term_parts(mass, x, y, 1.0, prim, delta_grav, delta_sink);
 
-//                 conserved_to_primitive(uij, pij, velocity_ceiling);
-//                 point_mass_source_term(&mass_list.masses[which_mass - 1], xp, yp, 1.0, pij, u_dot);
-//                 for (int q = 0; q < NCONS; ++q)
-//                 {
-//                     u_dot_sum[q] += w[ic] * w[jc] * u_dot[q];
-//                 }
-//             }
-//         }
+                    for (int t = 0; t < 2; ++t)
+                    {
+                        double *delta = t == 0 ? delta_grav : delta_sink;
+                        double *s = &zone_sums[(2 * p + t) * 5];
+                        s[0] += gw * delta[0];
+                        s[1] += gw * delta[1];
+                        s[2] += gw * delta[2];
+                        s[3] += gw * (x * delta[2] - y * delta[1]);
+                        s[4] += gw * (mass->vx * delta[1] + mass->vy * delta[2]);
+                    }
+                }
 
-//         for (int q = 0; q < NCONS; ++q)
-//         {
-//             udot[q] = u_dot_sum[q];
-//         }
-//     }
-// }
+                // Moments of the surface density; the eccentricity vector is
+                // that of a test particle orbiting a unit mass at the origin.
+                double sigma = prim[0];
+                double vx = prim[1];
+                double vy = prim[2];
+                double cos_phi = r > 0.0 ? x / r : 1.0;
+                double sin_phi = r > 0.0 ? y / r : 0.0;
+                double v_dot_v = vx * vx + vy * vy;
+                double v_dot_r = vx * x + vy * y;
+                double ex = v_dot_v * x - v_dot_r * vx - cos_phi;
+                double ey = v_dot_v * y - v_dot_r * vy - sin_phi;
+
+                zone_sums[20] += gw * sigma;
+                zone_sums[21] += gw * (x * cons[2] - y * cons[1]);
+                zone_sums[22] += gw * sigma * ex;
+                zone_sums[23] += gw * sigma * ey;
+                zone_sums[24] += gw * sigma * cos_phi;
+                zone_sums[25] += gw * sigma * sin_phi;
+            }
+        }
+
+        for (int k = 0; k < NUM_DIAGNOSTIC_SUMS; ++k)
+        {
+            ACCUMULATE(sums[i * NUM_DIAGNOSTIC_SUMS + k], zone_sums[k]);
+        }
+    }
+}
 
 
 PUBLIC void cbdisodg_2d_wavespeed(
@@ -4,13 +4,18 @@ Isothermal solver for the binary accretion problem in 2D planar coordinates.
 
 from logging import getLogger
 from typing import NamedTuple
+from sailfish.kernel.allocate import Allocator
 from sailfish.kernel.library import Library
 from sailfish.kernel.system import get_array_module, execution_context, num_devices
 from sailfish.mesh import PlanarCartesian2DMesh
-from sailfish.physics.circumbinary import Physics, EquationOfState, ViscosityModel
+from sailfish.physics.circumbinary import (
+    Physics,
+    EquationOfState,
+    ViscosityModel,
+    Diagnostic,
+)
 from sailfish.solver_base import SolverBase
-from sailfish.subdivide import subdivide, concat_on_host, lazy_reduce
-
+from sailfish.subdivide import subdivide, to_host, concat_on_host, lazy_reduce
 
 logger = getLogger(__name__)
 
@@ -19,6 +24,15 @@ NPOLY = 6
 ORDER = 3
 GUARD = 1
 
+# Point mass source term diagnostics integrated by the diagnostics kernel, in
+# the order of the innermost axis of its [mass][term][quantity] sums.
+SOURCE_TERM_QUANTITIES = ("mdot", "fx", "fy", "torque", "power")
+
+# Moments of the solution integrated by the diagnostics kernel, and their
+# columns following the source terms. The complex-valued ones take two columns.
+MOMENT_COLUMNS = dict(mass=20, angular_momentum=21, eccentricity_vector=22, sigma_m1=24)
+NUM_DIAGNOSTIC_SUMS = 26
+
 
 class Options(NamedTuple):
     """
@@ -28,6 +42,7 @@ class Options(NamedTuple):
     velocity_ceiling: float = 1e12
     rk_order: int = 2
     limit_slopes: bool = True
+    huge_pages: bool = False
 
 
 def primitive_to_conserved(prim, cons):
@@ -80,6 +95,40 @@ def initial_condition(setup, mesh, time):
     return weights
 
 
+def prolong_weights(weights):
+    """
+    Return a 2D array of weights on a mesh with twice the resolution.
+
+    The polynomial in each zone is projected onto each of its four
+    sub-zones. Since the restriction of the polynomial to a sub-zone is a
+    polynomial of the same order, the projection is exact, and the zone
+    averages are conserved.
+    """
+    import numpy as np
+
+    g = (-0.774596669241483, +0.000000000000000, +0.774596669241483)
+    w = (+0.555555555555556, +0.888888888888889, +0.555555555555556)
+
+    def legendre(x):
+        return np.array([1.0, 3.0**0.5 * x, 5.0**0.5 * 0.5 * (3.0 * x * x - 1.0)])
+
+    # m[s, a, b] is the weight of sub-zone basis function b from the parent
+    # basis function a, in the left (s=0) or right (s=1) sub-zone.
+    m = np.zeros((2, ORDER, ORDER))
+
+    for s, offset in enumerate((-1.0, +1.0)):
+        for x, wx in zip(g, w):
+            m[s] += 0.5 * wx * np.outer(legendre(0.5 * (x + offset)), legendre(x))
+
+    ni, nj = weights.shape[:2]
+    fine = np.zeros((2 * ni, 2 * nj) + weights.shape[2:])
+
+    for si in range(2):
+        for sj in range(2):
+            fine[si::2, sj::2] = np.einsum("ijqab,ac,bd->ijqcd", weights, m[si], m[sj])
+    return fine
+
+
 class Patch:
     """
     Holds the array buffer state for the solution on a subset of the
@@ -115,28 +164,25 @@ class Patch:
         self.buffer_outer_radius = buffer_outer_radius
         self.buffer_surface_density = buffer_surface_density
 
+        alloc = Allocator(xp, huge_pages=options.huge_pages)
+
         with self.execution_context:
-            self.wavespeeds = xp.zeros(weights.shape[:2])
-            self.weights0 = xp.zeros(weights.shape)  # weights at the timestep start
-            self.weights1 = xp.array(weights)  # weights to be read from
-            self.weights2 = xp.array(weights)  # weights to be written to
+            self.wavespeeds = alloc.zeros(weights.shape[:2])
+            self.weights0 = alloc.zeros(weights.shape)  # weights at the timestep start
+            self.weights1 = alloc.array(weights)  # weights to be read from
+            self.weights2 = alloc.array(weights)  # weights to be written to
 
-    def point_mass_source_term(self, which_mass):
+    def diagnostic_sums(self, inner_radius, outer_radius):
         """
-        Return an array of the rates of conserved quantities, resulting from the application of
-        gravitational and/or accretion source terms due to point masses.
+        Return this patch's integrals of the diagnostic quantities over the
+        radial annulus, divided by the zone area, as an array of length
+        NUM_DIAGNOSTIC_SUMS.
         """
-        if which_mass not in (1, 2):
-            raise ValueError("the mass must be either 1 or 2")
-
-        ng = GUARD  # number of guard cells
-        ni, nj = self.shape
         m1, m2 = self.physics.point_masses(self.time)
 
         with self.execution_context:
-            cons_rate = self.xp.zeros([ni + 2 * ng, nj + 2 * ng, NCONS])
-
-            self.lib.cbdiso_2d_point_mass_source_term[self.shape](
+            sums = self.xp.zeros((self.shape[0], NUM_DIAGNOSTIC_SUMS))
+            self.lib.cbdisodg_2d_diagnostics[self.shape](
                 self.xl,
                 self.xr,
                 self.yl,
@@ -160,11 +206,12 @@ class Patch:
                 m2.sink_radius,
                 m2.sink_model.value,
                 self.options.velocity_ceiling,
-                which_mass,
+                inner_radius,
+                outer_radius,
                 self.weights1,
-                cons_rate,
+                sums,
             )
-        return cons_rate[ng:-ng, ng:-ng]
+            return sums.sum(axis=0)
 
     def maximum_wavespeed(self):
         """
@@ -317,6 +364,14 @@ class Solver(SolverBase):
     ):
         import numpy
 
+        physics["diagnostics"] = [
+            Diagnostic(**v) for v in physics.get("diagnostics", [])
+        ]
+
+        if options.get("mapped_state_dir"):
+            # The weights arrays are not kept in file-backed memory.
+            raise ValueError("solver does not support mapped_state_dir")
+
         self._physics = physics = Physics(**physics)
         self._options = options = Options(**options)
 
@@ -344,6 +399,14 @@ class Solver(SolverBase):
         if not physics.constant_softening:
             raise ValueError("solver only supports constant gravitational softening")
 
+        for d in physics.diagnostics:
+            if d.quantity not in (
+                "time",
+                *SOURCE_TERM_QUANTITIES,
+                *MOMENT_COLUMNS,
+            ):
+                raise ValueError(f"solver does not support diagnostic {d.quantity}")
+
         xp = get_array_module(mode)
         ng = GUARD  # number of guard zones
         nq = NCONS  # number of conserved quantities
@@ -413,6 +476,15 @@ class Solver(SolverBase):
             rank=2,
         )
 
+    def prolonged_solution(self, factor=2):
+        weights = self.solution
+
+        while factor > 1:
+            weights = prolong_weights(weights)
+            factor //= 2
+
+        return weights
+
     @property
     def primitive(self):
         self.set_bc("weights1")
@@ -426,35 +498,70 @@ class Solver(SolverBase):
         """
         Generate runtime reductions on the solution data for time series.
 
-        As of now, the reductions generated are the rates of mass accretion, and
-        of x and y momentum (combined gravitational and accretion) resulting
-        from each of the point masses. If there are 2 point masses, then the
-        result of this function is a 7-element list: `[time, mdot1, fx1, fy1,
-        mdot2, fx2, fy2]`.
+        The diagnostics are integrated over the zones by Gauss quadrature of
+        the DG solution, in one launch of the diagnostics kernel per patch and
+        distinct radial cut. If no diagnostics are configured, the result is
+        the time followed by the rates of mass accretion, and of x and y
+        momentum (combined gravitational and accretion), due to each of the
+        point masses: `[time, mdot1, fx1, fy1, mdot2, fx2, fy2]` for two
+        point masses.
         """
-
-        def to_host(a):
-            try:
-                return a.get()
-            except AttributeError:
-                return a
-
-        def patch_reduction(patch, which):
-            return patch.point_mass_source_term(which).sum(axis=(0, 1)) * da
-
         da = self.mesh.dx * self.mesh.dy
-        point_mass_reductions = [self.time]
+        sums = dict()
+
+        def get_sums(cut):
+            key = tuple(cut) if cut is not None else None
 
-        for n in range(self._physics.num_particles):
-            point_mass_reductions.extend(
-                lazy_reduce(
+            if key not in sums:
+                r0, r1 = key or (-1.0, float("inf"))
+                sums[key] = da * lazy_reduce(
                     sum,
                     to_host,
-                    (lambda: patch_reduction(patch, n + 1) for patch in self.patches),
+                    (lambda: patch.diagnostic_sums(r0, r1) for patch in self.patches),
                     (patch.execution_context for patch in self.patches),
                 )
-            )
-        return point_mass_reductions
+            return sums[key]
+
+        def source_term(f, quantity, mass, term):
+            return f[
+                ((mass - 1) * 2 + term) * 5 + SOURCE_TERM_QUANTITIES.index(quantity)
+            ]
+
+        if not self._physics.diagnostics:
+            f = get_sums(None)
+            point_mass_reductions = [self.time]
+
+            for n in range(self._physics.num_particles):
+                for quantity in ("mdot", "fx", "fy"):
+                    point_mass_reductions.append(
+                        source_term(f, quantity, n + 1, 0)
+                        + source_term(f, quantity, n + 1, 1)
+                    )
+            return point_mass_reductions
+
+        result = []
+
+        for d in self._physics.diagnostics:
+            if d.quantity == "time":
+                result.append(self.time / self.setup.reference_time_scale)
+                continue
+
+            f = get_sums(d.radial_cut)
+
+            if d.quantity in SOURCE_TERM_QUANTITIES:
+                if d.quantity == "power" and d.which_mass == "both":
+                    raise ValueError("Mass option for 'power' must be 1 or 2.")
+
+                masses = [1, 2] if d.which_mass == "both" else [d.which_mass]
+                term = 1 if d.accretion else 0
+                result.append(sum(source_term(f, d.quantity, m, term) for m in masses))
+            elif d.quantity in ("eccentricity_vector", "sigma_m1"):
+                k = MOMENT_COLUMNS[d.quantity]
+                result.append(f[k] + 1.0j * f[k + 1])
+            else:
+                result.append(f[MOMENT_COLUMNS[d.quantity]])
+
+        return result
 
     @property
     def time(self):
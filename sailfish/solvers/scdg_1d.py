@@ -201,6 +201,8 @@ class Solver(SolverBase):
     - :code:`rk3-sr02`: four-stage 3rd Order SSP-4RK3 of Spiteri & Ruuth (2002)
     """
 
+    returns_live_state = True
+
     def __init__(
         self,
         setup=None,
@@ -92,7 +92,8 @@ PRIVATE void primitive_to_conserved(const double *prim, double *cons, double dv)
     cons[3] = dv * m * prim[3];
 }
 
-PRIVATE void conserved_to_primitive(double *cons, double *prim, double dv, double coordinate)
+// Returns 1 if the Mach ceiling was applied, and 0 otherwise.
+PRIVATE int conserved_to_primitive(double *cons, double *prim, double dv, double coordinate)
 {
     const double newton_iter_max = 500;
     const double error_tolerance = 1e-12 * (cons[0] + cons[2]) / dv;
@@ -135,8 +136,9 @@ PRIVATE void conserved_to_primitive(double *cons, double *prim, double dv, doubl
     double u = prim[1];
     double e = prim[2] / prim[0] * 3.0;
     double emin = u * u / (1.0 + u * u) / pow(mach_ceiling, 2.0);
+    int mach_ceiling_active = e < emin;
 
-    if (e < emin) {
+    if (mach_ceiling_active) {
         prim[2] = prim[0] * emin * (ADIABATIC_GAMMA - 1.0);
         // primitive_to_conserved(prim, cons, dv);
     }
@@ -162,6 +164,8 @@ PRIVATE void conserved_to_primitive(double *cons, double *prim, double dv, doubl
         exit(1);
     }
     #endif
+
+    return mach_ceiling_active;
 }
 
 PRIVATE void primitive_to_flux(const double *prim, const double *cons, double *flux)
@@ -428,6 +432,8 @@ PUBLIC void srhd_1d_conserved_to_primitive(
     double *face_positions, // :: $.shape == (num_zones + 1,)
     double *conserved,      // :: $.shape == (num_zones + 4, 4)
     double *primitive,      // :: $.shape == (num_zones + 4, 4)
+    double *floor_counters, // :: $.shape == (num_zones,)
+    int count_floors,       // :: $ in [0, 1]
     double scale_factor,    // :: $ >= 0.0
     int coords)             // :: $ in [0, 1]
 {
@@ -442,7 +448,7 @@ PUBLIC void srhd_1d_conserved_to_primitive(
         double xl = yl * scale_factor;
         double xr = yr * scale_factor;
         double dv = cell_volume(coords, xl, xr);
-        conserved_to_primitive(u, p, dv, xl);
+        floor_counters[i] += count_floors * conserved_to_primitive(u, p, dv, xl);
     }
 }
 
@@ -16,6 +16,7 @@ value of 2.0.
 
 from logging import getLogger
 from typing import NamedTuple
+from sailfish.kernel.allocate import Allocator
 from sailfish.kernel.library import Library
 from sailfish.kernel.system import get_array_module, execution_context, num_devices
 from sailfish.subdivide import subdivide, concat_on_host, lazy_reduce
@@ -58,6 +59,7 @@ def initial_condition(setup, mesh, i0, i1, time, xp):
 class Options(NamedTuple):
     compute_wavespeed: bool = False
     rk_order: int = 2
+    huge_pages: bool = False
 
 
 class Physics(NamedTuple):
@@ -83,6 +85,7 @@ class Patch:
         fix_i1,
         lib,
         xp,
+        alloc,
         execution_context,
     ):
         import numpy as np
@@ -128,18 +131,21 @@ class Patch:
                 conserved_with_guard[ng:-ng] = xp.array(conserved)
 
             self.faces = faces
-            self.wavespeeds = xp.zeros(num_zones)
-            self.primitive1 = xp.zeros_like(conserved_with_guard)
-            self.conserved0 = conserved_with_guard.copy()
-            self.conserved1 = conserved_with_guard.copy()
-            self.conserved2 = conserved_with_guard.copy()
-
-    def recompute_primitive(self):
+            self.wavespeeds = alloc.zeros(num_zones)
+            self.floor_counters = alloc.zeros(num_zones)
+            self.primitive1 = alloc.zeros(conserved_with_guard.shape)
+            self.conserved0 = alloc.array(conserved_with_guard)
+            self.conserved1 = alloc.array(conserved_with_guard)
+            self.conserved2 = alloc.array(conserved_with_guard)
+
+    def recompute_primitive(self, count_floors=False):
         with self.execution_context:
             self.lib.srhd_1d_conserved_to_primitive[self.num_zones](
                 self.faces,
                 self.conserved1,
                 self.primitive1,
+                self.floor_counters,
+                int(count_floors),
                 self.scale_factor,
                 self.coordinates,
             )
@@ -235,6 +241,7 @@ class Solver(SolverBase):
         logger.info(f"subdivide grid over {num_patches} patches")
         logger.info(f"mesh is {mesh}")
         logger.info(f"boundary condition is {bcl}/{bcr}")
+        alloc = Allocator(xp, huge_pages=options.huge_pages)
         patches = list()
 
         for n, (a, b) in enumerate(subdivide(mesh.shape[0], num_patches)):
@@ -250,6 +257,7 @@ class Solver(SolverBase):
                 fix_i1,
                 lib,
                 xp,
+                alloc,
                 execution_context(mode, device_id=n % num_devices(mode)),
             )
             patches.append(patch)
@@ -313,13 +321,29 @@ class Solver(SolverBase):
 
     def advance_rk(self, rk_param, dt):
         for patch in self.patches:
-            patch.recompute_primitive()
+            patch.recompute_primitive(count_floors=True)
 
         self.set_bc("primitive1")
 
         for patch in self.patches:
             patch.advance_rk(rk_param, dt)
 
+    def floor_counts(self):
+        """
+        Return the number of zone updates, since the previous call, in which
+        the Mach ceiling was applied, and reset the counters.
+
+        Zones are counted once per Runge-Kutta stage.
+        """
+        count = 0
+
+        for patch in self.patches:
+            with patch.execution_context:
+                count += int(patch.floor_counters.sum())
+                patch.floor_counters[...] = 0.0
+
+        return dict(mach_ceiling=count)
+
     def set_bc(self, array):
         ng = self.num_guard
         num_patches = len(self.patches)
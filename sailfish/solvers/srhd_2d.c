@@ -104,7 +104,8 @@ PRIVATE void primitive_to_conserved(const double *prim, double *cons, double dv)
     // cons[4] = dv * m * prim[3];
 }
 
-PRIVATE void conserved_to_primitive(double *cons1, double *cons2, double *prim, double dv, double x, double q)
+// Returns 1 if the Mach ceiling was applied, and 0 otherwise.
+PRIVATE int conserved_to_primitive(double *cons1, double *cons2, double *prim, double dv, double x, double q)
 {
     const double newton_iter_max = 500;
     const double error_tolerance = 1e-12 * (cons1[0] + cons1[3]) / dv;
@@ -150,8 +151,9 @@ PRIVATE void conserved_to_primitive(double *cons1, double *cons2, double *prim,
     double u_squared = prim[1] * prim[1] + prim[2] * prim[2];
     double e = prim[3] / prim[0] * 3.0;
     double emin = u_squared / (1.0 + u_squared) / pow(mach_ceiling, 2.0);
+    int mach_ceiling_active = e < emin;
 
-    if (e < emin) {
+    if (mach_ceiling_active) {
         prim[3] = prim[0] * emin * (ADIABATIC_GAMMA - 1.0);
         primitive_to_conserved(prim, cons2, dv);
     }
@@ -182,6 +184,8 @@ PRIVATE void conserved_to_primitive(double *cons1, double *cons2, double *prim,
         exit(1);
     }
     #endif
+
+    return mach_ceiling_active;
 }
 
 PRIVATE void primitive_to_flux(const double *prim, const double *cons, double *flux, int direction)
@@ -518,6 +522,8 @@ PUBLIC void srhd_2d_conserved_to_primitive(
     double *conserved1,      // :: $.shape == (ni + 4, nj, 4)
     double *conserved2,      // :: $.shape == (ni + 4, nj, 4)
     double *primitive,       // :: $.shape == (ni + 4, nj, 4)
+    double *floor_counters,  // :: $.shape == (ni, nj)
+    int count_floors,        // :: $ in [0, 1]
     double polar_extent,
     double scale_factor)     // :: $ >= 0.0
 {
@@ -539,7 +545,7 @@ PUBLIC void srhd_2d_conserved_to_primitive(
         double q0 = dq * (j + 0);
         double q1 = dq * (j + 1);
         double dv = cell_volume(r0, r1, q0, q1);
-        conserved_to_primitive(u1, u2, p, dv, x0, q0);
+        floor_counters[i * nj + j] += count_floors * conserved_to_primitive(u1, u2, p, dv, x0, q0);
     }
 }
 
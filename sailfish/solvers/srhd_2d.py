@@ -16,6 +16,7 @@ value of 2.0.
 
 from logging import getLogger
 from typing import NamedTuple
+from sailfish.kernel.allocate import Allocator
 from sailfish.kernel.library import Library
 from sailfish.kernel.system import get_array_module, execution_context, num_devices
 from sailfish.subdivide import subdivide, concat_on_host, lazy_reduce
@@ -64,6 +65,7 @@ class Options(NamedTuple):
     rk_order: int = 2
     plm_theta: float = 1.5
     mach_ceiling: float = 1e6
+    huge_pages: bool = False
 
 
 class Physics(NamedTuple):
@@ -92,6 +94,7 @@ class Patch:
         num_first_order_zones,
         lib,
         xp,
+        alloc,
         execution_context,
     ):
         ng = NUM_GUARD
@@ -136,19 +139,22 @@ class Patch:
                 conserved_with_guard[ng:-ng] = xp.array(conserved)
 
             self.faces = faces
-            self.wavespeeds = xp.zeros(shape)
-            self.primitive1 = xp.zeros_like(conserved_with_guard)
-            self.conserved0 = conserved_with_guard.copy()
-            self.conserved1 = conserved_with_guard.copy()
-            self.conserved2 = conserved_with_guard.copy()
-
-    def recompute_primitive(self):
+            self.wavespeeds = alloc.zeros(shape)
+            self.floor_counters = alloc.zeros(shape)
+            self.primitive1 = alloc.zeros(conserved_with_guard.shape)
+            self.conserved0 = alloc.array(conserved_with_guard)
+            self.conserved1 = alloc.array(conserved_with_guard)
+            self.conserved2 = alloc.array(conserved_with_guard)
+
+    def recompute_primitive(self, count_floors=False):
         with self.execution_context:
             self.lib.srhd_2d_conserved_to_primitive[self.shape](
                 self.faces,
                 self.conserved1,
                 self.conserved2,
                 self.primitive1,
+                self.floor_counters,
+                int(count_floors),
                 self.polar_extent,
                 self.scale_factor,
             )
@@ -256,6 +262,7 @@ class Solver(SolverBase):
         if options.rk_order not in (1, 2, 3):
             raise ValueError("solver only supports rk_order in 1, 2, 3")
 
+        alloc = Allocator(xp, huge_pages=options.huge_pages)
         patches = list()
 
         for n, (a, b) in enumerate(subdivide(mesh.shape[0], num_patches)):
@@ -275,6 +282,7 @@ class Solver(SolverBase):
                 num_first_order_zones,
                 lib,
                 xp,
+                alloc,
                 execution_context(mode, device_id=n % num_devices(mode)),
             )
             patches.append(patch)
@@ -343,13 +351,29 @@ class Solver(SolverBase):
 
     def advance_rk(self, rk_param, dt):
         for patch in self.patches:
-            patch.recompute_primitive()
+            patch.recompute_primitive(count_floors=True)
 
         self.set_bc("primitive1")
 
         for patch in self.patches:
             patch.advance_rk(rk_param, dt)
 
+    def floor_counts(self):
+        """
+        Return the number of zone updates, since the previous call, in which
+        the Mach ceiling was applied, and reset the counters.
+
+        Zones are counted once per Runge-Kutta stage.
+        """
+        count = 0
+
+        for patch in self.patches:
+            with patch.execution_context:
+                count += int(patch.floor_counters.sum())
+                patch.floor_counters[...] = 0.0
+
+        return dict(mach_ceiling=count)
+
     def set_bc(self, array):
         ng = self.num_guard
         num_patches = len(self.patches)
@@ -0,0 +1,853 @@
+/*
+MODULE: standalone
+
+DESCRIPTION: Python-free time loop for the cbdiso_2d and cbdgam_2d solvers.
+
+  This file is not a kernel library. It is concatenated with the kernel
+  header and one of the solver sources (selected with SOLVER_CBDISO_2D or
+  SOLVER_CBDGAM_2D) by sailfish/standalone.py, and compiled to an
+  executable. The executable reads a run configuration and initial state
+  written by `python3 -m sailfish.standalone export`, and writes checkpoints
+  in the same format. Checkpoints can be used to restart the executable, or
+  converted back to pickles for the Python driver with
+  `python3 -m sailfish.standalone import`.
+
+  Usage: sailfish-<solver> run.cfg [key=value ...]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// ============================ CONFIGURATION =================================
+// ============================================================================
+#define MAX_CONFIG_ITEMS 256
+#define MAX_KEY_LENGTH 64
+#define MAX_VAL_LENGTH 1024
+
+struct Config {
+    int size;
+    char keys[MAX_CONFIG_ITEMS][MAX_KEY_LENGTH];
+    char vals[MAX_CONFIG_ITEMS][MAX_VAL_LENGTH];
+};
+
+static char *strip(char *s)
+{
+    char *end;
+    while (*s == ' ' || *s == '\t') ++s;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) --end;
+    *end = '\0';
+    return s;
+}
+
+static void config_set(struct Config *cfg, const char *key, const char *val)
+{
+    for (int n = 0; n < cfg->size; ++n)
+    {
+        if (strcmp(cfg->keys[n], key) == 0)
+        {
+            snprintf(cfg->vals[n], MAX_VAL_LENGTH, "%s", val);
+            return;
+        }
+    }
+    if (cfg->size == MAX_CONFIG_ITEMS)
+    {
+        fprintf(stderr, "[standalone:error] too many config items\n");
+        exit(1);
+    }
+    snprintf(cfg->keys[cfg->size], MAX_KEY_LENGTH, "%s", key);
+    snprintf(cfg->vals[cfg->size], MAX_VAL_LENGTH, "%s", val);
+    cfg->size += 1;
+}
+
+static void config_set_double(struct Config *cfg, const char *key, double val)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", val);
+    config_set(cfg, key, buf);
+}
+
+static void config_set_int(struct Config *cfg, const char *key, long val)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%ld", val);
+    config_set(cfg, key, buf);
+}
+
+static int config_parse_item(struct Config *cfg, char *line)
+{
+    char *eq = strchr(line, '=');
+    if (eq == NULL)
+    {
+        return 0;
+    }
+    *eq = '\0';
+    config_set(cfg, strip(line), strip(eq + 1));
+    return 1;
+}
+
+static void config_read(struct Config *cfg, const char *filename)
+{
+    char line[MAX_KEY_LENGTH + MAX_VAL_LENGTH];
+    FILE *infile = fopen(filename, "r");
+
+    if (infile == NULL)
+    {
+        fprintf(stderr, "[standalone:error] could not open config file %s\n", filename);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), infile))
+    {
+        char *s = strip(line);
+        if (*s == '#' || *s == '\0')
+        {
+            continue;
+        }
+        config_parse_item(cfg, s);
+    }
+    fclose(infile);
+}
+
+static void config_write(const struct Config *cfg, const char *filename)
+{
+    FILE *outfile = fopen(filename, "w");
+
+    if (outfile == NULL)
+    {
+        fprintf(stderr, "[standalone:error] could not write config file %s\n", filename);
+        exit(1);
+    }
+    fprintf(outfile, "# sailfish standalone run configuration\n");
+
+    for (int n = 0; n < cfg->size; ++n)
+    {
+        fprintf(outfile, "%s = %s\n", cfg->keys[n], cfg->vals[n]);
+    }
+    fclose(outfile);
+}
+
+static const char *config_str(const struct Config *cfg, const char *key)
+{
+    for (int n = 0; n < cfg->size; ++n)
+    {
+        if (strcmp(cfg->keys[n], key) == 0)
+        {
+            return cfg->vals[n];
+        }
+    }
+    fprintf(stderr, "[standalone:error] missing config item %s\n", key);
+    exit(1);
+}
+
+static int config_has(const struct Config *cfg, const char *key)
+{
+    for (int n = 0; n < cfg->size; ++n)
+    {
+        if (strcmp(cfg->keys[n], key) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double config_double(const struct Config *cfg, const char *key)
+{
+    return strtod(config_str(cfg, key), NULL);
+}
+
+static int config_int(const struct Config *cfg, const char *key)
+{
+    return (int) strtol(config_str(cfg, key), NULL, 10);
+}
+
+
+// ============================ KEPLER ========================================
+// ============================================================================
+// This is a port of OrbitalElements.orbital_state in sailfish/physics/kepler.py
+// ----------------------------------------------------------------------------
+struct OrbitalElements {
+    double semimajor_axis;
+    double total_mass;
+    double mass_ratio;
+    double eccentricity;
+};
+
+static double orbital_omega(const struct OrbitalElements *orbit)
+{
+    double m = orbit->total_mass;
+    double a = orbit->semimajor_axis;
+    return sqrt(m / a / a / a);
+}
+
+static double eccentric_anomaly(const struct OrbitalElements *orbit, double time_since_periapse)
+{
+    double p = 2.0 * M_PI / orbital_omega(orbit);
+    double t = time_since_periapse - p * floor(time_since_periapse / p);
+    double e = orbit->eccentricity;
+    double n = orbital_omega(orbit) * t;
+    double k = n;
+    int iter = 0;
+
+    while (fabs(k - e * sin(k) - n) > 1e-15)
+    {
+        k -= (k - e * sin(k) - n) / (1.0 - e * cos(k));
+
+        if (++iter > 10)
+        {
+            fprintf(stderr, "[standalone:error] eccentric anomaly: no solution\n");
+            exit(1);
+        }
+    }
+    return k;
+}
+
+static void orbital_state(
+    const struct OrbitalElements *orbit,
+    double time_since_periapse,
+    struct PointMass *c1,
+    struct PointMass *c2)
+{
+    double a = orbit->semimajor_axis;
+    double m = orbit->total_mass;
+    double q = orbit->mass_ratio;
+    double e = orbit->eccentricity;
+    double w = orbital_omega(orbit);
+    double m1 = m / (1.0 + q);
+    double m2 = m - m1;
+    double ek = eccentric_anomaly(orbit, time_since_periapse);
+    double ck = cos(ek);
+    double sk = sin(ek);
+    double x1 = -a * q / (1.0 + q) * (e - ck);
+    double y1 = +a * q / (1.0 + q) * (sk) * sqrt(1.0 - e * e);
+    double vx1 = -a * q / (1.0 + q) * w / (1.0 - e * ck) * sk;
+    double vy1 = +a * q / (1.0 + q) * w / (1.0 - e * ck) * ck * sqrt(1.0 - e * e);
+
+    c1->mass = m1;
+    c1->x = x1;
+    c1->y = y1;
+    c1->vx = vx1;
+    c1->vy = vy1;
+    c2->mass = m2;
+    c2->x = -x1 / q;
+    c2->y = -y1 / q;
+    c2->vx = -vx1 / q;
+    c2->vy = -vy1 / q;
+}
+
+
+// ============================ RUN STATE =====================================
+// ============================================================================
+#define POINT_MASS_MODEL_NONE 0
+#define POINT_MASS_MODEL_STATIC 1
+#define POINT_MASS_MODEL_KEPLER 2
+
+struct Run {
+    int ni;
+    int nj;
+    double x0;
+    double x1;
+    double y0;
+    double y1;
+    double time;
+    double time0;
+    double *primitive1;
+    double *primitive2;
+    double *conserved0;
+    double *wavespeeds;
+    double *accumulators; // point mass source terms; not reported here
+    double *floor_counters;
+
+    int point_mass_model;
+    struct OrbitalElements orbit;
+    struct PointMass masses[2];
+
+    double buffer_surface_density;
+    double buffer_surface_pressure;
+    double buffer_driving_rate;
+    double buffer_outer_radius;
+    double buffer_onset_width;
+    int buffer_is_enabled;
+
+    double sound_speed_squared;
+    double mach_squared;
+    int eos_type;
+    double viscosity_coefficient;
+    double alpha;
+    double gamma_law_index;
+    double cooling_coefficient;
+    int split_cooling;
+    int constant_softening;
+
+    double velocity_ceiling;
+    double density_floor;
+    double pressure_floor;
+    double mach_ceiling;
+    int rk_order;
+};
+
+static size_t num_state_elements(const struct Run *run)
+{
+    return (size_t) (run->ni + 2 * NUM_GUARD) * (run->nj + 2 * NUM_GUARD) * NCONS;
+}
+
+static void point_masses(const struct Run *run, double time, struct PointMass *m1, struct PointMass *m2)
+{
+    *m1 = run->masses[0];
+    *m2 = run->masses[1];
+
+    if (run->point_mass_model == POINT_MASS_MODEL_KEPLER)
+    {
+        orbital_state(&run->orbit, time, m1, m2);
+    }
+}
+
+static void read_point_mass(const struct Config *cfg, int n, struct PointMass *m)
+{
+    char key[MAX_KEY_LENGTH];
+#define READ_POINT_MASS_FIELD(field, func) \
+    snprintf(key, sizeof(key), "point_mass%d.%s", n, #field); \
+    m->field = func(cfg, key);
+
+    READ_POINT_MASS_FIELD(mass, config_double)
+    READ_POINT_MASS_FIELD(x, config_double)
+    READ_POINT_MASS_FIELD(y, config_double)
+    READ_POINT_MASS_FIELD(vx, config_double)
+    READ_POINT_MASS_FIELD(vy, config_double)
+    READ_POINT_MASS_FIELD(softening_length, config_double)
+    READ_POINT_MASS_FIELD(sink_rate, config_double)
+    READ_POINT_MASS_FIELD(sink_radius, config_double)
+    READ_POINT_MASS_FIELD(sink_model, config_int)
+#undef READ_POINT_MASS_FIELD
+}
+
+static void run_init(struct Run *run, const struct Config *cfg)
+{
+    run->ni = config_int(cfg, "ni");
+    run->nj = config_int(cfg, "nj");
+    run->x0 = config_double(cfg, "x0");
+    run->x1 = config_double(cfg, "x1");
+    run->y0 = config_double(cfg, "y0");
+    run->y1 = config_double(cfg, "y1");
+    run->time = run->time0 = config_double(cfg, "time");
+
+    run->point_mass_model = config_int(cfg, "point_mass_model");
+    read_point_mass(cfg, 1, &run->masses[0]);
+    read_point_mass(cfg, 2, &run->masses[1]);
+
+    if (run->point_mass_model == POINT_MASS_MODEL_KEPLER)
+    {
+        run->orbit.semimajor_axis = config_double(cfg, "orbit.semimajor_axis");
+        run->orbit.total_mass = config_double(cfg, "orbit.total_mass");
+        run->orbit.mass_ratio = config_double(cfg, "orbit.mass_ratio");
+        run->orbit.eccentricity = config_double(cfg, "orbit.eccentricity");
+    }
+
+    run->buffer_surface_density = config_double(cfg, "buffer_surface_density");
+    run->buffer_surface_pressure = config_double(cfg, "buffer_surface_pressure");
+    run->buffer_driving_rate = config_double(cfg, "buffer_driving_rate");
+    run->buffer_outer_radius = config_double(cfg, "buffer_outer_radius");
+    run->buffer_onset_width = config_double(cfg, "buffer_onset_width");
+    run->buffer_is_enabled = config_int(cfg, "buffer_is_enabled");
+
+    run->sound_speed_squared = config_double(cfg, "sound_speed_squared");
+    run->mach_squared = config_double(cfg, "mach_squared");
+    run->eos_type = config_int(cfg, "eos_type");
+    run->viscosity_coefficient = config_double(cfg, "viscosity_coefficient");
+    run->alpha = config_double(cfg, "alpha");
+    run->gamma_law_index = config_double(cfg, "gamma_law_index");
+    run->cooling_coefficient = config_double(cfg, "cooling_coefficient");
+    run->split_cooling = config_has(cfg, "split_cooling") ? config_int(cfg, "split_cooling") : 0;
+    run->constant_softening = config_int(cfg, "constant_softening");
+
+    run->velocity_ceiling = config_double(cfg, "velocity_ceiling");
+    run->density_floor = config_double(cfg, "density_floor");
+    run->pressure_floor = config_double(cfg, "pressure_floor");
+    run->mach_ceiling = config_double(cfg, "mach_ceiling");
+    run->rk_order = config_int(cfg, "rk_order");
+
+    // The reconstruction scheme, and with it NUM_GUARD, is compiled in.
+    if (config_has(cfg, "reconstruction") && config_int(cfg, "reconstruction") != RECONSTRUCTION)
+    {
+        fprintf(stderr, "[standalone:error] run uses reconstruction %d, but the executable was built for %d\n",
+            config_int(cfg, "reconstruction"), RECONSTRUCTION);
+        exit(1);
+    }
+
+    size_t n = num_state_elements(run);
+    run->primitive1 = (double*) calloc(n, sizeof(double));
+    run->primitive2 = (double*) calloc(n, sizeof(double));
+    run->conserved0 = (double*) calloc(n, sizeof(double));
+    run->wavespeeds = (double*) calloc(n / NCONS, sizeof(double));
+    run->accumulators = (double*) calloc(run->ni * NUM_ACCUMULATORS, sizeof(double));
+    run->floor_counters = (double*) calloc(run->ni * NUM_FLOOR_COUNTERS, sizeof(double));
+
+    if (!run->primitive1 || !run->primitive2 || !run->conserved0 || !run->wavespeeds || !run->accumulators || !run->floor_counters)
+    {
+        fprintf(stderr, "[standalone:error] could not allocate state arrays\n");
+        exit(1);
+    }
+}
+
+static void run_free(struct Run *run)
+{
+    free(run->primitive1);
+    free(run->primitive2);
+    free(run->conserved0);
+    free(run->wavespeeds);
+    free(run->accumulators);
+    free(run->floor_counters);
+}
+
+
+// ============================ STATE I/O =====================================
+// ============================================================================
+// The state file is the interior primitive array of shape (ni, nj, NCONS), in
+// C order, with no header. It is read and written one row of zones at a time
+// so that no full-size staging buffer is needed.
+// ----------------------------------------------------------------------------
+static void path_join(char *result, size_t size, const char *dir, const char *name)
+{
+    if (name[0] == '/' || dir[0] == '\0')
+    {
+        snprintf(result, size, "%s", name);
+    }
+    else
+    {
+        snprintf(result, size, "%s/%s", dir, name);
+    }
+}
+
+static void read_state(struct Run *run, const char *filename)
+{
+    int ng = NUM_GUARD;
+    int si = NCONS * (run->nj + 2 * ng);
+    FILE *infile = fopen(filename, "rb");
+
+    if (infile == NULL)
+    {
+        fprintf(stderr, "[standalone:error] could not open state file %s\n", filename);
+        exit(1);
+    }
+    for (int i = 0; i < run->ni; ++i)
+    {
+        double *row = &run->primitive1[(i + ng) * si + ng * NCONS];
+
+        if (fread(row, sizeof(double), run->nj * NCONS, infile) != (size_t) (run->nj * NCONS))
+        {
+            fprintf(stderr, "[standalone:error] state file %s is truncated\n", filename);
+            exit(1);
+        }
+    }
+    fclose(infile);
+}
+
+static void write_state(const struct Run *run, const char *filename)
+{
+    int ng = NUM_GUARD;
+    int si = NCONS * (run->nj + 2 * ng);
+    char tmpname[2 * MAX_VAL_LENGTH + 8];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+    FILE *outfile = fopen(tmpname, "wb");
+
+    if (outfile == NULL)
+    {
+        fprintf(stderr, "[standalone:error] could not write state file %s\n", tmpname);
+        exit(1);
+    }
+    for (int i = 0; i < run->ni; ++i)
+    {
+        const double *row = &run->primitive1[(i + ng) * si + ng * NCONS];
+
+        if (fwrite(row, sizeof(double), run->nj * NCONS, outfile) != (size_t) (run->nj * NCONS))
+        {
+            fprintf(stderr, "[standalone:error] failed writing state file %s\n", tmpname);
+            exit(1);
+        }
+    }
+    fclose(outfile);
+    rename(tmpname, filename);
+}
+
+
+// ============================ SOLVER ========================================
+// ============================================================================
+static void set_bc(struct Run *run, double *p)
+{
+    int ng = NUM_GUARD;
+    int mi = run->ni + 2 * ng;
+    int mj = run->nj + 2 * ng;
+    int si = NCONS * mj;
+    int sj = NCONS;
+
+    for (int i = 0; i < ng; ++i)
+    {
+        memcpy(&p[i * si], &p[ng * si], si * sizeof(double));
+        memcpy(&p[(mi - 1 - i) * si], &p[(mi - 1 - ng) * si], si * sizeof(double));
+    }
+    for (int i = 0; i < mi; ++i)
+    {
+        for (int j = 0; j < ng; ++j)
+        {
+            memcpy(&p[i * si + j * sj], &p[i * si + ng * sj], sj * sizeof(double));
+            memcpy(&p[i * si + (mj - 1 - j) * sj], &p[i * si + (mj - 1 - ng) * sj], sj * sizeof(double));
+        }
+    }
+}
+
+static double maximum_wavespeed(struct Run *run)
+{
+    int ni = run->ni;
+    int nj = run->nj;
+    long n = (long) (ni + 2 * NUM_GUARD) * (nj + 2 * NUM_GUARD);
+    double amax = 0.0;
+
+#if defined(SOLVER_CBDISO_2D)
+    struct PointMass m1, m2;
+    point_masses(run, run->time, &m1, &m2);
+    cbdiso_2d_wavespeed(
+        ni, nj, run->x0, run->x1, run->y0, run->y1,
+        run->sound_speed_squared, run->mach_squared, run->eos_type,
+        m1.x, m1.y, m1.vx, m1.vy, m1.mass, m1.softening_length, m1.sink_rate, m1.sink_radius, m1.sink_model,
+        m2.x, m2.y, m2.vx, m2.vy, m2.mass, m2.softening_length, m2.sink_rate, m2.sink_radius, m2.sink_model,
+        run->primitive1,
+        run->wavespeeds);
+#elif defined(SOLVER_CBDGAM_2D)
+    cbdgam_2d_wavespeed(ni, nj, run->primitive1, run->wavespeeds, run->gamma_law_index);
+#endif
+
+#if (EXEC_MODE == EXEC_OMP)
+    #pragma omp parallel for reduction(max : amax)
+#endif
+    for (long m = 0; m < n; ++m)
+    {
+        amax = max2(amax, run->wavespeeds[m]);
+    }
+    return amax;
+}
+
+static void new_iteration(struct Run *run)
+{
+    run->time0 = run->time;
+#if defined(SOLVER_CBDISO_2D)
+    cbdiso_2d_primitive_to_conserved(run->ni, run->nj, run->primitive1, run->conserved0);
+#elif defined(SOLVER_CBDGAM_2D)
+    cbdgam_2d_primitive_to_conserved(run->ni, run->nj, run->primitive1, run->conserved0, run->gamma_law_index);
+#endif
+}
+
+static void advance_rk(struct Run *run, double a, double dt)
+{
+    struct PointMass m1, m2;
+    point_masses(run, run->time, &m1, &m2);
+    set_bc(run, run->primitive1);
+
+#if defined(SOLVER_CBDISO_2D)
+    cbdiso_2d_advance_rk(
+        run->ni, run->nj, run->x0, run->x1, run->y0, run->y1,
+        run->conserved0, run->primitive1, run->primitive2, run->accumulators, run->floor_counters,
+        run->buffer_surface_density, m1.mass + m2.mass, run->buffer_driving_rate,
+        run->buffer_outer_radius, run->buffer_onset_width, run->buffer_is_enabled,
+        m1.x, m1.y, m1.vx, m1.vy, m1.mass, m1.softening_length, m1.sink_rate, m1.sink_radius, m1.sink_model,
+        m2.x, m2.y, m2.vx, m2.vy, m2.mass, m2.softening_length, m2.sink_rate, m2.sink_radius, m2.sink_model,
+        run->sound_speed_squared, run->mach_squared, run->eos_type, run->viscosity_coefficient,
+        a, dt, 0.0, run->velocity_ceiling, run->density_floor);
+#elif defined(SOLVER_CBDGAM_2D)
+    cbdgam_2d_advance_rk(
+        run->ni, run->nj, run->x0, run->x1, run->y0, run->y1,
+        run->conserved0, run->primitive1, run->primitive2, run->accumulators, run->floor_counters,
+        run->gamma_law_index,
+        run->buffer_surface_density, run->buffer_surface_pressure, m1.mass + m2.mass,
+        run->buffer_driving_rate, run->buffer_outer_radius, run->buffer_onset_width, run->buffer_is_enabled,
+        m1.x, m1.y, m1.vx, m1.vy, m1.mass, m1.softening_length, m1.sink_rate, m1.sink_radius, m1.sink_model,
+        m2.x, m2.y, m2.vx, m2.vy, m2.mass, m2.softening_length, m2.sink_rate, m2.sink_radius, m2.sink_model,
+        run->alpha, a, dt, 0.0, run->velocity_ceiling,
+        run->split_cooling ? 0.0 : run->cooling_coefficient, run->mach_ceiling,
+        run->density_floor, run->pressure_floor, run->constant_softening);
+#endif
+
+    double *p = run->primitive1;
+    run->time = run->time0 * a + (run->time + dt) * (1.0 - a);
+    run->primitive1 = run->primitive2;
+    run->primitive2 = p;
+}
+
+#if defined(SOLVER_CBDGAM_2D)
+// Apply the cooling term for a time dt, separately from the hydrodynamics
+// update; this mirrors cbdgam_2d.Solver.cool.
+static void cool(struct Run *run, double dt)
+{
+    cbdgam_2d_cool(
+        run->ni, run->nj, run->primitive1, run->primitive2, run->floor_counters,
+        run->cooling_coefficient, run->mach_ceiling, run->pressure_floor, dt, run->gamma_law_index);
+
+    double *p = run->primitive1;
+    run->primitive1 = run->primitive2;
+    run->primitive2 = p;
+}
+#endif
+
+#if defined(SOLVER_CBDISO_2D)
+static const char *floor_counter_names[] = {"density_floor", "velocity_ceiling"};
+#elif defined(SOLVER_CBDGAM_2D)
+static const char *floor_counter_names[] = {"density_floor", "velocity_ceiling", "pressure_floor", "mach_ceiling"};
+#endif
+
+// Print the number of zone updates per step which applied each floor or
+// ceiling, if any did, and reset the counters.
+static void report_floor_counts(struct Run *run, long iteration, int fold)
+{
+    double counts[NUM_FLOOR_COUNTERS] = {0.0};
+    int any = 0;
+
+    for (int i = 0; i < run->ni; ++i)
+    {
+        for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+        {
+            counts[n] += run->floor_counters[i * NUM_FLOOR_COUNTERS + n];
+            run->floor_counters[i * NUM_FLOOR_COUNTERS + n] = 0.0;
+        }
+    }
+    for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+    {
+        any |= counts[n] > 0.0;
+    }
+    if (any)
+    {
+        printf("[%04ld] floors per step:", iteration);
+
+        for (int n = 0; n < NUM_FLOOR_COUNTERS; ++n)
+        {
+            printf(" %s=%.1f", floor_counter_names[n], counts[n] / fold);
+        }
+        printf("\n");
+    }
+}
+
+static void advance(struct Run *run, double dt)
+{
+#if defined(SOLVER_CBDGAM_2D)
+    // With split cooling, the hydrodynamics update is bracketed by two
+    // half-steps of cooling (Strang splitting).
+    if (run->split_cooling)
+    {
+        cool(run, 0.5 * dt);
+    }
+#endif
+    new_iteration(run);
+
+    switch (run->rk_order)
+    {
+        case 1:
+            advance_rk(run, 0.0, dt);
+            break;
+        case 2:
+            advance_rk(run, 0.0, dt);
+            advance_rk(run, 0.5, dt);
+            break;
+        case 3:
+            advance_rk(run, 0.0, dt);
+            advance_rk(run, 0.75, dt);
+            advance_rk(run, 1.0 / 3.0, dt);
+            break;
+        default:
+            fprintf(stderr, "[standalone:error] rk_order must be 1, 2, or 3\n");
+            exit(1);
+    }
+#if defined(SOLVER_CBDGAM_2D)
+    if (run->split_cooling)
+    {
+        cool(run, 0.5 * dt);
+    }
+#endif
+}
+
+
+// ============================ EVENTS ========================================
+// ============================================================================
+// This mirrors Recurrence and RecurringEvent in sailfish/event.py
+// ----------------------------------------------------------------------------
+#define RECURRENCE_LINEAR 0
+#define RECURRENCE_LOG 1
+
+struct RecurringEvent {
+    int kind;
+    double interval;
+    double last_time;
+    int number;
+};
+
+static double event_next_time(const struct RecurringEvent *event, double time)
+{
+    if (event->number == 0)
+    {
+        return time;
+    }
+    if (event->kind == RECURRENCE_LOG)
+    {
+        return event->last_time * (1.0 + event->interval);
+    }
+    return event->last_time + event->interval;
+}
+
+static int event_is_due(const struct RecurringEvent *event, double time)
+{
+    return event->interval > 0.0 && time >= event_next_time(event, time);
+}
+
+static void event_next(struct RecurringEvent *event, double time)
+{
+    event->last_time = event_next_time(event, time);
+    event->number += 1;
+}
+
+
+// ============================ DRIVER ========================================
+// ============================================================================
+static double wall_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void write_checkpoint(
+    struct Config *cfg,
+    const struct Run *run,
+    const struct RecurringEvent *event,
+    long iteration,
+    double dt,
+    const char *outdir)
+{
+    char data_name[64];
+    char cfg_name[64];
+    char path[2 * MAX_VAL_LENGTH];
+    snprintf(data_name, sizeof(data_name), "chkpt.%04d.dat", event->number - 1);
+    snprintf(cfg_name, sizeof(cfg_name), "chkpt.%04d.cfg", event->number - 1);
+
+    config_set_double(cfg, "time", run->time);
+    config_set_int(cfg, "iteration", iteration);
+    config_set_double(cfg, "timestep_dt", dt);
+    config_set_int(cfg, "checkpoint_number", event->number);
+    config_set_double(cfg, "checkpoint_last_time", event->last_time);
+    config_set(cfg, "state_file", data_name);
+
+    path_join(path, sizeof(path), outdir, data_name);
+    write_state(run, path);
+    path_join(path, sizeof(path), outdir, cfg_name);
+    config_write(cfg, path);
+    printf("[standalone] write checkpoint %s\n", path);
+}
+
+int main(int argc, char **argv)
+{
+    static struct Config cfg;
+    struct Run run;
+    struct RecurringEvent checkpoint;
+    char cfg_dir[MAX_VAL_LENGTH];
+    char path[2 * MAX_VAL_LENGTH];
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s run.cfg [key=value ...]\n", argv[0]);
+        return 1;
+    }
+    config_read(&cfg, argv[1]);
+
+    for (int n = 2; n < argc; ++n)
+    {
+        char item[MAX_KEY_LENGTH + MAX_VAL_LENGTH];
+        snprintf(item, sizeof(item), "%s", argv[n]);
+
+        if (!config_parse_item(&cfg, item))
+        {
+            fprintf(stderr, "[standalone:error] expected key=value, got %s\n", argv[n]);
+            return 1;
+        }
+    }
+
+    snprintf(cfg_dir, sizeof(cfg_dir), "%s", argv[1]);
+    char *slash = strrchr(cfg_dir, '/');
+
+    if (slash != NULL)
+    {
+        *slash = '\0';
+    }
+    else
+    {
+        snprintf(cfg_dir, sizeof(cfg_dir), ".");
+    }
+
+    const char *outdir = cfg_dir;
+
+    for (int n = 0; n < cfg.size; ++n)
+    {
+        if (strcmp(cfg.keys[n], "output_directory") == 0)
+        {
+            outdir = cfg.vals[n];
+        }
+    }
+
+    run_init(&run, &cfg);
+    path_join(path, sizeof(path), cfg_dir, config_str(&cfg, "state_file"));
+    read_state(&run, path);
+
+    checkpoint.kind = config_int(&cfg, "checkpoint_kind");
+    checkpoint.interval = config_double(&cfg, "checkpoint_interval");
+    checkpoint.number = config_int(&cfg, "checkpoint_number");
+    checkpoint.last_time = config_double(&cfg, "checkpoint_last_time");
+
+    double end_time = config_double(&cfg, "end_time");
+    double reference_time = config_double(&cfg, "reference_time");
+    double cfl_number = config_double(&cfg, "cfl_number");
+    double dt = config_double(&cfg, "timestep_dt");
+    double min_spacing = min2((run.x1 - run.x0) / run.ni, (run.y1 - run.y0) / run.nj);
+    long iteration = config_int(&cfg, "iteration");
+    int fold = config_int(&cfg, "fold");
+    int new_timestep_cadence = config_int(&cfg, "new_timestep_cadence");
+
+    printf("\nsailfish standalone driver (%s)\n\n", config_str(&cfg, "solver"));
+    printf("[standalone] %d x %d zones, start at t=%0.4f\n", run.ni, run.nj, run.time / reference_time);
+    printf("[standalone] run until t=%g\n", end_time);
+    printf("[standalone] CFL number is %g\n", cfl_number);
+    printf("[standalone] output directory is %s\n", outdir);
+
+    while (1)
+    {
+        double user_time = run.time / reference_time;
+
+        if (event_is_due(&checkpoint, user_time))
+        {
+            event_next(&checkpoint, user_time);
+            write_checkpoint(&cfg, &run, &checkpoint, iteration, dt, outdir);
+        }
+
+        if (user_time >= end_time)
+        {
+            break;
+        }
+
+        double start = wall_time();
+
+        for (int n = 0; n < fold; ++n)
+        {
+            if (dt <= 0.0 || iteration % new_timestep_cadence == 0)
+            {
+                dt = min_spacing / maximum_wavespeed(&run) * cfl_number;
+            }
+            advance(&run, dt);
+            iteration += 1;
+        }
+
+        double mzps = (double) run.ni * run.nj / (wall_time() - start) * 1e-6 * fold;
+        printf("[%04ld] t=%0.3f dt=%.3e Mzps=%.3f\n", iteration, user_time, dt, mzps);
+        report_floor_counts(&run, iteration, fold);
+        fflush(stdout);
+    }
+
+    run_free(&run);
+    return 0;
+}
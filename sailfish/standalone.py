@@ -0,0 +1,468 @@
+"""
+Export runs to, and import checkpoints from, the standalone C driver.
+
+The standalone driver (standalone.c) is a Python-free time loop for the
+`cbdiso_2d` and `cbdgam_2d` solvers, intended for long production runs on
+clusters where a Python environment is inconvenient. A run is prepared with
+
+    python3 -m sailfish.standalone export circumbinary-disk -n 1000 -o run
+
+which initializes the setup (or loads a checkpoint) exactly as the Python
+driver would, and writes to the run directory a configuration file
+`run.cfg`, the initial primitive data `state.dat`, a metadata sidecar
+`metadata.pk`, and a compiled executable `sailfish-<solver>`. The run is
+started with
+
+    run/sailfish-cbdiso_2d run/run.cfg [key=value ...]
+
+and writes checkpoints `chkpt.NNNN.dat` and `chkpt.NNNN.cfg`. A checkpoint
+configuration file can be given back to the executable to restart, or
+converted to a pickled checkpoint that the Python driver and plotting tools
+understand, with
+
+    python3 -m sailfish.standalone import run/chkpt.0003.cfg
+
+Only the checkpoint event is supported by the standalone driver; time series
+and other events are left as they were when the run was exported.
+"""
+
+import os, pickle, subprocess
+from logging import getLogger
+from types import SimpleNamespace
+
+logger = getLogger(__name__)
+
+SUPPORTED_SOLVERS = ("cbdiso_2d", "cbdgam_2d")
+POINT_MASS_MODEL_NONE = 0
+POINT_MASS_MODEL_STATIC = 1
+POINT_MASS_MODEL_KEPLER = 2
+EXPORT_EVENT = "standalone_export"
+
+
+class StandaloneError(Exception):
+    """The run cannot be handled by the standalone driver"""
+
+
+def format_value(value):
+    """
+    Format a config value so that floats survive the round trip exactly.
+    """
+    if type(value) is bool:
+        return str(int(value))
+    if type(value) is float:
+        return repr(value)
+    return str(value)
+
+
+def read_config(filename):
+    """
+    Read a standalone config file into a dictionary of strings.
+    """
+    config = dict()
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith("#") and "=" in line:
+                key, val = line.split("=", 1)
+                config[key.strip()] = val.strip()
+    return config
+
+
+def write_config(filename, config):
+    with open(filename, "w") as f:
+        f.write("# sailfish standalone run configuration\n")
+        for key, val in config.items():
+            f.write(f"{key} = {format_value(val)}\n")
+
+
+def point_mass_model(setup, physics, time):
+    """
+    Determine how the standalone driver should generate the point masses.
+
+    The point masses are either absent, static, or follow the Kepler orbit
+    described by the setup's `orbital_elements` property. The choice is
+    verified by sampling the setup's point mass function over one orbit.
+    """
+    from math import pi
+
+    if physics.point_mass_function is None:
+        return POINT_MASS_MODEL_NONE, None
+
+    masses = physics.point_masses(time)
+    orbit = getattr(setup, "orbital_elements", None)
+    sample_times = [time + 2.0 * pi * n / 7.0 for n in range(8)]
+
+    def same_masses(m, n):
+        return all(abs(a - b) <= 1e-12 * (1.0 + abs(a)) for a, b in zip(m, n))
+
+    if orbit is not None:
+
+        def kepler_matches(t):
+            c1, c2 = orbit.orbital_state(t)
+            m1, m2 = physics.point_masses(t)
+            return same_masses(c1, m1[:5]) and same_masses(c2, m2[:5])
+
+        if all(kepler_matches(t) for t in sample_times):
+            return POINT_MASS_MODEL_KEPLER, orbit
+
+    def static_matches(t):
+        m1, m2 = physics.point_masses(t)
+        return m1 == masses[0] and m2 == masses[1]
+
+    if all(static_matches(t) for t in sample_times):
+        return POINT_MASS_MODEL_STATIC, None
+
+    raise StandaloneError("point masses are neither static nor a Kepler orbit")
+
+
+def run_config(state, end_time, new_timestep_cadence):
+    """
+    Return a dictionary of the items needed by the standalone driver.
+    """
+    from sailfish.event import LINEAR
+
+    solver = state.solver
+    setup = state.setup
+    physics = solver._physics
+    options = solver._options
+    patch = solver.patches[0]
+    mesh = state.mesh
+    model, orbit = point_mass_model(setup, physics, solver.time)
+    checkpoint = state.driver.events.get("checkpoint")
+    checkpoint_state = state.event_states.get("checkpoint")
+
+    config = dict(
+        solver=setup.solver,
+        ni=mesh.ni,
+        nj=mesh.nj,
+        x0=float(mesh.x0),
+        x1=float(mesh.x1),
+        y0=float(mesh.y0),
+        y1=float(mesh.y1),
+        time=float(solver.time),
+        iteration=state.iteration,
+        timestep_dt=float(state.timestep_dt or 0.0),
+        end_time=float(end_time),
+        reference_time=float(setup.reference_time_scale),
+        cfl_number=float(state.cfl_number),
+        fold=state.driver.fold or 10,
+        new_timestep_cadence=new_timestep_cadence,
+        rk_order=getattr(options, "rk_order", 2),
+        reconstruction=solver.define_macros["RECONSTRUCTION"],
+        checkpoint_kind=checkpoint.kind if checkpoint else LINEAR,
+        checkpoint_interval=float(checkpoint.interval if checkpoint else 0.0),
+        checkpoint_number=checkpoint_state.number if checkpoint_state else 0,
+        checkpoint_last_time=float(
+            checkpoint_state and checkpoint_state.last_time or 0.0
+        ),
+        eos_type=physics.eos_type.value,
+        sound_speed_squared=float(physics.sound_speed**2),
+        mach_squared=float(physics.mach_number**2),
+        viscosity_coefficient=float(physics.viscosity_coefficient),
+        alpha=float(physics.alpha),
+        gamma_law_index=float(physics.gamma_law_index),
+        cooling_coefficient=float(physics.cooling_coefficient),
+        split_cooling=getattr(patch, "split_cooling", False),
+        constant_softening=physics.constant_softening,
+        buffer_is_enabled=physics.buffer_is_enabled,
+        buffer_driving_rate=float(physics.buffer_driving_rate),
+        buffer_onset_width=float(physics.buffer_onset_width),
+        buffer_outer_radius=float(patch.buffer_outer_radius),
+        buffer_surface_density=float(patch.buffer_surface_density),
+        buffer_surface_pressure=float(getattr(patch, "buffer_surface_pressure", 0.0)),
+        velocity_ceiling=float(options.velocity_ceiling),
+        density_floor=float(options.density_floor),
+        pressure_floor=float(getattr(options, "pressure_floor", 0.0)),
+        mach_ceiling=float(getattr(options, "mach_ceiling", 0.0)),
+        point_mass_model=model,
+    )
+
+    for n, m in enumerate(physics.point_masses(solver.time)):
+        config[f"point_mass{n + 1}.mass"] = float(m.mass)
+        config[f"point_mass{n + 1}.x"] = float(m.position_x)
+        config[f"point_mass{n + 1}.y"] = float(m.position_y)
+        config[f"point_mass{n + 1}.vx"] = float(m.velocity_x)
+        config[f"point_mass{n + 1}.vy"] = float(m.velocity_y)
+        config[f"point_mass{n + 1}.softening_length"] = float(m.softening_length)
+        config[f"point_mass{n + 1}.sink_rate"] = float(m.sink_rate)
+        config[f"point_mass{n + 1}.sink_radius"] = float(m.sink_radius)
+        config[f"point_mass{n + 1}.sink_model"] = m.sink_model.value
+
+    if orbit is not None:
+        config["orbit.semimajor_axis"] = float(orbit.semimajor_axis)
+        config["orbit.total_mass"] = float(orbit.total_mass)
+        config["orbit.mass_ratio"] = float(orbit.mass_ratio)
+        config["orbit.eccentricity"] = float(orbit.eccentricity)
+
+    config["state_file"] = "state.dat"
+    return config
+
+
+def build_executable(solver, rundir, mode="cpu", compiler="cc", reconstruction=0):
+    """
+    Generate and compile the standalone driver source for the given solver.
+
+    The source is the kernel library header, followed by the solver's C
+    module, followed by standalone.c. It is written to the run directory
+    alongside the executable, so the run can be rebuilt on another machine
+    with the same command. The reconstruction scheme is the index of the
+    solver's RECONSTRUCTION macro, which also sets the number of guard zones.
+    """
+    from sailfish.kernel.library import KERNEL_LIB_HEADER
+
+    if mode not in ("cpu", "omp"):
+        raise StandaloneError(f"execution mode {mode} is not supported")
+
+    base = os.path.dirname(__file__)
+
+    with open(os.path.join(base, "solvers", f"{solver}.c")) as f:
+        solver_code = f.read()
+    with open(os.path.join(base, "standalone.c")) as f:
+        driver_code = f.read()
+
+    source = os.path.join(rundir, f"sailfish-{solver}.c")
+    target = os.path.join(rundir, f"sailfish-{solver}")
+
+    with open(source, "w") as f:
+        f.write(f"#define SOLVER_{solver.upper()}\n")
+        f.write(KERNEL_LIB_HEADER)
+        f.write(solver_code)
+        f.write(driver_code)
+
+    command = [compiler, "-O3", "-std=gnu99", f"-DEXEC_MODE={dict(cpu=0, omp=1)[mode]}"]
+    command += [f"-DRECONSTRUCTION={reconstruction}"]
+    command += ["-fopenmp"] if mode == "omp" else []
+    command += [source, "-o", target, "-lm"]
+
+    logger.info(" ".join(command))
+
+    with open(os.path.join(rundir, "build.sh"), "w") as f:
+        f.write("#!/bin/sh\n" + " ".join(command) + "\n")
+
+    subprocess.run(command, check=True)
+    return target
+
+
+def export_run(driver, rundir, mode="cpu", compiler="cc"):
+    """
+    Initialize a run with the Python driver, and export it for the standalone
+    driver.
+    """
+    from sailfish.event import Recurrence, LINEAR
+    from sailfish.driver import simulate, first_not_none
+
+    events = {EXPORT_EVENT: Recurrence(kind=LINEAR, interval=float("inf"))}
+    events.update(driver.events)
+    execution_mode = driver.execution_mode
+    driver = driver._replace(events=events, execution_mode=mode)
+    name, number, state = next(simulate(driver))
+
+    if name != EXPORT_EVENT:
+        raise StandaloneError("could not initialize the run")
+
+    del state.driver.events[EXPORT_EVENT]
+    del state.event_states[EXPORT_EVENT]
+
+    setup = state.setup
+    solver = state.solver
+
+    if setup.solver not in SUPPORTED_SOLVERS:
+        raise StandaloneError(
+            f"solver {setup.solver} is not supported, must be one of {SUPPORTED_SOLVERS}"
+        )
+
+    if len(solver.patches) != 1:
+        raise StandaloneError("the standalone driver does not support patches")
+
+    for name in state.driver.events:
+        if name != "checkpoint":
+            logger.warning(f"{name} event is ignored by the standalone driver")
+
+    end_time = first_not_none(
+        state.driver.end_time, setup.default_end_time, float("inf")
+    )
+    config = run_config(state, end_time, state.driver.new_timestep_cadence or 1)
+
+    os.makedirs(rundir, exist_ok=True)
+    solver.solution.astype("float64").tofile(os.path.join(rundir, "state.dat"))
+
+    metadata = dict(
+        driver=state.driver._replace(execution_mode=execution_mode),
+        mesh=state.mesh,
+        timeseries=state.timeseries,
+        event_states=state.event_states,
+        model_parameters=setup.model_parameter_dict(),
+        setup_name=setup.dash_case_class_name(),
+        solver_options=solver.options,
+    )
+
+    with open(os.path.join(rundir, "metadata.pk"), "wb") as f:
+        pickle.dump(metadata, f)
+
+    config["metadata_file"] = os.path.abspath(os.path.join(rundir, "metadata.pk"))
+    write_config(os.path.join(rundir, "run.cfg"), config)
+    logger.info(f"write run configuration {os.path.join(rundir, 'run.cfg')}")
+
+    return build_executable(
+        setup.solver,
+        rundir,
+        mode=mode,
+        compiler=compiler,
+        reconstruction=config["reconstruction"],
+    )
+
+
+def import_checkpoint(cfg_file, outdir=None):
+    """
+    Convert a standalone checkpoint to a pickle for the Python driver.
+
+    The resulting `chkpt.NNNN.pk` is written next to the config file, unless
+    `outdir` is given, and can be used to restart the Python driver.
+    """
+    import numpy as np
+    from sailfish.driver import DriverState, write_checkpoint
+    from sailfish.event import RecurringEvent
+    from sailfish.setup_base import SetupBase
+
+    config = read_config(cfg_file)
+    cfg_dir = os.path.dirname(cfg_file)
+
+    with open(config["metadata_file"], "rb") as f:
+        metadata = pickle.load(f)
+
+    ni, nj = int(config["ni"]), int(config["nj"])
+    nq = dict(cbdiso_2d=3, cbdgam_2d=4)[config["solver"]]
+    data_file = os.path.join(cfg_dir, config["state_file"])
+    solution = np.fromfile(data_file, dtype=np.float64).reshape(ni, nj, nq)
+
+    setup_class = SetupBase.find_setup_class(metadata["setup_name"])
+    setup = setup_class(**metadata["model_parameters"])
+    event_states = dict(metadata["event_states"])
+    number = int(config["checkpoint_number"])
+
+    if "checkpoint" in event_states:
+        last_time = float(config["checkpoint_last_time"])
+        event_states["checkpoint"] = RecurringEvent(last_time=last_time, number=number)
+
+    timestep_dt = float(config["timestep_dt"])
+    solver = SimpleNamespace(
+        time=float(config["time"]),
+        solution=solution,
+        primitive=None,
+        options=metadata["solver_options"],
+        mapped_solution=lambda name: None,
+    )
+    state = DriverState(
+        iteration=int(config["iteration"]),
+        driver=metadata["driver"],
+        mesh=metadata["mesh"],
+        timeseries=metadata["timeseries"],
+        event_states=event_states,
+        solver=solver,
+        setup=setup,
+        cfl_number=float(config["cfl_number"]),
+        timestep_dt=timestep_dt if timestep_dt > 0.0 else None,
+    )
+    write_checkpoint(number - 1, outdir or cfg_dir or ".", state)
+
+
+def main():
+    import argparse
+    import sailfish.setups
+    from sailfish.driver import (
+        DriverArgs,
+        init_logging,
+        load_user_config,
+        keyed_value,
+        ConfigurationError,
+    )
+    from sailfish.event import Recurrence
+    from sailfish.setup_base import SetupError
+
+    parser = argparse.ArgumentParser(
+        prog="sailfish.standalone",
+        description="prepare and post-process runs of the standalone C driver",
+    )
+    subparsers = parser.add_subparsers(dest="subcommand", required=True)
+    export_parser = subparsers.add_parser("export", help="export a run")
+    export_parser.add_argument(
+        "command",
+        help="setup name or restart file",
+    )
+    export_parser.add_argument("--resolution", "-n", metavar="N", type=int)
+    export_parser.add_argument("--cfl", dest="cfl_number", metavar="C", type=float)
+    export_parser.add_argument("--fold", "-f", metavar="F", type=int)
+    export_parser.add_argument("--new-timestep-cadence", metavar="C", type=int)
+    export_parser.add_argument("--end-time", "-e", metavar="T", type=float)
+    export_parser.add_argument(
+        "--checkpoint", "-c", metavar="C", type=Recurrence.from_str
+    )
+    export_parser.add_argument(
+        "--model",
+        nargs="*",
+        metavar="K=V",
+        type=keyed_value,
+        default=list(),
+        dest="model_parameters",
+    )
+    export_parser.add_argument(
+        "--solver",
+        nargs="*",
+        metavar="K=V",
+        type=keyed_value,
+        default=list(),
+        dest="solver_options",
+    )
+    export_parser.add_argument(
+        "--mode", dest="execution_mode", choices=["cpu", "omp"], default="cpu"
+    )
+    export_parser.add_argument("--compiler", default="cc")
+    export_parser.add_argument(
+        "--outdir", "-o", metavar="D", default=".", dest="output_directory"
+    )
+    import_parser = subparsers.add_parser("import", help="import a checkpoint")
+    import_parser.add_argument("cfg_file", help="standalone checkpoint .cfg file")
+    import_parser.add_argument(
+        "--outdir", "-o", metavar="D", default=None, dest="output_directory"
+    )
+
+    init_logging()
+    load_user_config()
+    args = parser.parse_args()
+
+    try:
+        if args.subcommand == "export":
+            parts = args.command.split(":")
+            model_parameters = dict(keyed_value(a) for a in parts[1:])
+            model_parameters.update(args.model_parameters)
+            is_chkpt = parts[0].endswith(".pk")
+            driver = DriverArgs(
+                setup_name=None if is_chkpt else parts[0],
+                chkpt_file=parts[0] if is_chkpt else None,
+                model_parameters=model_parameters,
+                solver_options=dict(args.solver_options),
+                cfl_number=args.cfl_number,
+                end_time=args.end_time,
+                fold=args.fold,
+                resolution=args.resolution,
+                new_timestep_cadence=args.new_timestep_cadence,
+                events=dict(checkpoint=args.checkpoint) if args.checkpoint else dict(),
+            )
+            export_run(
+                driver,
+                args.output_directory,
+                mode=args.execution_mode,
+                compiler=args.compiler,
+            )
+        else:
+            import_checkpoint(args.cfg_file, args.output_directory)
+
+    except (StandaloneError, ConfigurationError, SetupError) as e:
+        print(f"standalone error: {e}")
+
+    except subprocess.CalledProcessError as e:
+        print(f"compile failed: {e}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,425 @@
+"""
+Run a grid of simulations concurrently on the local machine.
+
+A sweep is a setup together with a parameter grid. Each point on the grid is
+a job, which is run in a pool of worker processes under a budget of CPU
+cores. Jobs on larger meshes are given more OpenMP threads, up to the core
+budget, and smaller jobs run single-threaded side by side. Worker processes
+are kept alive between jobs, so compiled solver modules stay loaded (see
+:py:mod:`sailfish.kernel.library`).
+
+Each job writes its checkpoints to its own subdirectory of the sweep
+directory. The file `sweep.pk` in the sweep directory is an index of the
+jobs, their parameters, status, time series, and final checkpoint, and is
+updated as jobs finish. Running the same sweep again in the same directory
+skips completed jobs, and restarts incomplete ones from their newest
+checkpoint.
+
+The sweep is invoked from the command line as, for example,
+
+    sailfish sweep circumbinary-disk --grid mass_ratio=0.1,0.5,1.0 \\
+        eccentricity=0.0,0.1 -n 256 -e 100 -c 10 --cores 16 -o sweep
+
+The grid key `resolution` is special, and sweeps the mesh resolution rather
+than a model parameter.
+"""
+
+import os, pickle
+from itertools import product
+from logging import getLogger
+
+logger = getLogger(__name__)
+
+SWEEP_INDEX = "sweep.pk"
+DEFAULT_ZONES_PER_THREAD = 65536
+
+
+def job_directory(index):
+    return f"job.{index:04d}"
+
+
+def load_sweep(directory):
+    """
+    Load the index of a sweep directory.
+    """
+    with open(os.path.join(directory, SWEEP_INDEX), "rb") as f:
+        return pickle.load(f)
+
+
+def write_sweep(directory, sweep):
+    """
+    Write the sweep index, replacing the old one atomically.
+    """
+    filename = os.path.join(directory, SWEEP_INDEX)
+
+    with open(filename + ".tmp", "wb") as f:
+        pickle.dump(sweep, f)
+
+    os.replace(filename + ".tmp", filename)
+
+
+def grid_points(grid):
+    """
+    Generate the dictionaries of parameters for each point on a grid.
+    """
+    keys = list(grid)
+    for values in product(*(grid[key] for key in keys)):
+        yield dict(zip(keys, values))
+
+
+def num_threads(zones, cores, zones_per_thread):
+    """
+    Return the number of threads to give a job with the given number of zones.
+
+    The result is a power of two, not more than the core budget.
+    """
+    threads = 1
+    while threads * 2 <= min(cores, zones // zones_per_thread):
+        threads *= 2
+    return threads
+
+
+def new_sweep(setup_name, grid, driver_args):
+    """
+    Create the index for a new sweep.
+    """
+    jobs = [
+        dict(
+            index=n,
+            parameters=parameters,
+            directory=job_directory(n),
+            status="pending",
+        )
+        for n, parameters in enumerate(grid_points(grid))
+    ]
+    return dict(
+        setup_name=setup_name,
+        grid=grid,
+        driver_args=driver_args,
+        jobs=jobs,
+    )
+
+
+def init_worker(threads):
+    """
+    Configure a worker process before any compiled module is loaded.
+
+    Log handlers inherited from the parent process are removed, so that job
+    output goes only to the job's log file.
+    """
+    os.environ["OMP_NUM_THREADS"] = str(threads)
+    getLogger().handlers.clear()
+
+
+def run_job(setup_name, job, driver_args, sweep_dir, threads):
+    """
+    Run one job of a sweep in a worker process, and return a summary.
+
+    The job's log is written to `sailfish.log` in its directory. If the
+    directory has checkpoints from an interrupted run, the job is restarted
+    from the newest one.
+    """
+    from logging import FileHandler, Formatter, INFO
+    from time import perf_counter
+    from sailfish.driver import (
+        DriverArgs,
+        ConfigurationError,
+        simulate,
+        append_timeseries,
+        write_checkpoint,
+        write_averages,
+        write_image,
+        append_probes,
+        newest_chkpt_in_directory,
+    )
+
+    outdir = os.path.join(sweep_dir, job["directory"])
+    os.makedirs(outdir, exist_ok=True)
+
+    handler = FileHandler(os.path.join(outdir, "sailfish.log"))
+    handler.setFormatter(Formatter("[%(name)s] %(message)s"))
+    root_logger = getLogger()
+    root_logger.addHandler(handler)
+    root_logger.setLevel(INFO)
+
+    parameters = dict(job["parameters"])
+    resolution = parameters.pop("resolution", driver_args.get("resolution"))
+    mode = "omp" if threads > 1 else "cpu"
+
+    try:
+        chkpt_file = newest_chkpt_in_directory(outdir)
+        driver = DriverArgs(
+            chkpt_file=chkpt_file,
+            model_parameters=dict(),
+            **dict(driver_args, resolution=resolution, execution_mode=mode),
+        )
+    except ConfigurationError:
+        driver = DriverArgs(
+            setup_name=setup_name,
+            model_parameters=parameters,
+            **dict(driver_args, resolution=resolution, execution_mode=mode),
+        )
+
+    start = perf_counter()
+
+    try:
+        for name, number, state in simulate(driver):
+            if name == "timeseries":
+                append_timeseries(state)
+            elif name == "checkpoint":
+                write_checkpoint(number, outdir, state)
+            elif name == "averages":
+                write_averages(number, outdir, state)
+            elif name == "image":
+                write_image(number, outdir, state)
+            elif name == "probes":
+                append_probes(outdir, state)
+            elif name == "end":
+                write_checkpoint("final", outdir, state)
+    finally:
+        root_logger.removeHandler(handler)
+        handler.close()
+
+    return dict(
+        status="complete",
+        time=state.solver.time,
+        iteration=state.iteration,
+        timeseries=state.timeseries,
+        final_checkpoint=os.path.join(job["directory"], "chkpt.final.pk"),
+        threads=threads,
+        wall_time=perf_counter() - start,
+    )
+
+
+def run_sweep(
+    setup_name,
+    grid,
+    sweep_dir,
+    driver_args=dict(),
+    cores=None,
+    zones_per_thread=DEFAULT_ZONES_PER_THREAD,
+):
+    """
+    Run a sweep, or resume one that was interrupted, and return the index.
+
+    The `driver_args` dictionary contains `DriverArgs` fields (other than the
+    setup name and model parameters) which are shared by all the jobs.
+    """
+    from concurrent.futures import ProcessPoolExecutor, wait, FIRST_COMPLETED
+    from sailfish.driver import ConfigurationError
+    from sailfish.setup_base import SetupBase
+
+    cores = cores or os.cpu_count()
+    os.makedirs(sweep_dir, exist_ok=True)
+
+    try:
+        sweep = load_sweep(sweep_dir)
+        if sweep["setup_name"] != setup_name or sweep["grid"] != grid:
+            raise ConfigurationError(
+                f"sweep directory {sweep_dir} contains a different sweep"
+            )
+        logger.info(f"resume sweep in {sweep_dir}")
+    except FileNotFoundError:
+        sweep = new_sweep(setup_name, grid, driver_args)
+        write_sweep(sweep_dir, sweep)
+        logger.info(f"start sweep in {sweep_dir}")
+
+    setup_class = SetupBase.find_setup_class(setup_name)
+    pending = list()
+
+    for job in sweep["jobs"]:
+        if job["status"] == "complete":
+            continue
+        parameters = dict(job["parameters"])
+        resolution = parameters.pop(
+            "resolution", sweep["driver_args"].get("resolution")
+        )
+        setup = setup_class(**parameters)
+        zones = setup.mesh(resolution or setup.default_resolution).num_total_zones
+        pending.append((num_threads(zones, cores, zones_per_thread), job))
+
+    logger.info(
+        f"{len(pending)} of {len(sweep['jobs'])} jobs to run with {cores} cores"
+    )
+
+    # Start the largest jobs first, so that the small ones fill in the
+    # remaining cores toward the end of the sweep.
+    pending.sort(key=lambda item: -item[0])
+    executors = dict()
+    running = dict()
+    cores_in_use = 0
+
+    try:
+        while pending or running:
+            for item in list(pending):
+                threads, job = item
+
+                if cores_in_use + threads > cores:
+                    continue
+
+                if threads not in executors:
+                    executors[threads] = ProcessPoolExecutor(
+                        max_workers=max(1, cores // threads),
+                        initializer=init_worker,
+                        initargs=(threads,),
+                    )
+                future = executors[threads].submit(
+                    run_job,
+                    setup_name,
+                    job,
+                    sweep["driver_args"],
+                    sweep_dir,
+                    threads,
+                )
+                running[future] = item
+                cores_in_use += threads
+                pending.remove(item)
+                logger.info(f"start job {job['index']} {job['parameters']}")
+
+            done, _ = wait(running, return_when=FIRST_COMPLETED)
+
+            for future in done:
+                threads, job = running.pop(future)
+                cores_in_use -= threads
+
+                try:
+                    job.update(future.result())
+                    logger.info(
+                        f"job {job['index']} complete in {job['wall_time']:0.1f}s"
+                    )
+                except Exception as e:
+                    job.update(status="failed", error=str(e))
+                    logger.warning(f"job {job['index']} failed: {e}")
+
+                write_sweep(sweep_dir, sweep)
+    finally:
+        for executor in executors.values():
+            executor.shutdown(cancel_futures=True)
+
+    return sweep
+
+
+def main(argv=None):
+    """
+    Command line interface, invoked as `sailfish sweep`.
+    """
+    import argparse
+    import sailfish.setups
+    from sailfish.driver import (
+        keyed_value,
+        init_logging,
+        load_user_config,
+        ConfigurationError,
+    )
+    from sailfish.event import Recurrence, ParseRecurrenceError
+    from sailfish.setup_base import SetupError
+    from sailfish.solvers import SolverInitializationError
+
+    def keyed_list(item):
+        key, vals = item.split("=", 1)
+        return key, [keyed_value(f"{key}={v}")[1] for v in vals.split(",")]
+
+    parser = argparse.ArgumentParser(
+        prog="sailfish sweep",
+        description="run a grid of simulations concurrently",
+    )
+    parser.add_argument("setup_name", help="setup name")
+    parser.add_argument(
+        "--grid",
+        nargs="+",
+        metavar="K=V1,V2,...",
+        type=keyed_list,
+        required=True,
+        help="model parameters (or resolution) and the values to sweep over",
+    )
+    parser.add_argument("--resolution", "-n", metavar="N", type=int)
+    parser.add_argument("--cfl", dest="cfl_number", metavar="C", type=float)
+    parser.add_argument("--fold", "-f", metavar="F", type=int)
+    parser.add_argument("--new-timestep-cadence", metavar="C", type=int)
+    parser.add_argument("--adaptive-timestep", action="store_true", default=None)
+    parser.add_argument("--end-time", "-e", metavar="T", type=float)
+    parser.add_argument("--checkpoint", "-c", metavar="C", type=Recurrence.from_str)
+    parser.add_argument("--timeseries", "-t", metavar="T", type=Recurrence.from_str)
+    parser.add_argument("--averages", metavar="A", type=Recurrence.from_str)
+    parser.add_argument("--image", metavar="I", type=Recurrence.from_str)
+    parser.add_argument("--image-fields", metavar="F", default="log_sigma")
+    parser.add_argument(
+        "--solver",
+        nargs="*",
+        metavar="K=V",
+        type=keyed_value,
+        default=list(),
+        dest="solver_options",
+        help="key-value pairs passed as options to the solver",
+    )
+    parser.add_argument(
+        "--cores",
+        metavar="N",
+        type=int,
+        help="number of cores to use (default: all)",
+    )
+    parser.add_argument(
+        "--zones-per-thread",
+        metavar="Z",
+        type=int,
+        default=DEFAULT_ZONES_PER_THREAD,
+        help="minimum number of zones per thread of a job",
+    )
+    parser.add_argument(
+        "--outdir",
+        "-o",
+        metavar="D",
+        default="sweep",
+        dest="output_directory",
+        help="directory where the sweep index and job outputs are written",
+    )
+
+    try:
+        init_logging()
+        load_user_config()
+        args = parser.parse_args(argv)
+        events = dict()
+
+        if args.checkpoint:
+            events["checkpoint"] = args.checkpoint
+        if args.timeseries:
+            events["timeseries"] = args.timeseries
+        if args.averages:
+            events["averages"] = args.averages
+        if args.image:
+            events["image"] = args.image
+
+        driver_args = dict(
+            solver_options=dict(args.solver_options),
+            cfl_number=args.cfl_number,
+            end_time=args.end_time,
+            fold=args.fold,
+            resolution=args.resolution,
+            new_timestep_cadence=args.new_timestep_cadence,
+            adaptive_timestep=args.adaptive_timestep,
+            image_fields=args.image_fields,
+            events=events,
+        )
+        run_sweep(
+            args.setup_name,
+            dict(args.grid),
+            args.output_directory,
+            driver_args=driver_args,
+            cores=args.cores,
+            zones_per_thread=args.zones_per_thread,
+        )
+
+    except ConfigurationError as e:
+        print(f"bad configuration: {e}")
+
+    except SetupError as e:
+        print(f"setup error: {e}")
+
+    except ParseRecurrenceError as e:
+        print(f"parse error: {e}")
+
+    except SolverInitializationError as e:
+        print(f"solver initialization error: {e}")
+
+    except KeyboardInterrupt:
+        print("")
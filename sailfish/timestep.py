@@ -0,0 +1,75 @@
+"""
+Adaptive control of how often the driver recomputes the time step.
+
+Recomputing the time step requires a sweep over the solution to find the
+maximum wavespeed. With a fixed cadence, that cost is paid at the same rate
+whether the wavespeed is steady or changing quickly. The `TimestepCadence`
+here instead extrapolates the recent rate of change of the maximum wavespeed,
+and schedules the next recompute for when the predicted drift would reach a
+tolerance.
+
+The cadence state depends only on the sequence of wavespeeds it has been
+given, and it is reset (forcing a recompute) after every driver event and
+on restart. A checkpoint is written at an event, so a restarted run resumes
+from the same cadence state as the continuous run, and the two remain
+bitwise identical.
+"""
+
+from math import log
+from typing import NamedTuple
+
+
+def drift_tolerance(cfl_number, maximum_cfl):
+    """
+    Return the relative wavespeed drift allowed between time step recomputes.
+
+    If the wavespeed grows by a fraction d after dt was computed, the
+    effective CFL number is cfl_number * (1 + d). The tolerance is half of
+    the value of d which would reach the solver's maximum CFL number, and at
+    most 0.1, so that the time step also stays close to optimal.
+    """
+    return min(0.5 * (maximum_cfl / cfl_number - 1.0), 0.1)
+
+
+class TimestepCadence(NamedTuple):
+    """
+    State of the adaptive time step recompute cadence.
+
+    A default-constructed instance has no wavespeed history, and is due at
+    any iteration.
+    """
+
+    last_wavespeed: float = None
+    last_iteration: int = None
+    next_iteration: int = None
+
+    def is_due(self, iteration):
+        return self.next_iteration is None or iteration >= self.next_iteration
+
+    def next(self, iteration, wavespeed, tolerance, max_interval):
+        """
+        Return the cadence state after the wavespeed was measured at the given
+        iteration.
+
+        The next recompute is scheduled when the relative wavespeed change,
+        extrapolated at the rate measured since the last recompute, would
+        reach the tolerance. The interval is at least one iteration, at most
+        `max_interval`, and at most twice the previous interval, so that it
+        lengthens gradually when the wavespeed has been steady. Without a
+        previous measurement, the next recompute is on the following
+        iteration.
+        """
+        if self.last_wavespeed is None or tolerance <= 0.0:
+            interval = 1
+        else:
+            previous = iteration - self.last_iteration
+            rate = abs(log(wavespeed / self.last_wavespeed)) / previous
+
+            if rate == 0.0:
+                interval = max_interval
+            else:
+                interval = int(tolerance / rate)
+
+            interval = max(1, min(interval, max_interval, 2 * previous))
+
+        return TimestepCadence(wavespeed, iteration, iteration + interval)
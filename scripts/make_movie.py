@@ -1,63 +1,274 @@
-import numpy as np
-import matplotlib.pyplot as plt
-import msgpack
-import os
-from pathlib import Path
+"""
+Render a movie from a sequence of checkpoints.
+
+Frames are decoded and rendered in a pool of worker processes, and streamed
+in order to ffmpeg, or written as a numbered sequence of PNG images. Each
+worker reads only the level of the checkpoint pyramid that matches the
+requested frame size (see `sailfish.driver.load_pyramid_level`), falling back
+to the full checkpoint if there is no such level. The number of frames in
+flight is bounded, so memory use does not grow with the length of the
+movie.
+
+The colormap and scale are fixed for the whole movie. If the field range is
+not given, it is taken from the first frame. So is the frame size: a frame
+of a different size is resampled to it.
+"""
+
 import argparse
+import subprocess
+import sys
+from collections import deque
+from multiprocessing import Pool, cpu_count
 
+sys.path.insert(1, ".")
 
-plt.switch_backend('agg')
+FIELDS = dict(
+    sigma=lambda p: p[..., 0],
+    vx=lambda p: p[..., 1],
+    vy=lambda p: p[..., 2],
+    speed=lambda p: (p[..., 1] ** 2 + p[..., 2] ** 2) ** 0.5,
+    pressure=lambda p: p[..., 3],
+)
 
 
-def file_load(indir, outdir, savefigbool, filename):
-    file_count = 0
-    current_path_name = Path().resolve()
-    Path('{}/output-figures'.format(current_path_name)).mkdir(parents=True, exist_ok=True)
-    max_file_count = 5  # Number of digits in the filename.
+def load_primitive(filename, pixels):
+    """
+    Return the primitive array from a checkpoint, or from its pyramid level
+    with at least the given number of zones on a side.
+    """
+    from sailfish.driver import load_checkpoint, load_pyramid_level
 
-    for name in sorted(Path(indir).iterdir()):
-        file_count += 1
-        chkpt = msgpack.load(open(name, 'rb'))
-        mesh = chkpt['mesh']
-        prim = np.zeros([mesh['ni'], mesh['nj'], 3])
-        for patch in chkpt['primitive_patches']:
-            i0 = patch['rect'][0]['start']
-            j0 = patch['rect'][1]['start']
-            i1 = patch['rect'][0]['end']
-            j1 = patch['rect'][1]['end']
-            local_prim = np.array(np.frombuffer(patch['data'])).reshape([i1 - i0, j1 - j0, 3])
-            prim[i0:i1, j0:j1] = local_prim
-        plt.imshow(prim[:,:,0].T, origin='lower')
-        plt.title(r"{} $\Sigma^{{1/4}}$".format(name))
+    if pixels is not None:
+        level = load_pyramid_level(filename, pixels)
 
-        file_count_str = str(file_count)
+        if level is not None:
+            return level[0]
 
-        if len(file_count_str) < max_file_count:
-            file_count_str = ('0' * (max_file_count - len(file_count_str))) + file_count_str
+    return load_checkpoint(filename)["solution"]
 
-        fname = '{}/output-figures/movie-{}.png'.format(current_path_name, file_count_str)
-        print(fname)
-        plt.savefig(fname, dpi=600)
 
-    make_movie(current_path_name, outdir, filename, max_file_count)
+def field_data(filename, field, pixels):
+    import numpy as np
 
-    if savefigbool is False:
-        os.system("rm -rf {}/{}".format(current_path_name, 'output-figures'))
+    prim = load_primitive(filename, pixels)
+    data = FIELDS[field.name](prim)
 
+    if field.log_scale:
+        with np.errstate(divide="ignore", invalid="ignore"):
+            data = np.log10(data)
 
-def make_movie(current_path, outdir, filename, max_count):
-    Path('{}/{}'.format(current_path, outdir)).mkdir(parents=True, exist_ok=True)
-    command = "ffmpeg -start_number 1 -i {}/output-figures/movie-%0{}d.png -c:v libx264 -vb 20M -r 30 -pix_fmt yuv420p -filter:v 'setpts=2*PTS' -y {}/movie-{}.mp4".format(current_path, max_count, outdir, filename)
+    return data
 
-    os.system(command)
 
+def render_frame(task):
+    """
+    Decode and colorize one checkpoint, returning an (rows, columns, 3)
+    array of 8-bit colors with even dimensions, as required by most video
+    encoders.
+    """
+    import numpy as np
+    from sailfish.render import colorize
 
-if __name__ == "__main__":
-    parser = argparse.ArgumentParser()
-    parser.add_argument('--indir', default='', help='Checkpoint file directory.', required=True)
-    parser.add_argument('--outdir', default='movie', help='Output movie directory.')
-    parser.add_argument('--filename', default='movie', help='Output movie name.')
-    parser.add_argument('--savefigs', default=False, help='Whether the program saves the figures used to make the movie.')
+    filename, field, pixels, cmap = task
+    data = field_data(filename, field, pixels)
+    rgb = colorize(data, field.vmin, field.vmax, cmap)
+    rows, cols, _ = rgb.shape
+    return np.pad(rgb, ((0, rows % 2), (0, cols % 2), (0, 0)), mode="edge")
+
+
+def ordered_map(pool, func, tasks, window):
+    """
+    Like `pool.imap`, but with at most `window` tasks submitted ahead of the
+    result being consumed.
+    """
+    pending = deque()
+
+    for task in tasks:
+        pending.append(pool.apply_async(func, (task,)))
+
+        if len(pending) >= window:
+            yield pending.popleft().get()
+
+    while pending:
+        yield pending.popleft().get()
+
+
+def resample(rgb, rows, cols):
+    """
+    Return an image resampled to the given size by nearest-neighbor lookup.
+    """
+    import numpy as np
+
+    i = (np.arange(rows) * rgb.shape[0]) // rows
+    j = (np.arange(cols) * rgb.shape[1]) // cols
+    return rgb[i[:, None], j[None, :]]
+
+
+class FrameSink:
+    """
+    Base class for movie outputs, which keeps every frame the size of the
+    first one. Frames change size if the resolution of the run changes, or
+    if some checkpoints have no pyramid level to read and are rendered at
+    full resolution; those frames are resampled, with a warning.
+    """
+
+    shape = None
+
+    def conform(self, rgb, n):
+        if self.shape is None:
+            self.shape = rgb.shape
+        elif rgb.shape != self.shape:
+            rows, cols, _ = self.shape
+            print(
+                f"\nframe {n + 1} is {rgb.shape[1]}x{rgb.shape[0]}, "
+                f"resampled to {cols}x{rows}"
+            )
+            rgb = resample(rgb, rows, cols)
+        return rgb
+
+
+class FFmpegSink(FrameSink):
+    def __init__(self, filename, fps, bitrate):
+        self.filename = filename
+        self.fps = fps
+        self.bitrate = bitrate
+        self.process = None
+        self.count = 0
+
+    def write(self, rgb):
+        rgb = self.conform(rgb, self.count)
+        self.count += 1
+
+        if self.process is None:
+            rows, cols, _ = rgb.shape
+            command = [
+                "ffmpeg",
+                "-loglevel",
+                "error",
+                "-y",
+                "-f",
+                "rawvideo",
+                "-pix_fmt",
+                "rgb24",
+                "-s",
+                f"{cols}x{rows}",
+                "-r",
+                str(self.fps),
+                "-i",
+                "-",
+                "-c:v",
+                "libx264",
+                "-b:v",
+                self.bitrate,
+                "-pix_fmt",
+                "yuv420p",
+                self.filename,
+            ]
+            self.process = subprocess.Popen(command, stdin=subprocess.PIPE)
+        self.process.stdin.write(rgb.tobytes())
+
+    def close(self):
+        if self.process is not None:
+            self.process.stdin.close()
+
+            if self.process.wait() != 0:
+                raise RuntimeError(f"ffmpeg exited with code {self.process.returncode}")
+
+
+class ImageSequenceSink(FrameSink):
+    def __init__(self, outdir):
+        from pathlib import Path
+
+        self.outdir = Path(outdir)
+        self.outdir.mkdir(parents=True, exist_ok=True)
+        self.count = 0
+
+    def write(self, rgb):
+        from sailfish.render import write_png
+
+        rgb = self.conform(rgb, self.count)
+        write_png(self.outdir / f"frame.{self.count:05d}.png", rgb)
+        self.count += 1
+
+    def close(self):
+        pass
+
+
+def main():
+    from sailfish.render import COLORMAPS, parse_image_fields
+
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("checkpoints", type=str, nargs="+")
+    parser.add_argument(
+        "--field",
+        "-f",
+        default="log_sigma",
+        help="field to render, as [log_]name[:vmin:vmax] with name in "
+        + ", ".join(FIELDS),
+    )
+    parser.add_argument(
+        "--pixels",
+        "-p",
+        default=None,
+        type=int,
+        help="render the coarsest pyramid level with at least this many zones on a side",
+    )
+    parser.add_argument(
+        "--cmap", default="magma", choices=COLORMAPS, help="colormap name"
+    )
+    parser.add_argument(
+        "--output",
+        "-o",
+        default="movie.mp4",
+        help="output movie, or a directory for a PNG sequence if --frames is given",
+    )
+    parser.add_argument(
+        "--frames",
+        action="store_true",
+        help="write a sequence of PNG images rather than piping to ffmpeg",
+    )
+    parser.add_argument("--fps", default=30, type=int, help="frames per second")
+    parser.add_argument("--bitrate", default="20M", help="video bitrate")
+    parser.add_argument(
+        "--processes",
+        "-j",
+        default=cpu_count(),
+        type=int,
+        help="number of worker processes",
+    )
     args = parser.parse_args()
 
-    file_load(args.indir, args.outdir, args.savefigs, args.filename)
+    (field,) = parse_image_fields(args.field)
+
+    if field.name not in FIELDS:
+        parser.error(f"unknown field {field.name}, options are {list(FIELDS)}")
+
+    if field.vmin is None:
+        import numpy as np
+
+        data = field_data(args.checkpoints[0], field, args.pixels)
+        finite = data[np.isfinite(data)]
+        field = field._replace(vmin=finite.min(), vmax=finite.max())
+        print(f"using range [{field.vmin:.4g}, {field.vmax:.4g}] from first frame")
+
+    if args.frames:
+        sink = ImageSequenceSink(args.output)
+    else:
+        sink = FFmpegSink(args.output, args.fps, args.bitrate)
+
+    tasks = ((f, field, args.pixels, args.cmap) for f in args.checkpoints)
+
+    try:
+        with Pool(args.processes) as pool:
+            frames = ordered_map(pool, render_frame, tasks, 2 * args.processes)
+
+            for n, rgb in enumerate(frames):
+                sink.write(rgb)
+                print(f"\rframe {n + 1}/{len(args.checkpoints)}", end="", flush=True)
+    finally:
+        print("")
+        sink.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,20 +1,45 @@
 import argparse
-import pickle
 import sys
 
 sys.path.insert(1, ".")
 
 
 def load_checkpoint(filename, require_solver=None):
-    with open(filename, "rb") as file:
-        chkpt = pickle.load(file)
+    from sailfish.driver import load_checkpoint
 
-        if require_solver is not None and chkpt["solver"] != require_solver:
-            raise ValueError(
-                f"checkpoint is from a run with solver {chkpt['solver']}, "
-                f"expected {require_solver}"
-            )
-        return chkpt
+    chkpt = load_checkpoint(filename)
+
+    if require_solver is not None and chkpt["solver"] != require_solver:
+        raise ValueError(
+            f"checkpoint is from a run with solver {chkpt['solver']}, "
+            f"expected {require_solver}"
+        )
+    return chkpt
+
+
+def checkpoint_solver(filename):
+    """
+    Return the name of the solver that wrote a checkpoint, reading it from
+    the checkpoint's pyramid file if there is one, since that is faster.
+    """
+    import numpy as np
+    from sailfish.driver import pyramid_filename
+
+    try:
+        with np.load(pyramid_filename(filename)) as archive:
+            return str(archive["solver"])
+    except FileNotFoundError:
+        return load_checkpoint(filename)["solver"]
+
+
+def add_pixels_argument(parser):
+    parser.add_argument(
+        "--pixels",
+        "-p",
+        default=None,
+        type=int,
+        help="plot the coarsest level of the checkpoint pyramid with at least this many zones on a side",
+    )
 
 
 def main_srhd_1d():
@@ -142,6 +167,7 @@ def main_srhd_2d():
 def main_cbdiso_2d():
     import matplotlib.pyplot as plt
     import numpy as np
+    from sailfish.driver import load_pyramid_level
 
     fields = {
         "sigma": lambda p: p[:, :, 0],
@@ -208,6 +234,7 @@ def main_cbdiso_2d():
         action="store_true",
     )
     parser.add_argument("-m", "--print-model-parameters", action="store_true")
+    add_pixels_argument(parser)
     args = parser.parse_args()
 
     class TorqueCalculation:
@@ -253,11 +280,23 @@ def main_cbdiso_2d():
 
     for filename in args.checkpoints:
         fig, ax = plt.subplots(figsize=[12, 9])
-        chkpt = load_checkpoint(filename)
-        mesh = chkpt["mesh"]
-        fields["torque"] = TorqueCalculation(mesh, chkpt["point_masses"])
+        level = None
+
+        if args.pixels is not None and args.field != "torque":
+            level = load_pyramid_level(filename, args.pixels)
 
-        if chkpt["solver"] == "cbdisodg_2d":
+        if level is not None:
+            prim, extent, _ = level
+            chkpt = None
+        else:
+            chkpt = load_checkpoint(filename)
+            mesh = chkpt["mesh"]
+            extent = mesh.x0, mesh.x1, mesh.y0, mesh.y1
+            fields["torque"] = TorqueCalculation(mesh, chkpt["point_masses"])
+
+        if chkpt is None:
+            pass
+        elif chkpt["solver"] == "cbdisodg_2d":
             prim = chkpt["primitive"]
             if args.poly is None:
                 prim = chkpt["primitive"]
@@ -271,7 +310,7 @@ def main_cbdiso_2d():
 
         f = fields[args.field](prim).T
 
-        if args.print_model_parameters:
+        if args.print_model_parameters and chkpt is not None:
             print(chkpt["model_parameters"])
 
         if args.scale_by_power is not None:
@@ -279,7 +318,6 @@ def main_cbdiso_2d():
         if args.log:
             f = np.log10(f)
 
-        extent = mesh.x0, mesh.x1, mesh.y0, mesh.y1
         cm = ax.imshow(
             f,
             origin="lower",
@@ -289,7 +327,7 @@ def main_cbdiso_2d():
             extent=extent,
         )
 
-        if args.draw_lindblad31_radius:
+        if args.draw_lindblad31_radius and chkpt is not None:
             x1 = chkpt["point_masses"][0].position_x
             y1 = chkpt["point_masses"][0].position_y
             t = np.linspace(0, 2 * np.pi, 1000)
@@ -325,6 +363,7 @@ def main_cbdisodg_2d():
 def main_cbdgam_2d():
     import matplotlib.pyplot as plt
     import numpy as np
+    from sailfish.driver import load_pyramid_level
 
     fields = {
         "sigma": lambda p: p[:, :, 0],
@@ -362,20 +401,30 @@ def main_cbdgam_2d():
         type=float,
         help="maximum value for colormap",
     )
+    add_pixels_argument(parser)
 
     args = parser.parse_args()
 
     for filename in args.checkpoints:
         fig, ax = plt.subplots(figsize=[10, 10])
-        chkpt = load_checkpoint(filename, require_solver="cbdgam_2d")
-        mesh = chkpt["mesh"]
-        prim = chkpt["solution"]
+        level = None
+
+        if args.pixels is not None:
+            level = load_pyramid_level(filename, args.pixels)
+
+        if level is not None:
+            prim, extent, _ = level
+        else:
+            chkpt = load_checkpoint(filename, require_solver="cbdgam_2d")
+            mesh = chkpt["mesh"]
+            prim = chkpt["solution"]
+            extent = mesh.x0, mesh.x1, mesh.y0, mesh.y1
+
         f = fields[args.field](prim).T
 
         if args.log:
             f = np.log10(f)
 
-        extent = mesh.x0, mesh.x1, mesh.y0, mesh.y1
         cm = ax.imshow(
             f,
             origin="lower",
@@ -394,21 +443,21 @@ def main_cbdgam_2d():
 if __name__ == "__main__":
     for arg in sys.argv:
         if arg.endswith(".pk"):
-            chkpt = load_checkpoint(arg)
-            if chkpt["solver"] == "srhd_1d":
+            solver = checkpoint_solver(arg)
+            if solver == "srhd_1d":
                 print("plotting for srhd_1d solver")
                 exit(main_srhd_1d())
-            if chkpt["solver"] == "srhd_2d":
+            if solver == "srhd_2d":
                 print("plotting for srhd_2d solver")
                 exit(main_srhd_2d())
-            if chkpt["solver"] == "cbdiso_2d":
+            if solver == "cbdiso_2d":
                 print("plotting for cbdiso_2d solver")
                 exit(main_cbdiso_2d())
-            if chkpt["solver"] == "cbdisodg_2d":
+            if solver == "cbdisodg_2d":
                 print("plotting for cbdisodg_2d solver")
                 exit(main_cbdisodg_2d())
-            if chkpt["solver"] == "cbdgam_2d":
+            if solver == "cbdgam_2d":
                 print("plotting for cbdgam_2d solver")
                 exit(main_cbdgam_2d())
             else:
-                print(f"Unknown solver {chkpt['solver']}")
+                print(f"Unknown solver {solver}")
@@ -0,0 +1,332 @@
+"""
+Time a single PRIVATE function of a solver's C code in isolation.
+
+The solver source is compiled unchanged, together with a generated PUBLIC
+kernel which calls the chosen function once per element of large input
+arrays. Each pointer parameter of the function becomes an array with one
+row per call (of width NCONS by default), each double or int parameter a
+fixed scalar (or, for doubles, optionally a per-call array), and each struct
+pointer a local struct with a given initializer. Return values are stored,
+so that the calls are not optimized away.
+
+Inputs are either random, or representative: rows of primitive variables
+sampled from the initial condition of a setup. In the latter case, pointer
+parameters whose names begin with "cons" receive the conserved variables
+computed by the solver's own `primitive_to_conserved`, through another
+generated kernel.
+
+Example:
+
+    python3 scripts/run_microbenchmark.py cbdgam_2d riemann_hlle --setup circumbinary-disk --model eos=gamma-law
+"""
+
+import argparse
+import sys
+
+sys.path.insert(1, ".")
+
+# Values of scalar parameters which are not given on the command line.
+DEFAULT_SCALARS = dict(
+    gamma_law_index=5.0 / 3.0,
+    cs2=0.01,
+    dt=1e-3,
+    h=0.1,
+    velocity_ceiling=1e16,
+    density_floor=1e-10,
+    pressure_floor=1e-12,
+    x1=1.0,
+    y1=0.5,
+    v_face=0.0,
+    dv=1.0,
+)
+
+# Initializers for struct parameters which are not given on the command line.
+POINT_MASS = "{0.5, 0.0, 0.0, 0.5, 0.5, 0.05, 10.0, 0.05, 2}"
+DEFAULT_STRUCTS = {
+    "struct PointMass*": POINT_MASS,
+    "struct PointMassList*": "{{%s, %s}}" % (POINT_MASS, POINT_MASS),
+}
+
+
+def keyed(item, cast=str):
+    key, _, value = item.partition("=")
+    return key, cast(value)
+
+
+def wrapper_code(function, widths, per_call, structs):
+    """
+    Return the source of a PUBLIC kernel named bench_<function name>, which
+    calls the function once for each of n elements.
+    """
+    args = [("    int n", "")]
+    setup = []
+    call = []
+
+    for p in function.params:
+        if p.dtype == "double*":
+            w = widths[p.name]
+            args.append((f"    double *{p.name}", f" // :: $.shape == (n, {w})"))
+            call.append(f"&{p.name}[i * {w}]")
+        elif p.dtype == "double" and p.name in per_call:
+            args.append((f"    double *{p.name}", " // :: $.shape == (n,)"))
+            call.append(f"{p.name}[i]")
+        elif p.dtype in ("double", "int"):
+            args.append((f"    {p.dtype} {p.name}", ""))
+            call.append(p.name)
+        elif p.dtype.startswith("struct "):
+            if p.name not in structs:
+                raise ValueError(f"need an initializer for {p.dtype} {p.name}")
+            setup.append(f"    {p.dtype[:-1]} {p.name} = {structs[p.name]};")
+            call.append(f"&{p.name}")
+        else:
+            raise ValueError(f"unsupported parameter type {p.dtype}")
+
+    expr = f"{function.name}({', '.join(call)})"
+
+    if function.return_type == "void":
+        body = f"{expr};"
+    else:
+        args.append(("    double *result", " // :: $.shape == (n,)"))
+        body = f"result[i] = {expr};"
+
+    return "\n".join(
+        [
+            f"PUBLIC void bench_{function.name}(",
+            *(
+                decl + ("," if k < len(args) - 1 else ")") + comment
+                for k, (decl, comment) in enumerate(args)
+            ),
+            "{",
+            *setup,
+            "    FOR_EACH_1D(n)",
+            "    {",
+            f"        {body}",
+            "    }",
+            "}",
+        ]
+    )
+
+
+def kernel_args(function, arrays, scalars, per_call, n, xp):
+    args = []
+
+    for p in function.params:
+        if p.dtype == "double*" or (p.dtype == "double" and p.name in per_call):
+            args.append(arrays[p.name])
+        elif p.dtype == "double":
+            args.append(float(scalars.get(p.name, DEFAULT_SCALARS.get(p.name, 1.0))))
+        elif p.dtype == "int":
+            args.append(int(scalars.get(p.name, 0)))
+
+    if function.return_type != "void":
+        args.append(xp.zeros(n))
+
+    return args
+
+
+def sample_primitives(args, n, rng):
+    """
+    Return n rows of primitive variables sampled from a setup's initial
+    condition.
+    """
+    import numpy as np
+    from sailfish.setup_base import SetupBase
+    from sailfish.solvers import make_solver
+    import sailfish.setups
+
+    setup = SetupBase.find_setup_class(args.setup)(**dict(args.model))
+    mesh = setup.mesh(args.resolution)
+    solver = make_solver(
+        setup.solver, setup.physics, dict(), setup=setup, mesh=mesh, time=0.0
+    )
+    prim = solver.primitive if solver.primitive is not None else solver.solution
+    prim = np.asarray(prim)
+    prim = prim.reshape(-1, prim.shape[-1])
+    return prim[rng.integers(0, prim.shape[0], n)]
+
+
+def main(args):
+    import numpy as np
+    from sailfish.kernel.library import Library
+    from sailfish.kernel.parse_api import parse_private
+    from sailfish.kernel.system import get_array_module, measure_time
+
+    xp = get_array_module(args.mode)
+    rng = np.random.default_rng(args.seed)
+    n = args.num_calls
+
+    with open(f"sailfish/solvers/{args.solver}.c") as f:
+        code = f.read()
+
+    function = parse_private(code, args.function)
+    nq = int(code.split("#define NCONS")[1].split()[0])
+    widths = dict(args.width)
+    per_call = dict(args.per_call)
+    scalars = dict(args.scalar)
+    structs = {
+        p.name: DEFAULT_STRUCTS[p.dtype]
+        for p in function.params
+        if p.dtype in DEFAULT_STRUCTS
+    }
+    structs.update(args.struct)
+
+    for p in function.params:
+        if p.dtype == "double*":
+            widths.setdefault(p.name, nq)
+
+    kernels = [wrapper_code(function, widths, per_call, structs)]
+
+    if args.setup:
+        prim = sample_primitives(args, n, rng)
+        cons_params = [
+            p.name
+            for p in function.params
+            if p.dtype == "double*" and p.name.startswith("cons")
+        ]
+        if cons_params and function.name != "primitive_to_conserved":
+            p2c = parse_private(code, "primitive_to_conserved")
+            p2c_widths = {p.name: prim.shape[1] for p in p2c.params}
+            kernels.append(wrapper_code(p2c, p2c_widths, dict(), dict()))
+    else:
+        prim = None
+        cons_params = []
+
+    lib = Library(
+        code + "\n" + "\n".join(kernels),
+        mode=args.mode,
+        name="microbenchmark",
+        debug=False,
+        define_macros=dict(args.define),
+    )
+
+    if cons_params and function.name != "primitive_to_conserved":
+        p2c_arrays = {
+            p.name: xp.zeros((n, prim.shape[1]))
+            for p in p2c.params
+            if p.dtype == "double*"
+        }
+        p2c_arrays[p2c.params[0].name][...] = xp.array(prim)
+        lib.bench_primitive_to_conserved[n](
+            *kernel_args(p2c, p2c_arrays, scalars, dict(), n, xp)
+        )
+        cons = p2c_arrays[p2c.params[1].name]
+
+    arrays = dict()
+
+    for p in function.params:
+        if p.dtype == "double*":
+            w = widths[p.name]
+            if p.name in cons_params:
+                arrays[p.name] = xp.array(cons[:, :w])
+            elif prim is not None and prim.shape[1] >= w:
+                arrays[p.name] = xp.array(prim[rng.permutation(n), :w])
+            else:
+                lo, hi = args.range
+                arrays[p.name] = xp.array(rng.uniform(lo, hi, (n, w)))
+        elif p.dtype == "double" and p.name in per_call:
+            lo, hi = per_call[p.name]
+            arrays[p.name] = xp.array(rng.uniform(lo, hi, n))
+
+    kernel = getattr(lib, f"bench_{function.name}")[n]
+    call_args = kernel_args(function, arrays, scalars, per_call, n, xp)
+    kernel(*call_args)
+    times = []
+
+    for _ in range(args.repeat):
+        with measure_time(args.mode) as duration:
+            kernel(*call_args)
+        times.append(duration())
+
+    best = min(times)
+    nbytes = sum(a.nbytes for a in call_args if hasattr(a, "nbytes"))
+
+    print(
+        f"{args.solver}.{function.name} ({', '.join(p.name for p in function.params)})"
+    )
+    print(f"inputs: {'sampled from ' + args.setup if args.setup else 'random'}")
+    print(f"calls:  {n} x {args.repeat} repeats")
+    print(
+        f"time:   {best * 1e9 / n:.2f} ns/call (best), {sum(times) / len(times) * 1e9 / n:.2f} ns/call (mean)"
+    )
+    print(
+        f"rate:   {n / best * 1e-6:.1f} Mcalls/s, {nbytes / best * 1e-9:.2f} GB/s of arguments"
+    )
+
+    if args.show_code:
+        print("\n".join(kernels))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="time a PRIVATE function of a solver's C code in isolation"
+    )
+    parser.add_argument("solver", help="solver module name, e.g. cbdgam_2d")
+    parser.add_argument("function", help="name of the PRIVATE function")
+    parser.add_argument("--num-calls", "-n", type=int, default=1 << 20)
+    parser.add_argument("--repeat", type=int, default=10)
+    parser.add_argument("--mode", default="cpu", help="execution mode")
+    parser.add_argument(
+        "--setup", help="sample primitive inputs from this setup's initial condition"
+    )
+    parser.add_argument(
+        "--model",
+        nargs="*",
+        metavar="K=V",
+        type=keyed,
+        default=[],
+        help="model parameters for the setup",
+    )
+    parser.add_argument("--resolution", type=int, default=64)
+    parser.add_argument(
+        "--range",
+        nargs=2,
+        type=float,
+        default=(0.1, 1.0),
+        metavar=("LO", "HI"),
+        help="range of random inputs",
+    )
+    parser.add_argument(
+        "--scalar",
+        nargs="*",
+        metavar="K=V",
+        type=lambda item: keyed(item, float),
+        default=[],
+        help="values of scalar parameters",
+    )
+    parser.add_argument(
+        "--per-call",
+        nargs="*",
+        metavar="K=LO:HI",
+        type=lambda item: keyed(item, lambda v: tuple(map(float, v.split(":")))),
+        default=[],
+        help="double parameters to draw per call from a uniform range",
+    )
+    parser.add_argument(
+        "--width",
+        nargs="*",
+        metavar="K=W",
+        type=lambda item: keyed(item, int),
+        default=[],
+        help="row widths of pointer parameters (default NCONS)",
+    )
+    parser.add_argument(
+        "--struct",
+        nargs="*",
+        metavar="K={...}",
+        type=keyed,
+        default=[],
+        help="C initializers of struct parameters",
+    )
+    parser.add_argument(
+        "--define",
+        nargs="*",
+        metavar="K=V",
+        type=keyed,
+        default=[],
+        help="macros to define when compiling the solver code",
+    )
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument(
+        "--show-code", action="store_true", help="print the generated kernels"
+    )
+    main(parser.parse_args())
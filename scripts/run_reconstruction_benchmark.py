@@ -0,0 +1,167 @@
+"""
+Compare the time-to-accuracy of the reconstruction schemes (PLM, PPM, and
+WENO5) of the cbdiso_2d and cbdgam_2d solvers.
+
+The advected-vortex setup is run at a sequence of resolutions with each
+reconstruction. The L1 error of the density, with respect to the exact
+solution averaged over each zone, is recorded along with the wall-clock time
+of the run. The errors and times are then interpolated (in log-log space) to
+estimate the time each scheme needs to reach a target error. The default
+target is the error of PLM at the highest resolution.
+"""
+
+import argparse
+import sys
+import time
+
+sys.path.insert(1, ".")
+
+RECONSTRUCTIONS = ("plm", "ppm", "weno5")
+
+
+def exact_density(setup, mesh, time, quad_order=3):
+    """
+    Return the exact density averaged over each zone of the mesh, by
+    Gaussian quadrature.
+    """
+    import numpy as np
+    from numpy.polynomial.legendre import leggauss
+
+    points, weights = leggauss(quad_order)
+    ni, nj = mesh.shape
+    prim = np.zeros(4)
+    rho = np.zeros((ni, nj))
+
+    for i in range(ni):
+        for j in range(nj):
+            xc, yc = mesh.cell_coordinates(i, j)
+            for a, wa in zip(points, weights):
+                for b, wb in zip(points, weights):
+                    x = xc + 0.5 * a * mesh.dx
+                    y = yc + 0.5 * b * mesh.dy
+                    setup.primitive(time, (x, y), prim)
+                    rho[i, j] += 0.25 * wa * wb * prim[0]
+    return rho
+
+
+def run_one(eos, reconstruction, resolution, end_time, mode):
+    """
+    Run the advected-vortex setup and return its L1 density error and the
+    wall-clock time of the run.
+    """
+    from numpy import abs, array, mean
+    from sailfish.driver import run
+
+    start = time.perf_counter()
+    state = run(
+        "advected-vortex",
+        resolution=resolution,
+        end_time=end_time,
+        model_parameters=dict(eos=eos),
+        solver_options=(
+            dict(reconstruction=reconstruction, rk_order=3)
+            if eos == "isothermal"
+            else dict(reconstruction=reconstruction)
+        ),
+        execution_mode=mode,
+        quiet=True,
+    )
+    elapsed = time.perf_counter() - start
+    rho = array(state.solver.solution[..., 0])
+    exact = exact_density(state.setup, state.mesh, state.solver.time)
+    return mean(abs(rho - exact)), elapsed
+
+
+def time_to_accuracy(errors, times, target):
+    """
+    Return the time to reach the target error, interpolating log(time)
+    linearly in log(error), or None if the target is outside the range of
+    measured errors.
+    """
+    from numpy import interp, log, exp
+
+    if not min(errors) <= target <= max(errors):
+        return None
+    return exp(interp(log(target), log(errors[::-1]), log(times[::-1])))
+
+
+def main(args):
+    from numpy import log2
+
+    resolutions = [int(n) for n in args.resolutions.split(",")]
+    errors = dict()
+    times = dict()
+
+    # Compile the solver kernels before any timed runs.
+    for reconstruction in RECONSTRUCTIONS:
+        run_one(args.eos, reconstruction, 16, 0.01, args.mode)
+
+    for reconstruction in RECONSTRUCTIONS:
+        errors[reconstruction] = list()
+        times[reconstruction] = list()
+
+        for n, res in enumerate(resolutions):
+            err, elapsed = run_one(
+                args.eos, reconstruction, res, args.end_time, args.mode
+            )
+            errors[reconstruction].append(err)
+            times[reconstruction].append(elapsed)
+
+            if n > 0:
+                prev = errors[reconstruction][n - 1]
+                rate = log2(prev / err) / log2(res / resolutions[n - 1])
+                rate = f"{rate:.2f}"
+            else:
+                rate = "-"
+
+            print(
+                f"{reconstruction:5s} N={res:4d} L1={err:.3e} "
+                f"order={rate:>5s} time={elapsed:.2f}s"
+            )
+
+    target = args.target or errors["plm"][-1]
+    print(f"\ntime to reach L1 = {target:.3e}:")
+
+    for reconstruction in RECONSTRUCTIONS:
+        t = time_to_accuracy(errors[reconstruction], times[reconstruction], target)
+        print(f"{reconstruction:5s} " + (f"{t:.2f}s" if t else "out of range"))
+
+    if args.plot:
+        from matplotlib import pyplot as plt
+
+        fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(10, 4))
+
+        for reconstruction in RECONSTRUCTIONS:
+            ax1.loglog(resolutions, errors[reconstruction], "-o", label=reconstruction)
+            ax2.loglog(times[reconstruction], errors[reconstruction], "-o")
+
+        ax1.set_xlabel(r"$N$")
+        ax1.set_ylabel(r"$L_1$")
+        ax2.set_xlabel("wall time [s]")
+        ax1.legend()
+        plt.show()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--eos",
+        default="isothermal",
+        choices=["isothermal", "gamma-law"],
+        help="the equation of state (selects the cbdiso_2d or cbdgam_2d solver)",
+    )
+    parser.add_argument(
+        "--resolutions",
+        default="32,64,128",
+        help="comma-separated list of resolutions",
+    )
+    parser.add_argument("--end-time", type=float, default=1.0)
+    parser.add_argument("--mode", default="cpu", help="execution mode")
+    parser.add_argument(
+        "--target",
+        type=float,
+        default=None,
+        help="target L1 error (default: PLM error at the highest resolution)",
+    )
+    parser.add_argument("--plot", action="store_true", help="plot the results")
+    main(parser.parse_args())
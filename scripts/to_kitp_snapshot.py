@@ -1,7 +1,11 @@
-import pickle
 import argparse
+import sys
 import numpy as np
 
+sys.path.insert(1, ".")
+
+from sailfish.driver import load_checkpoint
+
 parser = argparse.ArgumentParser()
 parser.add_argument("filenames", nargs="+")
 args = parser.parse_args()
@@ -17,7 +21,7 @@ for filename in args.filenames:
 
     # continue
 
-    chkpt = pickle.load(open(filename, "rb"))
+    chkpt = load_checkpoint(filename)
     mesh = chkpt["mesh"]
     solution = chkpt["solution"]
 